@@ -115,5 +115,122 @@ void mirror_bounds_1d
 	return;
 }
 
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/* Halo validity tracking                                                   */
+/*                                                                          */
+/* A bounds_tracker remembers which planes currently have mirrored          */
+/* boundaries. mirror_bounds_2d_tracked only mirrors a plane whose interior */
+/* (or size) changed since its last mirror; whoever writes to the interior  */
+/* of a tracked plane has to call bounds_mark_dirty afterwards.             */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+#define BOUNDS_TRACKER_SIZE 16
+
+typedef struct
+{
+    float **A [BOUNDS_TRACKER_SIZE];  /* planes with valid mirrored halos   */
+    int   nx [BOUNDS_TRACKER_SIZE];   /* their sizes when they were mirrored */
+    int   ny [BOUNDS_TRACKER_SIZE];
+    int   bx [BOUNDS_TRACKER_SIZE];
+    int   by [BOUNDS_TRACKER_SIZE];
+    int   count;                      /* number of valid planes             */
+    long  refreshes;                  /* halos mirrored                     */
+    long  skipped;                    /* mirrors avoided                    */
+} bounds_tracker;
+
+/*--------------------------------------------------------------------------*/
+
+
+void bounds_tracker_init
+(
+                          /***************************************************/
+    bounds_tracker *t     /* tracker without valid planes and counters       */
+                          /***************************************************/
+)
+{
+t->count     = 0;
+t->refreshes = 0;
+t->skipped   = 0;
+}
+
+/*--------------------------------------------------------------------------*/
+
+
+void bounds_mark_dirty
+(
+                          /***************************************************/
+    bounds_tracker *t,    /* tracker                                         */
+    float          **A    /* plane whose interior has been modified          */
+                          /***************************************************/
+)
+
+/* invalidates the halo of A */
+
+{
+int  k;
+
+for (k=0; k<t->count; k++)
+    if (t->A[k] == A)
+    {
+        t->count--;
+        t->A [k] = t->A [t->count];
+        t->nx[k] = t->nx[t->count];
+        t->ny[k] = t->ny[t->count];
+        t->bx[k] = t->bx[t->count];
+        t->by[k] = t->by[t->count];
+        return;
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+
+
+void mirror_bounds_2d_tracked
+(
+                     /********************************************************/
+    bounds_tracker *t,/* tracker                                             */
+    float **A,       /* image matrix                                         */
+    int   nx,        /* size in x direction                                  */
+    int   ny,        /* size in y direction                                  */
+    int   bx,        /* boundary in x direction                              */
+    int   by         /* boundary in y direction                              */
+                     /********************************************************/
+)
+
+/* mirrors the boundaries of A unless they are still valid */
+
+{
+int  k;
+
+for (k=0; k<t->count; k++)
+    if (t->A[k] == A)
+    {
+        if ((t->nx[k] == nx) && (t->ny[k] == ny) &&
+            (t->bx[k] == bx) && (t->by[k] == by))
+        {
+            t->skipped++;
+            return;
+        }
+        bounds_mark_dirty(t,A);
+        break;
+    }
+
+mirror_bounds_2d(A,nx,ny,bx,by);
+t->refreshes++;
+
+/* remember A; if the table is full it is simply mirrored every time */
+if (t->count < BOUNDS_TRACKER_SIZE)
+{
+    t->A [t->count] = A;
+    t->nx[t->count] = nx;
+    t->ny[t->count] = ny;
+    t->bx[t->count] = bx;
+    t->by[t->count] = by;
+    t->count++;
+}
+}
+
 /*--------------------------------------------------------------------------*/
 #endif
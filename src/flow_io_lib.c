@@ -0,0 +1,498 @@
+#ifndef FLOW_IO_LIB_INCLUDED
+#define FLOW_IO_LIB_INCLUDED
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Flow field files with bulk I/O:                                           */
+/*                                                                           */
+/*  - Middlebury .flo: float tag 202021.25, int width, int height, rows of   */
+/*    interleaved (u,v) floats. Written with a single fwrite, read through   */
+/*    a memory mapping.                                                      */
+/*  - flow streams: a fixed 64 byte header (flow_stream_header) followed by  */
+/*    raw frames of constant size in float32 or float16. Frames are appended */
+/*    with one fwrite each and can be replayed from a mapping without any    */
+/*    per-sample system calls; flow_stream_frame gives zero-copy access.    */
+/*                                                                           */
+/* All files are written in the byte order of the machine (little endian    */
+/* on x86, as required by the .flo format).                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "console_lib.c"
+#include "mmap_lib.c"
+#include "half_lib.c"
+#include "flow_io_lib.h"
+
+/*---------------------------------------------------------------------------*/
+
+void interleave_flow_row
+(
+                     /********************************************************/
+    float **u,       /* in  : x-component of flow field                      */
+    float **v,       /* in  : y-component of flow field                      */
+    int   nx,        /* in  : size in x-direction                            */
+    int   bx,        /* in  : boundary size in x-direction                   */
+    int   j,         /* in  : row index (including boundary)                 */
+    float *row       /* out : nx interleaved (u,v) pairs                     */
+                     /********************************************************/
+)
+{
+int i;
+
+for (i=0; i<nx; i++)
+{
+    row[2*i  ] = u[i+bx][j];
+    row[2*i+1] = v[i+bx][j];
+}
+}
+
+/*---------------------------------------------------------------------------*/
+
+void deinterleave_flow_row
+(
+                       /******************************************************/
+    const float *row,  /* in  : nx interleaved (u,v) pairs                   */
+    float       **u,   /* out : x-component of flow field                    */
+    float       **v,   /* out : y-component of flow field                    */
+    int         nx,    /* in  : size in x-direction                          */
+    int         bx,    /* in  : boundary size in x-direction                 */
+    int         j      /* in  : row index (including boundary)               */
+                       /******************************************************/
+)
+{
+int i;
+
+for (i=0; i<nx; i++)
+{
+    u[i+bx][j] = row[2*i  ];
+    v[i+bx][j] = row[2*i+1];
+}
+}
+
+/*---------------------------------------------------------------------------*/
+
+int write_flo_data
+(
+    char *filename, /* in : file name */
+    float **u,     /* in : x-component of vector data */
+    float **v,     /* in : y-component of vector data */
+    int  nx,      /* in : size in x-direction */
+    int  ny,      /* in : size in y-direction */
+    int  bx,      /* in : boundary in x-direction */
+    int  by       /* in : boundary in y-direction */
+)
+
+/* writes a Middlebury .flo file with a single fwrite; returns 1 on       */
+/* success, 0 on failure                                                     */
+
+{
+    FILE   *file;   /* file pointer */
+    float  *buffer; /* header and data */
+    size_t size;    /* number of floats in buffer */
+    int    j;       /* loop variable */
+    int    ok;      /* 1 if the file was written completely */
+
+    size   = 3 + 2 * (size_t)nx * ny;
+    buffer = (float*)malloc(size * sizeof(float));
+    if (buffer == NULL)
+    {
+	console_error("Cannot allocate buffer for %s!\n", filename);
+	return 0;
+    }
+
+    /* header */
+    buffer[0] = FLO_TAG;
+    memcpy(buffer+1, &nx, sizeof(int));
+    memcpy(buffer+2, &ny, sizeof(int));
+
+    /* data */
+    for (j=by; j<ny+by; j++)
+	interleave_flow_row(u, v, nx, bx, j, buffer + 3 + 2*(size_t)nx*(j-by));
+
+    if ((file = fopen(filename,"wb")) == NULL)
+    {
+	console_error("Could not open file %s!\n", filename);
+	free(buffer);
+	return 0;
+    }
+    /* fclose flushes the stream, so a full disk may only show up there */
+    ok = (fwrite(buffer, sizeof(float), size, file) == size);
+    if (fclose(file) != 0)
+	ok = 0;
+    if (!ok)
+	console_error("Could not write file %s!\n", filename);
+    free(buffer);
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int read_flo_size
+(
+    const char *filename, /* in  : file name */
+    int        *nx,       /* out : size in x-direction */
+    int        *ny        /* out : size in y-direction */
+)
+
+/* reads the dimensions of a .flo file; returns 1 on success, 0 on failure */
+
+{
+    FILE  *file;
+    float tag;
+    int   ok;
+
+    if ((file = fopen(filename,"rb")) == NULL)
+    {
+	console_error("Could not open file %s!\n", filename);
+	return 0;
+    }
+    ok = (fread(&tag, sizeof(float), 1, file) == 1)
+      && (fread(nx, sizeof(int), 1, file) == 1)
+      && (fread(ny, sizeof(int), 1, file) == 1)
+      && (tag == FLO_TAG);
+    fclose(file);
+
+    if (!ok)
+	console_error("File %s is not a .flo file!\n", filename);
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int read_flo_data
+(
+    const char *filename, /* in : file name */
+    float **u,     /* out : x-component of vector data */
+    float **v,     /* out : y-component of vector data */
+    int  nx,      /* in : size in x-direction */
+    int  ny,      /* in : size in y-direction */
+    int  bx,      /* in : boundary in x-direction */
+    int  by       /* in : boundary in y-direction */
+)
+
+/* reads a .flo file of known size through a memory mapping; returns 1 on */
+/* success and 0 on failure (wrong tag, size or truncated file)           */
+
+{
+    mapped_file  m;
+    const float  *data;
+    int          nxf = 0, nyf = 0, j;
+
+    if (!map_file_read(filename, &m))
+	return 0;
+
+    data = (const float*)m.data;
+    if (m.size >= 3 * sizeof(float))
+    {
+	memcpy(&nxf, data+1, sizeof(int));
+	memcpy(&nyf, data+2, sizeof(int));
+    }
+    if ((m.size < 3 * sizeof(float)) || (data[0] != FLO_TAG))
+    {
+	console_error("File %s is not a .flo file!\n", filename);
+	unmap_file(&m);
+	return 0;
+    }
+    if ((nxf != nx) || (nyf != ny)
+        || (m.size < (3 + 2 * (size_t)nx * ny) * sizeof(float)))
+    {
+	console_error("File %s has wrong dimensions or is truncated!\n",
+	              filename);
+	unmap_file(&m);
+	return 0;
+    }
+
+    for (j=by; j<ny+by; j++)
+	deinterleave_flow_row(data + 3 + 2*(size_t)nx*(j-by), u, v, nx, bx, j);
+
+    unmap_file(&m);
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int flow_stream_open_write
+(
+                               /**********************************************/
+    flow_stream_writer *s,     /* out : stream                                */
+    const char         *filename, /* in : file to be created                  */
+    int                nx,     /* in  : frame size in x-direction             */
+    int                ny,     /* in  : frame size in y-direction             */
+    int                encoding/* in  : FLOW_STREAM_FLOAT32 or _FLOAT16       */
+                               /**********************************************/
+)
+
+/* creates a flow stream; returns 1 on success and 0 on failure */
+
+{
+size_t sample_bytes;
+
+memset(s,0,sizeof(flow_stream_writer));
+if ((encoding != FLOW_STREAM_FLOAT32) && (encoding != FLOW_STREAM_FLOAT16))
+{
+    console_error("Unknown flow stream encoding %d!\n", encoding);
+    return 0;
+}
+
+sample_bytes = (encoding == FLOW_STREAM_FLOAT16) ? sizeof(half_float)
+                                                 : sizeof(float);
+memcpy(s->header.magic,FLOW_STREAM_MAGIC,4);
+s->header.version     = FLOW_STREAM_VERSION;
+s->header.nx          = nx;
+s->header.ny          = ny;
+s->header.encoding    = encoding;
+s->header.frames      = 0;
+s->header.frame_bytes = 2 * (long long)nx * ny * sample_bytes;
+
+/* the float row in front of the encoded frame is the conversion buffer */
+s->buffer = malloc(2 * (size_t)nx * sizeof(float) + s->header.frame_bytes);
+if (s->buffer == NULL)
+{
+    console_error("Cannot allocate flow stream buffer!\n");
+    return 0;
+}
+if ((s->file = fopen(filename,"wb")) == NULL)
+{
+    console_error("Could not open file %s!\n", filename);
+    free(s->buffer);
+    s->buffer = NULL;
+    return 0;
+}
+if (fwrite(&s->header,sizeof(flow_stream_header),1,s->file) != 1)
+{
+    console_error("Could not write file %s!\n", filename);
+    fclose(s->file);
+    free(s->buffer);
+    s->file   = NULL;
+    s->buffer = NULL;
+    return 0;
+}
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int flow_stream_write_frame
+(
+                               /**********************************************/
+    flow_stream_writer *s,     /* in+out : stream                             */
+    float              **u,    /* in     : x-component of flow field          */
+    float              **v,    /* in     : y-component of flow field          */
+    int                bx,     /* in     : boundary size in x-direction       */
+    int                by      /* in     : boundary size in y-direction       */
+                               /**********************************************/
+)
+
+/* appends one frame with a single fwrite; returns 1 on success */
+
+{
+int        nx  = s->header.nx;
+int        ny  = s->header.ny;
+float      *row   = (float*)s->buffer;
+char       *frame = (char*)s->buffer + 2 * (size_t)nx * sizeof(float);
+int        j;
+
+for (j=by; j<ny+by; j++)
+{
+    if (s->header.encoding == FLOW_STREAM_FLOAT16)
+    {
+        interleave_flow_row(u,v,nx,bx,j,row);
+        float_to_half_array(row,(half_float*)frame + 2*(size_t)nx*(j-by),
+                            2*(size_t)nx);
+    }
+    else
+        interleave_flow_row(u,v,nx,bx,j,(float*)frame + 2*(size_t)nx*(j-by));
+}
+
+if (fwrite(frame,1,(size_t)s->header.frame_bytes,s->file)
+    != (size_t)s->header.frame_bytes)
+{
+    console_error("Could not write flow stream frame %lld!\n",
+                  s->header.frames);
+    return 0;
+}
+s->header.frames++;
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void flow_stream_close_write
+(
+                               /**********************************************/
+    flow_stream_writer *s      /* in+out : stream                             */
+                               /**********************************************/
+)
+
+/* completes the header with the number of frames and closes the file */
+
+{
+if (s->file)
+{
+    fseek(s->file,0,SEEK_SET);
+    fwrite(&s->header,sizeof(flow_stream_header),1,s->file);
+    fclose(s->file);
+}
+free(s->buffer);
+s->file   = NULL;
+s->buffer = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int flow_stream_open_read
+(
+                               /**********************************************/
+    flow_stream_reader *s,     /* out : stream                                */
+    const char         *filename /* in : file to be mapped                    */
+                               /**********************************************/
+)
+
+/* maps a flow stream; returns 1 on success and 0 on failure. A stream that */
+/* was not closed properly still replays all complete frames.               */
+
+{
+long long frames;
+size_t    sample_bytes;   /* bytes of one flow component                  */
+size_t    samples;        /* flow components per frame                    */
+
+if (!map_file_read(filename,&s->map))
+    return 0;
+
+if (s->map.size < sizeof(flow_stream_header))
+{
+    console_error("File %s is not a flow stream!\n", filename);
+    unmap_file(&s->map);
+    return 0;
+}
+memcpy(&s->header,s->map.data,sizeof(flow_stream_header));
+if ((memcmp(s->header.magic,FLOW_STREAM_MAGIC,4) != 0)
+    || (s->header.version != FLOW_STREAM_VERSION)
+    || (s->header.frame_bytes <= 0))
+{
+    console_error("File %s is not a flow stream!\n", filename);
+    unmap_file(&s->map);
+    return 0;
+}
+
+/* the frame size must be that of the grid and the encoding, otherwise */
+/* decoding would read past the end of a frame                         */
+if (s->header.encoding == FLOW_STREAM_FLOAT32)
+    sample_bytes = sizeof(float);
+else if (s->header.encoding == FLOW_STREAM_FLOAT16)
+    sample_bytes = sizeof(half_float);
+else
+    sample_bytes = 0;
+if ((sample_bytes == 0) || (s->header.nx <= 0) || (s->header.ny <= 0)
+    || ((size_t)s->header.nx > SIZE_MAX / 2 / sample_bytes
+                               / (size_t)s->header.ny))
+{
+    console_error("Flow stream %s has an invalid grid or encoding!\n",
+                  filename);
+    unmap_file(&s->map);
+    return 0;
+}
+samples = 2 * (size_t)s->header.nx * (size_t)s->header.ny;
+if ((unsigned long long)s->header.frame_bytes != samples * sample_bytes)
+{
+    console_error("Flow stream %s has %lld bytes per frame, expected %zu!\n",
+                  filename, s->header.frame_bytes, samples * sample_bytes);
+    unmap_file(&s->map);
+    return 0;
+}
+
+frames = ((long long)s->map.size - FLOW_STREAM_HEADER) / s->header.frame_bytes;
+if ((s->header.frames == 0) || (s->header.frames > frames))
+    s->header.frames = frames;
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+const void *flow_stream_frame
+(
+                               /**********************************************/
+    flow_stream_reader *s,     /* in : stream                                 */
+    long long          k       /* in : frame number                           */
+                               /**********************************************/
+)
+
+/* returns a pointer to the raw samples of frame k inside the mapping */
+
+{
+if ((k < 0) || (k >= s->header.frames))
+    return NULL;
+return (const char*)s->map.data + FLOW_STREAM_HEADER + k * s->header.frame_bytes;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int flow_stream_read_frame
+(
+                               /**********************************************/
+    flow_stream_reader *s,     /* in  : stream                                */
+    long long          k,      /* in  : frame number                          */
+    float              **u,    /* out : x-component of flow field             */
+    float              **v,    /* out : y-component of flow field             */
+    int                bx,     /* in  : boundary size in x-direction          */
+    int                by      /* in  : boundary size in y-direction          */
+                               /**********************************************/
+)
+
+/* decodes frame k into the planes u,v; returns 1 on success */
+
+{
+int        nx = s->header.nx;
+int        ny = s->header.ny;
+const char *frame = (const char*)flow_stream_frame(s,k);
+float      *row;
+int        j;
+
+if (frame == NULL)
+{
+    console_error("Flow stream has no frame %lld!\n", k);
+    return 0;
+}
+
+if (s->header.encoding == FLOW_STREAM_FLOAT16)
+{
+    row = (float*)malloc(2 * (size_t)nx * sizeof(float));
+    if (row == NULL)
+    {
+        console_error("Out of memory decoding flow stream frame %lld!\n", k);
+        return 0;
+    }
+    for (j=by; j<ny+by; j++)
+    {
+        half_to_float_array((const half_float*)frame + 2*(size_t)nx*(j-by),
+                            row, 2*(size_t)nx);
+        deinterleave_flow_row(row,u,v,nx,bx,j);
+    }
+    free(row);
+}
+else
+    for (j=by; j<ny+by; j++)
+        deinterleave_flow_row((const float*)frame + 2*(size_t)nx*(j-by),
+                              u,v,nx,bx,j);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void flow_stream_close_read
+(
+                               /**********************************************/
+    flow_stream_reader *s      /* in+out : stream                             */
+                               /**********************************************/
+)
+{
+unmap_file(&s->map);
+}
+
+/*---------------------------------------------------------------------------*/
+#endif
@@ -0,0 +1,77 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Flow field files (see flow_io_lib.c).                                     */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef FLOW_IO_LIB_H_INCLUDED
+#define FLOW_IO_LIB_H_INCLUDED
+
+#include <stdio.h>
+#include "mmap_lib.h"
+
+#define FLO_TAG              202021.25f
+#define FLOW_STREAM_MAGIC    "OFST"
+#define FLOW_STREAM_VERSION  1
+#define FLOW_STREAM_HEADER   64
+
+/* sample encodings of a flow stream */
+#define FLOW_STREAM_FLOAT32  0
+#define FLOW_STREAM_FLOAT16  1
+
+/* fixed 64 byte header of a flow stream file, followed by the frames;     */
+/* frame k starts at byte FLOW_STREAM_HEADER + k * frame_bytes and holds   */
+/* rows of interleaved (u,v) samples like the payload of a .flo file       */
+typedef struct
+{
+  char      magic[4];      /* "OFST"                                        */
+  int       version;       /* FLOW_STREAM_VERSION                           */
+  int       nx, ny;        /* frame size                                    */
+  int       encoding;      /* FLOW_STREAM_FLOAT32 or FLOW_STREAM_FLOAT16    */
+  int       reserved;      /* zero                                          */
+  long long frames;        /* number of frames in the file                  */
+  long long frame_bytes;   /* bytes per frame                               */
+  char      padding[24];   /* zero, pads the header to 64 bytes             */
+} flow_stream_header;
+
+typedef struct
+{
+  FILE               *file;    /* output file                               */
+  flow_stream_header header;   /* header, frames counted while writing      */
+  void               *buffer;  /* one encoded frame                         */
+} flow_stream_writer;
+
+typedef struct
+{
+  mapped_file        map;      /* the whole file, mapped read-only          */
+  flow_stream_header header;   /* copy of the header                        */
+} flow_stream_reader;
+
+int  write_flo_data
+     (char *filename, float **u, float **v, int nx, int ny, int bx, int by);
+int  read_flo_size
+     (const char *filename, int *nx, int *ny);
+int  read_flo_data
+     (const char *filename, float **u, float **v, int nx, int ny,
+      int bx, int by);
+
+int  flow_stream_open_write
+     (flow_stream_writer *s, const char *filename, int nx, int ny,
+      int encoding);
+int  flow_stream_write_frame
+     (flow_stream_writer *s, float **u, float **v, int bx, int by);
+void flow_stream_close_write
+     (flow_stream_writer *s);
+
+int  flow_stream_open_read
+     (flow_stream_reader *s, const char *filename);
+const void *flow_stream_frame
+     (flow_stream_reader *s, long long k);
+int  flow_stream_read_frame
+     (flow_stream_reader *s, long long k, float **u, float **v,
+      int bx, int by);
+void flow_stream_close_read
+     (flow_stream_reader *s);
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef HALF_LIB_INCLUDED
+#define HALF_LIB_INCLUDED
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* IEEE 754 half precision (float16) and bfloat16 conversion.                */
+/*                                                                           */
+/* Scalar conversions round to nearest even and handle subnormals, infinity  */
+/* and NaN. The array versions use the F16C instructions when the unit is    */
+/* compiled for them (e.g. VARIANT=avx2) and fall back to the scalar code.   */
+/* bfloat16 is the upper half of a float; its array versions use AVX2 shifts */
+/* when available.                                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <stddef.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+typedef unsigned short half_float;
+typedef unsigned short bfloat16;
+
+/*---------------------------------------------------------------------------*/
+
+half_float float_to_half (float f)
+
+/* converts a float to half precision, rounding to nearest even */
+
+{
+unsigned int x, sign, mant, rem, halfway;
+int          e, shift;
+half_float   h;
+
+memcpy(&x,&f,sizeof(float));
+sign = (x >> 16) & 0x8000;
+mant = x & 0x7fffff;
+e    = (int)((x >> 23) & 0xff);
+
+/* infinity and NaN */
+if (e == 0xff)
+    return (half_float)(sign | 0x7c00 | (mant ? 0x200 : 0));
+
+e = e - 127 + 15;
+
+/* overflow to infinity */
+if (e >= 31)
+    return (half_float)(sign | 0x7c00);
+
+/* subnormal result or underflow to zero */
+if (e <= 0)
+{
+    if (e < -10)
+        return (half_float)sign;
+    mant   |= 0x800000;
+    shift   = 14 - e;
+    h       = (half_float)(mant >> shift);
+    rem     = mant & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+    if ((rem > halfway) || ((rem == halfway) && (h & 1)))
+        h++;
+    return (half_float)(sign | h);
+}
+
+/* normal result; a carry out of the mantissa correctly bumps the exponent */
+h   = (half_float)(sign | ((unsigned int)e << 10) | (mant >> 13));
+rem = mant & 0x1fff;
+if ((rem > 0x1000) || ((rem == 0x1000) && (h & 1)))
+    h++;
+return h;
+}
+
+/*---------------------------------------------------------------------------*/
+
+float half_to_float (half_float h)
+
+/* converts a half precision number to float (exact) */
+
+{
+unsigned int sign = ((unsigned int)h & 0x8000) << 16;
+unsigned int e    = ((unsigned int)h >> 10) & 0x1f;
+unsigned int mant = (unsigned int)h & 0x3ff;
+unsigned int x;
+float        f;
+
+if (e == 0)
+{
+    if (mant == 0)
+        x = sign;
+    else
+    {
+        /* normalise the subnormal number */
+        e = 127 - 15 + 1;
+        while (!(mant & 0x400))
+        {
+            mant <<= 1;
+            e--;
+        }
+        x = sign | (e << 23) | ((mant & 0x3ff) << 13);
+    }
+}
+else if (e == 31)
+    x = sign | 0x7f800000 | (mant << 13);
+else
+    x = sign | ((e - 15 + 127) << 23) | (mant << 13);
+
+memcpy(&f,&x,sizeof(float));
+return f;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void float_to_half_array
+(
+                          /***************************************************/
+    const float *in,      /* in  : float values                              */
+    half_float  *out,     /* out : half precision values                     */
+    size_t      n         /* in  : number of values                          */
+                          /***************************************************/
+)
+{
+size_t k = 0;
+
+#ifdef __F16C__
+for (; k+8 <= n; k+=8)
+    _mm_storeu_si128((__m128i*)(out+k),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(in+k),
+                                     _MM_FROUND_TO_NEAREST_INT));
+#endif
+for (; k<n; k++)
+    out[k] = float_to_half(in[k]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void half_to_float_array
+(
+                          /***************************************************/
+    const half_float *in, /* in  : half precision values                     */
+    float       *out,     /* out : float values                              */
+    size_t      n         /* in  : number of values                          */
+                          /***************************************************/
+)
+{
+size_t k = 0;
+
+#ifdef __F16C__
+for (; k+8 <= n; k+=8)
+    _mm256_storeu_ps(out+k,
+                     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in+k))));
+#endif
+for (; k<n; k++)
+    out[k] = half_to_float(in[k]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+bfloat16 float_to_bfloat16 (float f)
+
+/* converts a float to bfloat16, rounding to nearest even */
+
+{
+unsigned int x;
+
+memcpy(&x,&f,sizeof(float));
+
+/* NaN stays a quiet NaN; rounding could turn it into infinity */
+if ((x & 0x7fffffff) > 0x7f800000)
+    return (bfloat16)((x >> 16) | 0x40);
+
+x += 0x7fff + ((x >> 16) & 1);
+return (bfloat16)(x >> 16);
+}
+
+/*---------------------------------------------------------------------------*/
+
+float bfloat16_to_float (bfloat16 b)
+
+/* converts a bfloat16 number to float (exact) */
+
+{
+unsigned int x = (unsigned int)b << 16;
+float        f;
+
+memcpy(&f,&x,sizeof(float));
+return f;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void float_to_bfloat16_array
+(
+                          /***************************************************/
+    const float *in,      /* in  : float values                              */
+    bfloat16    *out,     /* out : bfloat16 values                           */
+    size_t      n         /* in  : number of values                          */
+                          /***************************************************/
+)
+{
+size_t k;
+
+for (k=0; k<n; k++)
+    out[k] = float_to_bfloat16(in[k]);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bfloat16_to_float_array
+(
+                          /***************************************************/
+    const bfloat16 *in,   /* in  : bfloat16 values                           */
+    float       *out,     /* out : float values                              */
+    size_t      n         /* in  : number of values                          */
+                          /***************************************************/
+)
+{
+size_t k = 0;
+
+#ifdef __AVX2__
+for (; k+8 <= n; k+=8)
+    _mm256_storeu_ps(out+k, _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in+k))),16)));
+#endif
+for (; k<n; k++)
+    out[k] = bfloat16_to_float(in[k]);
+}
+
+/*---------------------------------------------------------------------------*/
+#endif
@@ -0,0 +1,748 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Lane-batched Horn/Schunck solver for many small pairs of the same size.   */
+/*                                                                           */
+/* The K pairs are interleaved pair-minor: a wide plane A of K pairs holds   */
+/* pixel (i,j) of pair k in A[i][j*K+k], with the halos interleaved the      */
+/* same way. Allocated as an nx x (ny*K) plane with boundaries bx and by*K,  */
+/* the usual float** indexing and the pointwise routines of                  */
+/* horn_schunck_warp_c.c work unchanged; the stencils step by K in           */
+/* y-direction, and their innermost loop runs over the pairs, so one SIMD    */
+/* vector holds the same pixel of K pairs. All pairs take the same path      */
+/* through the warping pyramid and the fixed point iterations in lockstep.   */
+/*                                                                           */
+/* The solver is the pointwise SOR on the assembled system (hs_options       */
+/* sor_weights 1); every pair gets bit-identical results to                  */
+/* HORN_SCHUNCK_MAIN_OPT with that option. The motion tensor of brightness   */
+/* constancy, the nonlinearities, the assembly, the sweeps and the warping   */
+/* are lane-batched; resampling and the motion tensor with gradient          */
+/* constancy (w_bright_grad > 0) run pair by pair on single planes.          */
+/*                                                                           */
+/*****************************************************************************/
+
+#include "precision_lib.h"
+#include "horn_schunck_batch_c.h"
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_mirror_bounds
+(
+ /*****************************************************/
+ float **A,              /* in+out : wide plane                               */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* mirror_bounds_2d for every pair of a wide plane */
+
+{
+  /*****************************************************/
+  int   i,j,k;            /* loop variables                                    */
+  /*****************************************************/
+
+  /* upper and lower boundary */
+  for(i=bx;i<nx+bx;i++)
+    for(j=1;j<=by;j++)
+      for(k=0;k<K;k++)
+      {
+        A[i][(by     -j)*K+k] = A[i][(by-1 +j)*K+k];
+        A[i][(ny+by-1+j)*K+k] = A[i][(ny+by-j)*K+k];
+      }
+
+  /* left and right boundary, whole rows */
+  for(i=1;i<=bx;i++)
+    for(j=0;j<(ny+2*by)*K;j++)
+    {
+      A[bx     -i][j] = A[bx-1 +i][j];
+      A[nx+bx-1+i][j] = A[nx+bx-i][j];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_extract
+(
+ /*****************************************************/
+ float **A,              /* in     : wide plane                               */
+ float **a,              /* out    : plane of pair k                          */
+ int   K,                /* in     : number of pairs                          */
+ int   k,                /* in     : pair                                     */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* copies pair k of a wide plane, boundaries included */
+
+{
+  int   i,j;              /* loop variables                                    */
+
+  for(i=0;i<nx+2*bx;i++)
+    for(j=0;j<ny+2*by;j++)
+      a[i][j] = A[i][j*K+k];
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_insert
+(
+ /*****************************************************/
+ float **a,              /* in     : plane of pair k                          */
+ float **A,              /* out    : wide plane                               */
+ int   K,                /* in     : number of pairs                          */
+ int   k,                /* in     : pair                                     */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* copies a plane into pair k of a wide plane, boundaries included */
+
+{
+  int   i,j;              /* loop variables                                    */
+
+  for(i=0;i<nx+2*bx;i++)
+    for(j=0;j<ny+2*by;j++)
+      A[i][j*K+k] = a[i][j];
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_backward_registration
+(
+ /*****************************************************/
+ float **f1,             /* in     : 1st images                               */
+ float **f2,             /* in     : 2nd images                               */
+ float **f2_bw,          /* out    : 2nd images (motion compensated)          */
+ float **u,              /* in     : x-components of displacement field       */
+ float **v,              /* in     : y-components of displacement field       */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy                /* in     : grid spacing in y-direction              */
+/*****************************************************/
+)
+
+/* backward_registration for every pair of wide planes */
+
+{
+  /*****************************************************/
+  int   i,j,k,n;          /* loop variables, index of pixel (i,j) of pair k    */
+  int   ii,jj;            /* pixel coordinates                                 */
+  float ii_fp,jj_fp;      /* subpixel coordinates                              */
+  float delta_i,delta_j;  /* subpixel displacement                             */
+  float hx_1,hy_1;        /* time saver                                        */
+  /*****************************************************/
+
+  hx_1=1.0/hx;
+  hy_1=1.0/hy;
+
+  set_bounds_2d(f2,nx,ny*K,bx,by*K,(float)0.0);
+
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+      for(k=0;k<K;k++)
+      {
+        n = j*K+k;
+        ii_fp=i+(u[i][n]*hx_1);
+        jj_fp=j+(v[i][n]*hy_1);
+
+        if ((ii_fp<bx)||(jj_fp<by)||(ii_fp>(nx+bx-1))||(jj_fp>(ny+by-1)))
+            f2_bw[i][n]=f1[i][n];
+        else
+        {
+            ii=(int)floor(ii_fp);
+            jj=(int)floor(jj_fp);
+
+            delta_i = ii_fp-(float)ii;
+            delta_j = jj_fp-(float)jj;
+
+            f2_bw[i][n] = (1.0-delta_i)*(1.0-delta_j) * f2[ii  ][ jj   *K+k]
+                        +      delta_i *(1.0-delta_j) * f2[ii+1][ jj   *K+k]
+                        + (1.0-delta_i)*     delta_j  * f2[ii  ][(jj+1)*K+k]
+                        +      delta_i *     delta_j  * f2[ii+1][(jj+1)*K+k];
+        }
+      }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_motion_tensor
+(
+ /*****************************************************/
+ float **f1,             /* in     : 1st images                               */
+ float **f2,             /* in     : 2nd images                               */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float lambda,           /* in     : weight gradient vs. brightness constancy */
+ float **J_11,           /* out    : entry 11 of the motion tensor            */
+ float **J_22,           /* out    : entry 22 of the motion tensor            */
+ float **J_33,           /* out    : entry 33 of the motion tensor            */
+ float **J_12,           /* out    : entry 12 of the motion tensor            */
+ float **J_13,           /* out    : entry 13 of the motion tensor            */
+ float **J_23            /* out    : entry 23 of the motion tensor            */
+/*****************************************************/
+)
+
+/*
+ compute_motion_tensor for every pair of wide planes. Brightness constancy
+ is lane-batched with the clamped derivatives of compute_first_derivatives
+ (in the first and last row the clamped neighbour is the pixel itself);
+ with gradient constancy the pairs are copied out one by one, this is done
+ once per level and does not pay for kernels of its own.
+*/
+
+{
+  /*****************************************************/
+  int    i,j,k,n;         /* loop variables, index                             */
+  int    im,ip;           /* left and right neighbour column (clamped)         */
+  int    jm,jp;           /* upper and lower neighbour row (clamped)           */
+  float  hx_1,hy_1;       /* time saver variables                              */
+  float  **fx,**fy,**ft;  /* first order derivatives                           */
+  of_acc theta;           /* normalisation factor                              */
+  float  **g1,**g2;       /* images of one pair                                */
+  float  **j11,**j22,**j33,**j12,**j13,**j23; /* motion tensor of one pair     */
+  /*****************************************************/
+
+  if (lambda != 0.0f)
+  {
+      malloc_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&g1,&g2,
+                   &j11,&j22,&j33,&j12,&j13,&j23);
+      for(k=0;k<K;k++)
+      {
+          horn_schunck_batch_extract(f1,g1,K,k,nx,ny,bx,by);
+          horn_schunck_batch_extract(f2,g2,K,k,nx,ny,bx,by);
+          compute_motion_tensor(g1,g2,nx,ny,bx,by,hx,hy,lambda,
+                                j11,j22,j33,j12,j13,j23);
+          horn_schunck_batch_insert(j11,J_11,K,k,nx,ny,bx,by);
+          horn_schunck_batch_insert(j22,J_22,K,k,nx,ny,bx,by);
+          horn_schunck_batch_insert(j33,J_33,K,k,nx,ny,bx,by);
+          horn_schunck_batch_insert(j12,J_12,K,k,nx,ny,bx,by);
+          horn_schunck_batch_insert(j13,J_13,K,k,nx,ny,bx,by);
+          horn_schunck_batch_insert(j23,J_23,K,k,nx,ny,bx,by);
+      }
+      free_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&g1,&g2,
+                 &j11,&j22,&j33,&j12,&j13,&j23);
+      return;
+  }
+
+  malloc_multi(3,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&fx,&fy,&ft);
+
+  hx_1=1.0/(2.0*hx);
+  hy_1=1.0/(2.0*hy);
+
+  for(i=bx;i<nx+bx;i++)
+  {
+    im = (i>bx)      ? i-1 : i;
+    ip = (i<nx+bx-1) ? i+1 : i;
+    for(j=by;j<ny+by;j++)
+    {
+      jm = maximum(j-1,by);
+      jp = minimum(j+1,ny+by-1);
+#pragma GCC ivdep
+      for(k=0;k<K;k++)
+      {
+        n = j*K+k;
+        fy[i][n] = OF_C(0.5)*(OF_ACC(f1[i][jp*K+k])-f1[i][jm*K+k]
+                             +f2[i][jp*K+k]-f2[i][jm*K+k])*hy_1;
+        fx[i][n] = OF_C(0.5)*(OF_ACC(f1[ip][n])-f1[im][n]
+                             +f2[ip][n]-f2[im][n])*hx_1;
+        ft[i][n] = (f2[i][n]-f1[i][n]);
+      }
+    }
+  }
+
+  /* the tensor itself is pointwise */
+  for(i=bx;i<nx+bx;i++)
+    for(n=by*K;n<(ny+by)*K;n++)
+    {
+      theta = (of_real)(1/(OF_ACC(fx[i][n])*fx[i][n]
+                           +OF_ACC(fy[i][n])*fy[i][n]+OF_C(0.1)));
+
+      J_11[i][n] = theta*fx[i][n] * fx[i][n];
+      J_22[i][n] = theta*fy[i][n] * fy[i][n];
+      J_33[i][n] = theta*ft[i][n] * ft[i][n];
+      J_12[i][n] = theta*fx[i][n] * fy[i][n];
+      J_13[i][n] = theta*fx[i][n] * ft[i][n];
+      J_23[i][n] = theta*fy[i][n] * ft[i][n];
+    }
+
+  free_multi(3,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&fx,&fy,&ft);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_nonlinearities_reg
+(
+ /*****************************************************/
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **du,             /* in     : x-component of flow increment            */
+ float **dv,             /* in     : y-component of flow increment            */
+ float **psi_prime_s,    /* out    : nonlinearity smoothness term             */
+ float lambda,           /* in     : diffusivity parameter                    */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy                /* in     : grid spacing in y-direction              */
+/*****************************************************/
+)
+
+/*
+ update_nonlinearities_reg for every pair of wide planes; the central
+ differences are computed on the fly instead of in eight planes
+*/
+
+{
+  /*****************************************************/
+  int   i,n;              /* loop variable, index                              */
+  float hx_1,hy_1;        /* time saver variables                              */
+  float ux,uy,vx,vy;      /* derivatives of the flow                           */
+  float dux,duy,dvx,dvy;  /* derivatives of the increment                      */
+  of_real help;           /* squared gradient magnitude                        */
+  /*****************************************************/
+
+  hx_1 = 1.0/(2.0*hx);
+  hy_1 = 1.0/(2.0*hy);
+
+  horn_schunck_batch_mirror_bounds(u,K,nx,ny,bx,by);
+  horn_schunck_batch_mirror_bounds(v,K,nx,ny,bx,by);
+  horn_schunck_batch_mirror_bounds(du,K,nx,ny,bx,by);
+  horn_schunck_batch_mirror_bounds(dv,K,nx,ny,bx,by);
+
+  for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
+    for(n=by*K;n<(ny+by)*K;n++)
+    {
+      ux  = ( u[i+1][n] -  u[i-1][n])*hx_1;
+      uy  = ( u[i][n+K] -  u[i][n-K])*hy_1;
+      vx  = ( v[i+1][n] -  v[i-1][n])*hx_1;
+      vy  = ( v[i][n+K] -  v[i][n-K])*hy_1;
+      dux = (du[i+1][n] - du[i-1][n])*hx_1;
+      duy = (du[i][n+K] - du[i][n-K])*hy_1;
+      dvx = (dv[i+1][n] - dv[i-1][n])*hx_1;
+      dvy = (dv[i][n+K] - dv[i][n-K])*hy_1;
+
+      help = (OF_ACC(ux)+dux)*(OF_ACC(ux)+dux)
+            +(OF_ACC(vx)+dvx)*(OF_ACC(vx)+dvx)
+            +(OF_ACC(uy)+duy)*(OF_ACC(uy)+duy)
+            +(OF_ACC(vy)+dvy)*(OF_ACC(vy)+dvy);
+
+      psi_prime_s[i][n] = OF_C(1.0)/OF_SQRT( help/(OF_ACC(lambda) * lambda)
+                                            + OF_C(1.0));
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_sor_assemble
+(
+ /*****************************************************/
+ float **J_11,           /* in     : entry 11 of the motion tensor            */
+ float **J_22,           /* in     : entry 22 of the motion tensor            */
+ float **J_12,           /* in     : entry 12 of the motion tensor            */
+ float **J_13,           /* in     : entry 13 of the motion tensor            */
+ float **J_23,           /* in     : entry 23 of the motion tensor            */
+ float **u,              /* in     : x-component of flow field (mirrored)     */
+ float **v,              /* in     : y-component of flow field (mirrored)     */
+ float **psi_prime_d,    /* in     : nonlinearity data term                   */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float alpha,            /* in     : smoothness weight                        */
+ float **wx,             /* out    : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* out    : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* out    : inverse diagonal of the du equation      */
+ float **ia22,           /* out    : inverse diagonal of the dv equation      */
+ float **a12,            /* out    : coupling between du and dv               */
+ float **bu,             /* out    : right hand side of the du equation       */
+ float **bv              /* out    : right hand side of the dv equation       */
+/*****************************************************/
+)
+
+/*
+ horn_schunck_warp_sor_assemble for every pair of wide planes; the
+ boundaries of wx and wy must be zero
+*/
+
+{
+  /*****************************************************/
+  int   i,j,n;            /* loop variables, index                             */
+  float hx_2,hy_2;        /* time saver variables                              */
+  of_real xm,ym;          /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  /*****************************************************/
+
+  hx_2=alpha/(hx*hx);
+  hy_2=alpha/(hy*hy);
+
+  /* edge weights, zero across the last row and column */
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+#pragma GCC ivdep
+      for(n=j*K;n<(j+1)*K;n++)
+      {
+        wx[i][n] = (i<nx+bx-1) * hx_2
+                   * (OF_ACC(psi_prime_s[i+1][n])+psi_prime_s[i][n])/OF_C(2.0);
+        wy[i][n] = (j<ny+by-1) * hy_2
+                   * (OF_ACC(psi_prime_s[i][n+K])+psi_prime_s[i][n])/OF_C(2.0);
+      }
+
+  /* diagonals and right hand sides */
+  for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
+    for(n=by*K;n<(ny+by)*K;n++)
+    {
+      xm  = wx[i-1][n];
+      ym  = wy[i][n-K];
+      sum = OF_ACC(wx[i][n]) + xm + wy[i][n] + ym;
+
+      ia11[i][n] = OF_C(1.0)/(OF_ACC(psi_prime_d[i][n])*J_11[i][n]+sum);
+      ia22[i][n] = OF_C(1.0)/(OF_ACC(psi_prime_d[i][n])*J_22[i][n]+sum);
+      a12[i][n]  = OF_ACC(psi_prime_d[i][n])*J_12[i][n];
+
+      bu[i][n] = - OF_ACC(psi_prime_d[i][n])*J_13[i][n]
+                 + OF_ACC(xm)       * u[i-1][n  ] + OF_ACC(ym)       * u[i  ][n-K]
+                 + OF_ACC(wy[i][n]) * u[i  ][n+K] + OF_ACC(wx[i][n]) * u[i+1][n  ]
+                 - OF_ACC(sum)      * u[i  ][n  ];
+      bv[i][n] = - OF_ACC(psi_prime_d[i][n])*J_23[i][n]
+                 + OF_ACC(xm)       * v[i-1][n  ] + OF_ACC(ym)       * v[i  ][n-K]
+                 + OF_ACC(wy[i][n]) * v[i  ][n+K] + OF_ACC(wx[i][n]) * v[i+1][n  ]
+                 - OF_ACC(sum)      * v[i  ][n  ];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_batch_sor
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ int   K,                /* in     : number of pairs                          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float omega             /* in     : SOR overrelaxation parameter             */
+/*****************************************************/
+)
+
+/*
+ horn_schunck_warp_sor_precomputed for every pair of wide planes. The
+ sweep order over (i,j) is the same as for a single pair; the pairs of one
+ pixel do not depend on each other, so the innermost loop vectorises.
+*/
+
+{
+  /*****************************************************/
+  int   i,j,n;            /* loop variables, index                             */
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real omega_1;        /* time saver variable                               */
+  /*****************************************************/
+
+  omega_1 = OF_ACC(1.0f) - omega;
+
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+#pragma GCC ivdep
+      for(n=j*K;n<(j+1)*K;n++)
+      {
+        xp = wx[i  ][n  ];
+        xm = wx[i-1][n  ];
+        yp = wy[i  ][n  ];
+        ym = wy[i  ][n-K];
+
+        du[i][n] = OF_ACC(omega_1) * du[i][n] + OF_ACC(omega) * ia11[i][n] *
+                   ( OF_ACC(bu[i][n]) - OF_ACC(a12[i][n]) * dv[i][n]
+                   + OF_ACC(xm) * du[i-1][n] + OF_ACC(ym) * du[i][n-K]
+                   + OF_ACC(yp) * du[i][n+K] + OF_ACC(xp) * du[i+1][n]);
+
+        dv[i][n] = OF_ACC(omega_1) * dv[i][n] + OF_ACC(omega) * ia22[i][n] *
+                   ( OF_ACC(bv[i][n]) - OF_ACC(a12[i][n]) * du[i][n]
+                   + OF_ACC(xm) * dv[i-1][n] + OF_ACC(ym) * dv[i][n-K]
+                   + OF_ACC(yp) * dv[i][n+K] + OF_ACC(xp) * dv[i+1][n]);
+      }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_BATCH_WARP_LEVEL
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st images                               */
+float **f2,             /* in     : 2nd images, warped                       */
+float **du,             /* out    : x-components of flow increment           */
+float **dv,             /* out    : y-components of flow increment           */
+float **u,              /* in     : x-components of flow field               */
+float **v,              /* in     : y-components of flow field               */
+int   K,                /* in     : number of pairs                          */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float m_alpha,          /* in     : smoothness weight                        */
+float epsilon_d,        /* in     : diffusivity param data term              */
+float epsilon_s,        /* in     : diffusivity param smoothness term        */
+float w_bright_grad,    /* in     : weight gradient vs. brightness constancy */
+int   num_iter_inner,   /* in     : inner solver iterations                  */
+int   num_iter_outer,   /* in     : outer nonlin update iterations           */
+float n_omega           /* in     : SOR overrelaxation parameter             */
+                        /*****************************************************/
+)
+
+/* HORN_SCHUNCK_WARP_LEVEL with sor_weights 1 for all pairs at once */
+
+{
+                        /*****************************************************/
+int    i,j;             /* loop variables                                    */
+float  **J_11, **J_22, **J_33;  /* motion tensor                             */
+float  **J_12, **J_13, **J_23;
+float  **psi_prime_d;   /* nonlinearity data term                            */
+float  **psi_prime_s;   /* nonlinearity smoothness term                      */
+float  **wx, **wy;      /* SOR edge weights                                  */
+float  **ia11, **ia22;  /* inverse SOR diagonals                             */
+float  **a12;           /* coupling du - dv                                  */
+float  **bu, **bv;      /* right hand sides                                  */
+                        /*****************************************************/
+
+malloc_multi(8,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&J_11,&J_22,&J_33,
+             &J_12,&J_13,&J_23,&psi_prime_d,&psi_prime_s);
+calloc_multi(7,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&wx,&wy,&ia11,&ia22,&a12,
+             &bu,&bv);
+
+set_matrix_2d(du,nx+2*bx,(ny+2*by)*K,0,0,(float)0.0);
+set_matrix_2d(dv,nx+2*bx,(ny+2*by)*K,0,0,(float)0.0);
+
+horn_schunck_batch_motion_tensor(f1,f2,K,nx,ny,bx,by,hx,hy,w_bright_grad,
+                                 J_11,J_22,J_33,J_12,J_13,J_23);
+
+for(j=0;j<num_iter_outer;j++)
+{
+  /* the data term is pointwise, the wide planes pass for one pair */
+  update_nonlinearities(J_11,J_22,J_33,J_12,J_13,J_23,du,dv,psi_prime_d,
+                        epsilon_d,nx,ny*K,bx,by*K);
+  horn_schunck_batch_nonlinearities_reg(u,v,du,dv,psi_prime_s,epsilon_s,
+                                        K,nx,ny,bx,by,hx,hy);
+  horn_schunck_batch_sor_assemble(J_11,J_22,J_12,J_13,J_23,u,v,
+                                  psi_prime_d,psi_prime_s,K,nx,ny,bx,by,
+                                  hx,hy,m_alpha,wx,wy,ia11,ia22,a12,bu,bv);
+  for(i=1;i<=num_iter_inner;i++)
+    horn_schunck_batch_sor(wx,wy,ia11,ia22,a12,bu,bv,du,dv,
+                           K,nx,ny,bx,by,n_omega);
+}
+
+free_multi(8,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&J_11,&J_22,&J_33,
+           &J_12,&J_13,&J_23,&psi_prime_d,&psi_prime_s);
+free_multi(7,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&wx,&wy,&ia11,&ia22,&a12,
+           &bu,&bv);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_BATCH_WARP
+(
+                        /*****************************************************/
+float ***f1_orig,       /* in     : 1st images (original resolution)         */
+float ***f2_orig,       /* in     : 2nd images (original resolution)         */
+int   nx_orig,          /* in     : size in x-direction (original resolution)*/
+int   ny_orig,          /* in     : size in y-direction (original resolution)*/
+float **f1_res,         /* in+out : 1st images, resampled                    */
+float **f2_res,         /* in+out : 2nd images, resampled                    */
+float **f2_res_warp,    /* in+out : 2nd images, resampled and warped         */
+float **du,             /* in+out : x-components of flow increment           */
+float **dv,             /* in+out : y-components of flow increment           */
+float **u,              /* in+out : x-components of flow field               */
+float **v,              /* in+out : y-components of flow field               */
+float **s,              /* in+out : plane of one pair                        */
+float **tmp,            /* in+out : temporary array for resampling           */
+int   K,                /* in     : number of pairs                          */
+int   nx_fine,          /* in     : size in x-direction (current resolution) */
+int   ny_fine,          /* in     : size in y-direction (current resolution) */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx_fine,          /* in     : spacing in x-direction (current resol.)  */
+float hy_fine,          /* in     : spacing in y-direction (current resol.)  */
+float m_alpha,          /* in     : smoothness weight                        */
+float epsilon_d,        /* in     : diffusivity param data term              */
+float epsilon_s,        /* in     : diffusivity param smoothness term        */
+float w_bright_grad,    /* in     : weight gradient vs. brightness constancy */
+int   num_iter_inner,   /* in     : inner solver iterations                  */
+int   num_iter_outer,   /* in     : outer nonlin update iterations           */
+float n_omega,          /* in     : SOR overrelaxation parameter             */
+float n_warp_eta,       /* in     : warping reduction factor between levels  */
+int   max_rec_depth,    /* in     : maximum recursion depth                  */
+int   rec_depth         /* in     : current recursion depth                  */
+                        /*****************************************************/
+)
+
+/* HORN_SCHUNCK_WARP for all pairs at once; resampling is done pair by pair */
+
+{
+                             /************************************************/
+int   k;                     /* pair                                         */
+int   nx_coarse,ny_coarse;   /* dimensions on previous coarser grid          */
+                             /************************************************/
+
+nx_coarse=(int)ceil(nx_orig*pow(n_warp_eta,rec_depth+1));
+ny_coarse=(int)ceil(ny_orig*pow(n_warp_eta,rec_depth+1));
+
+if (rec_depth<max_rec_depth)
+    HORN_SCHUNCK_BATCH_WARP(f1_orig, f2_orig, nx_orig, ny_orig,
+                            f1_res, f2_res, f2_res_warp, du, dv, u, v, s, tmp,
+                            K, nx_coarse, ny_coarse, bx, by,
+                            (float)nx_orig/(float)nx_coarse,
+                            (float)ny_orig/(float)ny_coarse,
+                            m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+                            num_iter_inner, num_iter_outer, n_omega,
+                            n_warp_eta, max_rec_depth, rec_depth+1);
+
+/* ---- resample images and the flow of the coarser level ---- */
+for(k=0;k<K;k++)
+{
+    resample_2d(f1_orig[k],nx_orig,ny_orig,bx,by,s,nx_fine,ny_fine,tmp);
+    horn_schunck_batch_insert(s,f1_res,K,k,nx_fine,ny_fine,bx,by);
+    resample_2d(f2_orig[k],nx_orig,ny_orig,bx,by,s,nx_fine,ny_fine,tmp);
+    horn_schunck_batch_insert(s,f2_res,K,k,nx_fine,ny_fine,bx,by);
+
+    if (rec_depth<max_rec_depth)
+    {
+        horn_schunck_batch_extract(u,s,K,k,nx_coarse,ny_coarse,bx,by);
+        resample_2d(s,nx_coarse,ny_coarse,bx,by,s,nx_fine,ny_fine,tmp);
+        horn_schunck_batch_insert(s,u,K,k,nx_fine,ny_fine,bx,by);
+        horn_schunck_batch_extract(v,s,K,k,nx_coarse,ny_coarse,bx,by);
+        resample_2d(s,nx_coarse,ny_coarse,bx,by,s,nx_fine,ny_fine,tmp);
+        horn_schunck_batch_insert(s,v,K,k,nx_fine,ny_fine,bx,by);
+    }
+}
+if (rec_depth==max_rec_depth)
+{
+    set_matrix_2d(u,nx_fine+2*bx,(ny_fine+2*by)*K,0,0,(float)0.0);
+    set_matrix_2d(v,nx_fine+2*bx,(ny_fine+2*by)*K,0,0,(float)0.0);
+}
+
+/* ---- warp, solve and add the increment ---- */
+horn_schunck_batch_backward_registration(f1_res,f2_res,f2_res_warp,u,v,
+                                         K,nx_fine,ny_fine,bx,by,
+                                         hx_fine,hy_fine);
+
+HORN_SCHUNCK_BATCH_WARP_LEVEL(f1_res, f2_res_warp, du, dv, u, v,
+                              K, nx_fine, ny_fine, bx, by, hx_fine, hy_fine,
+                              m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+                              num_iter_inner, num_iter_outer, n_omega);
+
+add_matrix_2d(u,du,u,nx_fine,ny_fine*K,bx,by*K);
+add_matrix_2d(v,dv,v,nx_fine,ny_fine*K,bx,by*K);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_MAIN_BATCH
+(
+                         /*****************************************************/
+float ***f1,             /* in     : 1st images, one per pair                 */
+float ***f2,             /* in     : 2nd images, one per pair                 */
+float ***u,              /* out    : x-components of the flow, one per pair   */
+float ***v,              /* out    : y-components of the flow, one per pair   */
+int   num_pairs,         /* in     : number of pairs K                        */
+int   nx,                /* in     : size in x-direction (all pairs)          */
+int   ny,                /* in     : size in y-direction (all pairs)          */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels      /* in     : desired number of warping levels         */
+                         /*****************************************************/
+)
+
+/*
+ computes the optic flow of num_pairs pairs of the same size at once,
+ each pair gets the result of HORN_SCHUNCK_MAIN_OPT with sor_weights 1
+*/
+
+{
+                        /*****************************************************/
+int   K;                /* number of pairs                                   */
+int   k;                /* pair                                              */
+float **du, **dv;       /* flow increments                                   */
+float **f1_res;         /* 1st images, resampled                             */
+float **f2_res;         /* 2nd images, resampled                             */
+float **f2_res_warp;    /* 2nd images, resampled and warped                  */
+float **uw, **vw;       /* flow fields                                       */
+float **s, **tmp;       /* plane of one pair, temporary array for resampling */
+int   max_rec_depth;    /* maximum recursion depth (warping level -1)        */
+int   n_warp_max_levels;/* maximum possible number of warping levels         */
+                        /*****************************************************/
+
+K = num_pairs;
+if (K < 1)
+    return;
+
+compute_max_warp_levels(nx,ny,n_warp_eta,&n_warp_max_levels);
+max_rec_depth=minimum(n_warp_levels,n_warp_max_levels)-1;
+
+if (!malloc_multi(7,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&du,&dv,&f1_res,
+                  &f2_res,&f2_res_warp,&uw,&vw))
+{
+    console_error("[HORN_SCHUNCK_MAIN_BATCH] out of memory for %d pairs\n",K);
+    return;
+}
+malloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&s,&tmp);
+
+HORN_SCHUNCK_BATCH_WARP(f1, f2, nx, ny, f1_res, f2_res, f2_res_warp,
+                        du, dv, uw, vw, s, tmp, K, nx, ny, bx, by, hx, hy,
+                        m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+                        num_iter_inner, num_iter_outer, n_omega, n_warp_eta,
+                        max_rec_depth, 0);
+
+for(k=0;k<K;k++)
+{
+    horn_schunck_batch_extract(uw,u[k],K,k,nx,ny,bx,by);
+    horn_schunck_batch_extract(vw,v[k],K,k,nx,ny,bx,by);
+}
+
+free_multi(7,2,sizeof(float),nx,ny*K,bx,by*K,0,0,&du,&dv,&f1_res,
+           &f2_res,&f2_res_warp,&uw,&vw);
+free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&s,&tmp);
+}
@@ -0,0 +1,37 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Lane-batched Horn/Schunck solver (see horn_schunck_batch_c.c).            */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_HORN_SCHUNCK_BATCH_INCLUDED
+#define OF_HORN_SCHUNCK_BATCH_INCLUDED
+
+void HORN_SCHUNCK_MAIN_BATCH
+(
+ /*****************************************************/
+ float ***f1,             /* in     : 1st images, one per pair                 */
+ float ***f2,             /* in     : 2nd images, one per pair                 */
+ float ***u,              /* out    : x-components of the flow, one per pair   */
+ float ***v,              /* out    : y-components of the flow, one per pair   */
+ int   num_pairs,         /* in     : number of pairs K                        */
+ int   nx,                /* in     : size in x-direction (all pairs)          */
+ int   ny,                /* in     : size in y-direction (all pairs)          */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy,                /* in     : grid spacing in y-direction              */
+ float m_alpha,           /* in     : smoothness weight                        */
+ float epsilon_d,         /* in     : diffusivity param data term              */
+ float epsilon_s,
+ float w_bright_grad,
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels      /* in     : desired number of warping levels         */
+/*****************************************************/
+);
+
+#endif
@@ -0,0 +1,250 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Bidirectional Horn/Schunck flow with a forward-backward consistency mask. */
+/*                                                                           */
+/* Both directions see the same resampled images on every warping level,    */
+/* so the two pyramids are built once and handed to HORN_SCHUNCK_WARP        */
+/* instead of resampling f1 and f2 per level and direction. The forward      */
+/* solve (f1 -> f2) runs on the calling thread, the backward solve           */
+/* (f2 -> f1) on a second thread; each has its own flow, increment and warp  */
+/* planes, halo tracker and statistics. The pyramids are built with zero    */
+/* boundaries and only read by the solves. Both flows are bit-identical to   */
+/* two HORN_SCHUNCK_MAIN_OPT calls with the same options.                    */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <pthread.h>
+#include "horn_schunck_bidir_c.h"
+
+typedef struct
+{
+ float **f1, **f2;        /* images of this direction                        */
+ float ***f1_pyr;         /* resampled 1st image per recursion depth         */
+ float ***f2_pyr;         /* resampled 2nd image per recursion depth         */
+ float **u, **v;          /* flow of this direction                          */
+ int   nx, ny, bx, by;    /* size and boundaries                             */
+ float hx, hy;            /* grid spacing                                    */
+ float m_alpha, epsilon_d, epsilon_s, w_bright_grad;
+ int   num_iter_inner, num_iter_outer;
+ float n_warp_eta, n_omega;
+ int   max_rec_depth;     /* maximum recursion depth (warping level -1)      */
+ hs_options opt;          /* options, stats points to the own counters       */
+ hs_stats stats;          /* counters of this direction                      */
+} hs_bidir_task;
+
+/* ------------------------------------------------------------------------- */
+
+void *horn_schunck_bidir_solve
+(
+ void *arg               /* in+out : hs_bidir_task                            */
+)
+
+/* solves one direction on the shared pyramids */
+
+{
+  hs_bidir_task *t = (hs_bidir_task*)arg;
+
+  t->opt.stats = &t->stats;
+  horn_schunck_solve_pyramids(t->f1, t->f2, t->f1_pyr, t->f2_pyr, t->u, t->v,
+                              t->nx, t->ny, t->bx, t->by, t->hx, t->hy,
+                              t->m_alpha, t->epsilon_d, t->epsilon_s,
+                              t->w_bright_grad, t->num_iter_inner,
+                              t->num_iter_outer, t->n_warp_eta, t->n_omega,
+                              t->max_rec_depth, &t->opt);
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_consistency_mask
+(
+ /*****************************************************/
+ float **u,              /* in     : x-component of the forward flow          */
+ float **v,              /* in     : y-component of the forward flow          */
+ float **ub,             /* in+out : x-component of the backward flow,        */
+                         /*          boundaries are set to zero               */
+ float **vb,             /* in+out : y-component of the backward flow, dito   */
+ float **mask,           /* out    : 1 where consistent, 0 else               */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy                /* in     : grid spacing in y-direction              */
+/*****************************************************/
+)
+
+/*
+ forward-backward check: the backward flow is warped by the forward flow
+ with the bilinear backward_registration; pixels whose forward flow leaves
+ the image get a huge backward flow there and are marked inconsistent
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float **ubw, **vbw;     /* backward flow at x + w_f(x)                       */
+  float **out;            /* value used where x + w_f(x) is outside            */
+  float su, sv;           /* w_f + w_b(x+w_f) in pixels                        */
+  float fu, fv, bu, bv;   /* forward and warped backward flow in pixels        */
+  float hx_1, hy_1;       /* time savers                                       */
+  /*****************************************************/
+
+  malloc_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&ubw,&vbw,&out);
+  set_matrix_2d(out,nx+2*bx,ny+2*by,0,0,(float)1.0e10);
+  set_bounds_2d(ub,nx,ny,bx,by,(float)0.0);
+  set_bounds_2d(vb,nx,ny,bx,by,(float)0.0);
+
+  backward_registration(out,ub,ubw,u,v,nx,ny,bx,by,hx,hy);
+  backward_registration(out,vb,vbw,u,v,nx,ny,bx,by,hx,hy);
+
+  hx_1 = 1.0f/hx;
+  hy_1 = 1.0f/hy;
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      fu = u[i][j]*hx_1;
+      fv = v[i][j]*hy_1;
+      bu = ubw[i][j]*hx_1;
+      bv = vbw[i][j]*hy_1;
+      su = fu + bu;
+      sv = fv + bv;
+      mask[i][j] = (su*su + sv*sv
+                    <= HS_FB_ALPHA*(fu*fu + fv*fv + bu*bu + bv*bv)
+                       + HS_FB_BETA) ? 1.0f : 0.0f;
+    }
+
+  free_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&ubw,&vbw,&out);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_MAIN_BIDIR
+(
+                         /*****************************************************/
+float **f1,              /* in     : 1st image                                */
+float **f2,              /* in     : 2nd image                                */
+float **u,               /* out    : x-component of the flow f1 -> f2         */
+float **v,               /* out    : y-component of the flow f1 -> f2         */
+float **ub,              /* out    : x-component of the flow f2 -> f1         */
+float **vb,              /* out    : y-component of the flow f2 -> f1         */
+float **mask,            /* out    : consistency mask, NULL for none          */
+int   nx,                /* in     : size in x-direction                      */
+int   ny,                /* in     : size in y-direction                      */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels,     /* in     : desired number of warping levels         */
+const hs_options *opt    /* in     : solver options, NULL for the defaults;   */
+                         /*          stats sum up both directions             */
+                         /*****************************************************/
+)
+
+/*
+ computes the forward and the backward flow of a pair on two threads,
+ each gets the result of HORN_SCHUNCK_MAIN_OPT for its direction
+*/
+
+{
+                        /*****************************************************/
+float ***pyr1, ***pyr2; /* resampled images per recursion depth              */
+float **tmp;            /* temporary array for resampling                    */
+hs_bidir_task task[2];  /* forward and backward direction                    */
+hs_options defaults;    /* options used for opt == NULL                      */
+pthread_t thread;       /* thread of the backward solve                      */
+int   threaded;         /* 1 if the backward solve got its own thread        */
+int   max_rec_depth;    /* maximum recursion depth (warping level -1)        */
+int   n_warp_max_levels;/* maximum possible number of warping levels         */
+int   k;                /* direction                                         */
+                        /*****************************************************/
+
+if (!opt)
+{
+    hs_default_options(&defaults);
+    opt = &defaults;
+}
+
+compute_max_warp_levels(nx,ny,n_warp_eta,&n_warp_max_levels);
+max_rec_depth=minimum(n_warp_levels,n_warp_max_levels)-1;
+
+/* ---- shared pyramids ---- */
+pyr1 = (float***)malloc((max_rec_depth+1)*sizeof(float**));
+pyr2 = (float***)malloc((max_rec_depth+1)*sizeof(float**));
+if (!pyr1 || !pyr2)
+{
+    console_error("[HORN_SCHUNCK_MAIN_BIDIR] out of memory\n");
+    free(pyr1);
+    free(pyr2);
+    return;
+}
+malloc_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+horn_schunck_build_pyramid(f1,pyr1,nx,ny,bx,by,n_warp_eta,max_rec_depth,tmp);
+horn_schunck_build_pyramid(f2,pyr2,nx,ny,bx,by,n_warp_eta,max_rec_depth,tmp);
+free_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+
+/* ---- one task per direction ---- */
+for(k=0;k<2;k++)
+{
+    task[k].f1     = (k==0) ? f1 : f2;
+    task[k].f2     = (k==0) ? f2 : f1;
+    task[k].f1_pyr = (k==0) ? pyr1 : pyr2;
+    task[k].f2_pyr = (k==0) ? pyr2 : pyr1;
+    task[k].u      = (k==0) ? u : ub;
+    task[k].v      = (k==0) ? v : vb;
+    task[k].nx = nx;  task[k].ny = ny;
+    task[k].bx = bx;  task[k].by = by;
+    task[k].hx = hx;  task[k].hy = hy;
+    task[k].m_alpha        = m_alpha;
+    task[k].epsilon_d      = epsilon_d;
+    task[k].epsilon_s      = epsilon_s;
+    task[k].w_bright_grad  = w_bright_grad;
+    task[k].num_iter_inner = num_iter_inner;
+    task[k].num_iter_outer = num_iter_outer;
+    task[k].n_warp_eta     = n_warp_eta;
+    task[k].n_omega        = n_omega;
+    task[k].max_rec_depth  = max_rec_depth;
+    task[k].opt            = *opt;
+    task[k].opt.cache      = NULL;   /* not shared between the threads */
+}
+
+/* backward on a second thread, forward here; sequential if that fails */
+threaded = (pthread_create(&thread,NULL,horn_schunck_bidir_solve,
+                           &task[1]) == 0);
+horn_schunck_bidir_solve(&task[0]);
+if (threaded)
+    pthread_join(thread,NULL);
+else
+    horn_schunck_bidir_solve(&task[1]);
+
+if (opt->stats)
+{
+    *opt->stats = task[0].stats;
+    opt->stats->halo_refreshes += task[1].stats.halo_refreshes;
+    opt->stats->halo_skipped   += task[1].stats.halo_skipped;
+    opt->stats->sor_sweeps     += task[1].stats.sor_sweeps;
+    opt->stats->sor_updates    += task[1].stats.sor_updates;
+    if ((opt->stats->omega_min == 0.0f)
+        || ((task[1].stats.omega_min != 0.0f)
+            && (task[1].stats.omega_min < opt->stats->omega_min)))
+        opt->stats->omega_min = task[1].stats.omega_min;
+    if (task[1].stats.omega_max > opt->stats->omega_max)
+        opt->stats->omega_max = task[1].stats.omega_max;
+}
+
+if (mask)
+    horn_schunck_consistency_mask(u,v,ub,vb,mask,nx,ny,bx,by,hx,hy);
+
+horn_schunck_free_pyramid(pyr1,nx,ny,bx,by,n_warp_eta,max_rec_depth);
+horn_schunck_free_pyramid(pyr2,nx,ny,bx,by,n_warp_eta,max_rec_depth);
+free(pyr1);
+free(pyr2);
+}
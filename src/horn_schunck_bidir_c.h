@@ -0,0 +1,64 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Bidirectional Horn/Schunck flow (see horn_schunck_bidir_c.c).             */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_HORN_SCHUNCK_BIDIR_INCLUDED
+#define OF_HORN_SCHUNCK_BIDIR_INCLUDED
+
+/* a pixel is consistent if |w_f + w_b(x+w_f)|^2 <=                          */
+/* HS_FB_ALPHA (|w_f|^2 + |w_b(x+w_f)|^2) + HS_FB_BETA, flows in pixels      */
+#define HS_FB_ALPHA 0.01f
+#define HS_FB_BETA  0.5f
+
+void horn_schunck_consistency_mask
+(
+ /*****************************************************/
+ float **u,               /* in     : x-component of the forward flow          */
+ float **v,               /* in     : y-component of the forward flow          */
+ float **ub,              /* in+out : x-component of the backward flow,        */
+                          /*          boundaries are set to zero              */
+ float **vb,              /* in+out : y-component of the backward flow, dito   */
+ float **mask,            /* out    : 1 where consistent, 0 else               */
+ int   nx,                /* in     : size in x-direction                      */
+ int   ny,                /* in     : size in y-direction                      */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy                 /* in     : grid spacing in y-direction              */
+/*****************************************************/
+);
+
+void HORN_SCHUNCK_MAIN_BIDIR
+(
+ /*****************************************************/
+ float **f1,              /* in     : 1st image                                */
+ float **f2,              /* in     : 2nd image                                */
+ float **u,               /* out    : x-component of the flow f1 -> f2         */
+ float **v,               /* out    : y-component of the flow f1 -> f2         */
+ float **ub,              /* out    : x-component of the flow f2 -> f1         */
+ float **vb,              /* out    : y-component of the flow f2 -> f1         */
+ float **mask,            /* out    : consistency mask, NULL for none          */
+ int   nx,                /* in     : size in x-direction                      */
+ int   ny,                /* in     : size in y-direction                      */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy,                /* in     : grid spacing in y-direction              */
+ float m_alpha,           /* in     : smoothness weight                        */
+ float epsilon_d,         /* in     : diffusivity param data term              */
+ float epsilon_s,
+ float w_bright_grad,
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels,     /* in     : desired number of warping levels         */
+ const hs_options *opt    /* in     : solver options, NULL for the defaults;   */
+                          /*          stats sum up both directions            */
+/*****************************************************/
+);
+
+#endif
@@ -0,0 +1,385 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Level pipeline: the flow of the consecutive pairs of a frame sequence,    */
+/* with the warping levels split over a chain of stage threads.             */
+/*                                                                           */
+/* Stage 0 solves the coarsest levels of a pair and hands its flow to stage */
+/* 1, which continues with the next finer levels, and so on; the last stage */
+/* ends on the original grid. While pair t is on its finest levels, the     */
+/* earlier stages already work on the coarse levels of pair t+1, t+2, ...   */
+/* The levels are split so that every stage gets about the same number of   */
+/* pixel updates, plus a fixed cost per level. A stage starts a pair only   */
+/* once the next stage has taken the previous one, so at most one finished  */
+/* pair waits between two stages and the time of a pair stays that of the   */
+/* levels it goes through.                                                  */
+/*                                                                           */
+/* Every level is solved by horn_schunck_warp_step exactly as in            */
+/* HORN_SCHUNCK_WARP, so pair t gets the flow of HORN_SCHUNCK_MAIN_OPT on   */
+/* frames t and t+1. Each stage has its own work planes and halo tracker;   */
+/* the flow planes of a pair move with it from stage to stage.              */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <pthread.h>
+#include "horn_schunck_pipeline_c.h"
+
+#define HS_PIPELINE_LEVEL_PIXELS 256 /* fixed cost of a level in pixels     */
+
+typedef struct hs_pipeline_job hs_pipeline_job;
+
+typedef struct
+{
+ hs_pipeline_job *job;    /* pipeline                                        */
+ int   s;                 /* index of the stage                              */
+} hs_pipeline_stage;
+
+struct hs_pipeline_job
+{
+ float ***f;              /* frames                                          */
+ float ***u, ***v;        /* flow per pair                                   */
+ int   num_pairs;         /* number of pairs                                 */
+ int   nx, ny, bx, by;    /* size and boundaries                             */
+ float hx, hy;            /* grid spacing                                    */
+ float m_alpha, epsilon_d, epsilon_s, w_bright_grad;
+ int   num_iter_inner, num_iter_outer;
+ float n_warp_eta, n_omega;
+ int   max_rec_depth;     /* maximum recursion depth (warping level -1)      */
+ hs_options opt;          /* options without stats, cache and initial flow   */
+ int   stages;            /* stages of the split                             */
+ int   first_depth[HS_PIPELINE_MAX_STAGES+1]; /* levels of the stages, and   */
+                          /*    -1 behind the last one                       */
+ int   begun[HS_PIPELINE_MAX_STAGES];  /* pairs started by each stage        */
+ int   done[HS_PIPELINE_MAX_STAGES];   /* pairs finished by each stage       */
+ int   go;                /* 1: the split is final, stages may start         */
+ double *t_start;         /* start of each pair on the first stage           */
+ double *t_end;           /* end of each pair on the last stage              */
+ double cpu[HS_PIPELINE_MAX_STAGES];   /* CPU time of each stage              */
+ pthread_mutex_t lock;    /* protects begun, done, go and the times          */
+ pthread_cond_t  moved;   /* signalled whenever one of them changes          */
+};
+
+/* ------------------------------------------------------------------------- */
+
+double horn_schunck_level_pixels
+(
+ /*****************************************************/
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   rec_depth         /* in     : recursion depth of the level             */
+/*****************************************************/
+)
+
+/* cost measure of the split: the pixels of a warping level plus its fixed */
+/* cost (allocations, set up of the outer iterations), which is about that */
+/* of HS_PIPELINE_LEVEL_PIXELS pixels                                       */
+
+{
+  /*****************************************************/
+  int   mx, my;           /* size of the level                                 */
+  float hx, hy;           /* spacing of the level (unused)                     */
+  /*****************************************************/
+
+  horn_schunck_level_size(nx,ny,1.0f,1.0f,n_warp_eta,rec_depth,&mx,&my,&hx,&hy);
+  return (double)mx*my + HS_PIPELINE_LEVEL_PIXELS;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int horn_schunck_pipeline_split
+(
+ /*****************************************************/
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   max_rec_depth,    /* in     : maximum recursion depth                  */
+ int   stages,           /* in     : desired number of stages                 */
+ int   *first_depth      /* out    : coarsest depth of each stage, -1 behind  */
+                         /*          the last one                             */
+/*****************************************************/
+)
+
+/* splits the levels into contiguous ranges of about the same cost,       */
+/* coarsest first: a stage ends at the level closest to its share of the  */
+/* total; returns the number of stages                                    */
+
+{
+  /*****************************************************/
+  int   s, d;             /* stage, recursion depth                            */
+  double total, acc;      /* cost of all levels, of the levels split off       */
+  /*****************************************************/
+
+  if (stages > max_rec_depth+1)
+    stages = max_rec_depth+1;
+  if (stages > HS_PIPELINE_MAX_STAGES)
+    stages = HS_PIPELINE_MAX_STAGES;
+  if (stages < 1)
+    stages = 1;
+
+  total = 0.0;
+  for (d=0; d<=max_rec_depth; d++)
+    total += horn_schunck_level_pixels(nx,ny,n_warp_eta,d);
+
+  /* every stage takes at least one level and leaves one for each later */
+  /* stage; the next level is taken if at least half of it fits         */
+  acc = 0.0;
+  d   = max_rec_depth;
+  for (s=0; s<stages; s++)
+  {
+    first_depth[s] = d;
+    acc += horn_schunck_level_pixels(nx,ny,n_warp_eta,d--);
+    while ((d >= 0) &&
+           ((s == stages-1) ||
+            ((d+1 > stages-s-1) &&
+             (acc + 0.5*horn_schunck_level_pixels(nx,ny,n_warp_eta,d) <
+              total*(s+1)/stages))))
+      acc += horn_schunck_level_pixels(nx,ny,n_warp_eta,d--);
+  }
+  first_depth[stages] = -1;
+  return stages;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void *horn_schunck_pipeline_worker
+(
+ void *arg               /* in     : hs_pipeline_stage                        */
+)
+
+/* stage thread: solves its levels of every pair in order */
+
+{
+  /*****************************************************/
+  hs_pipeline_stage *stage; /* this stage                                      */
+  hs_pipeline_job *job;   /* pipeline                                          */
+  float **du, **dv;       /* flow increment                                    */
+  float **f1_res, **f2_res; /* resampled images                                */
+  float **f2_res_warp;    /* 2nd image, resampled and warped                   */
+  float **tmp;            /* temporary array for resampling                    */
+  bounds_tracker bt;      /* halo validity of the flow planes                  */
+  int   s, t, d;          /* stage, pair, recursion depth                      */
+  int   last;             /* finest depth of the stage                         */
+  int   mx, my;           /* size of the finest level of the stage             */
+  int   nx, ny;           /* size of level d                                   */
+  float hx, hy;           /* grid spacing of level d                           */
+  double c0;              /* CPU time at the start of the levels of a pair     */
+  /*****************************************************/
+
+  stage = (hs_pipeline_stage*)arg;
+  job   = stage->job;
+  s     = stage->s;
+
+  pthread_mutex_lock(&job->lock);
+  while (!job->go)
+    pthread_cond_wait(&job->moved,&job->lock);
+  pthread_mutex_unlock(&job->lock);
+
+  /* the work planes only need the finest level of the stage; the       */
+  /* resampling reads the original grid and keeps tmp at its size       */
+  last = job->first_depth[s+1] + 1;
+  horn_schunck_level_size(job->nx,job->ny,job->hx,job->hy,job->n_warp_eta,
+                          last,&mx,&my,&hx,&hy);
+  if (job->opt.low_memory)
+  {
+    malloc_multi(4,2,sizeof(float),mx,my,job->bx,job->by,0,0,&du,&dv,
+                 &f1_res,&f2_res);
+    malloc_multi(1,2,sizeof(float),job->nx,job->ny,job->bx,job->by,0,0,&tmp);
+    f2_res_warp = tmp;
+  }
+  else
+  {
+    malloc_multi(5,2,sizeof(float),mx,my,job->bx,job->by,0,0,&du,&dv,
+                 &f1_res,&f2_res,&f2_res_warp);
+    malloc_multi(1,2,sizeof(float),job->nx,job->ny,job->bx,job->by,0,0,&tmp);
+  }
+
+  for (t=0; t<job->num_pairs; t++)
+  {
+    /* wait for the pair from the previous stage and for the next stage */
+    /* to have taken the last one                                        */
+    pthread_mutex_lock(&job->lock);
+    while (((s > 0) && (job->done[s-1] <= t)) ||
+           ((s < job->stages-1) && (job->begun[s+1] < t)))
+      pthread_cond_wait(&job->moved,&job->lock);
+    job->begun[s] = t+1;
+    if (s == 0)
+      job->t_start[t] = wall_time();
+    pthread_cond_broadcast(&job->moved);
+    pthread_mutex_unlock(&job->lock);
+
+    c0 = thread_time();
+    bounds_tracker_init(&bt);
+    for (d=job->first_depth[s]; d>=last; d--)
+    {
+      horn_schunck_level_size(job->nx,job->ny,job->hx,job->hy,
+                              job->n_warp_eta,d,&nx,&ny,&hx,&hy);
+      horn_schunck_warp_step(job->f[t], job->f[t+1], job->nx, job->ny,
+                             NULL, NULL, f1_res, f2_res, f2_res_warp,
+                             du, dv, job->u[t], job->v[t], tmp,
+                             nx, ny, job->bx, job->by, hx, hy,
+                             job->m_alpha, job->epsilon_d, job->epsilon_s,
+                             job->w_bright_grad, job->num_iter_inner,
+                             job->num_iter_outer, job->n_omega,
+                             job->n_warp_eta, job->max_rec_depth, d, &bt,
+                             &job->opt);
+    }
+
+    job->cpu[s] += thread_time() - c0;
+
+    pthread_mutex_lock(&job->lock);
+    job->done[s] = t+1;
+    if (s == job->stages-1)
+      job->t_end[t] = wall_time();
+    pthread_cond_broadcast(&job->moved);
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  free_multi(1,2,sizeof(float),job->nx,job->ny,job->bx,job->by,0,0,&tmp);
+  if (job->opt.low_memory)
+    free_multi(4,2,sizeof(float),mx,my,job->bx,job->by,0,0,&du,&dv,
+               &f1_res,&f2_res);
+  else
+    free_multi(5,2,sizeof(float),mx,my,job->bx,job->by,0,0,&du,&dv,
+               &f1_res,&f2_res,&f2_res_warp);
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_PIPELINE
+(
+                         /*****************************************************/
+float ***f,              /* in     : frames 0 .. num_frames-1                 */
+int   num_frames,        /* in     : number of frames                         */
+float ***u,              /* out    : x-component of the flow of pair t        */
+float ***v,              /* out    : y-component of the flow of pair t        */
+int   nx,                /* in     : size in x-direction (all frames)         */
+int   ny,                /* in     : size in y-direction (all frames)         */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels,     /* in     : desired number of warping levels         */
+const hs_options *opt,   /* in     : solver options, NULL for the defaults    */
+int   stages,            /* in     : pipeline stages (threads)                */
+hs_pipeline_info *info   /* out    : stages and timing, NULL for none         */
+                         /*****************************************************/
+)
+
+/* computes the flow of all consecutive pairs on a pipeline of stage threads */
+
+{
+                        /*****************************************************/
+hs_pipeline_job job;    /* shared state of the stages                        */
+hs_pipeline_stage stage[HS_PIPELINE_MAX_STAGES]; /* arguments of the stages  */
+pthread_t workers[HS_PIPELINE_MAX_STAGES];       /* stage threads            */
+hs_options defaults;    /* options used for opt == NULL                      */
+int   n_warp_max_levels;/* maximum possible number of warping levels         */
+int   started;          /* stage threads started                             */
+int   k, t;             /* stage, pair                                       */
+double t0, lat;         /* start of the pipeline, latency of a pair          */
+                        /*****************************************************/
+
+if (info)
+    memset(info,0,sizeof(hs_pipeline_info));
+if (num_frames < 2)
+    return;
+if (!opt)
+{
+    hs_default_options(&defaults);
+    opt = &defaults;
+}
+
+job.f = f;  job.u = u;  job.v = v;  job.num_pairs = num_frames-1;
+job.nx = nx;  job.ny = ny;  job.bx = bx;  job.by = by;
+job.hx = hx;  job.hy = hy;
+job.m_alpha = m_alpha;  job.epsilon_d = epsilon_d;
+job.epsilon_s = epsilon_s;  job.w_bright_grad = w_bright_grad;
+job.num_iter_inner = num_iter_inner;
+job.num_iter_outer = num_iter_outer;
+job.n_warp_eta = n_warp_eta;
+job.n_omega    = n_omega;
+job.opt        = *opt;
+job.opt.stats  = NULL;
+job.opt.cache  = NULL;
+job.opt.init_flow = 0;
+
+compute_max_warp_levels(nx,ny,n_warp_eta,&n_warp_max_levels);
+job.max_rec_depth = minimum(n_warp_levels,n_warp_max_levels)-1;
+stages = horn_schunck_pipeline_split(nx,ny,n_warp_eta,job.max_rec_depth,
+                                     stages,job.first_depth);
+
+job.t_start = (double*)malloc(job.num_pairs*sizeof(double));
+job.t_end   = (double*)malloc(job.num_pairs*sizeof(double));
+if (!job.t_start || !job.t_end)
+{
+    console_error("[HORN_SCHUNCK_PIPELINE] out of memory\n");
+    free(job.t_start);
+    free(job.t_end);
+    return;
+}
+memset(job.begun,0,sizeof(job.begun));
+memset(job.done,0,sizeof(job.done));
+memset(job.cpu,0,sizeof(job.cpu));
+job.go = 0;
+pthread_mutex_init(&job.lock,NULL);
+pthread_cond_init(&job.moved,NULL);
+
+/* ---- stage threads; the calling thread runs stage 0 ---- */
+/* the stages wait for go, so if a thread cannot be started the levels  */
+/* are split again over the stages that are running                     */
+for (k=0; k<stages; k++)
+{
+    stage[k].job = &job;
+    stage[k].s   = k;
+}
+for (started=1; started<stages; started++)
+    if (pthread_create(&workers[started],NULL,horn_schunck_pipeline_worker,
+                       &stage[started]) != 0)
+        break;
+if (started < stages)
+    stages = horn_schunck_pipeline_split(nx,ny,n_warp_eta,job.max_rec_depth,
+                                         started,job.first_depth);
+job.stages = stages;
+
+t0 = wall_time();
+pthread_mutex_lock(&job.lock);
+job.go = 1;
+pthread_cond_broadcast(&job.moved);
+pthread_mutex_unlock(&job.lock);
+horn_schunck_pipeline_worker(&stage[0]);
+for (k=1; k<started; k++)
+    pthread_join(workers[k],NULL);
+
+if (info)
+{
+    info->stages  = stages;
+    info->threads = started;
+    info->seconds = wall_time() - t0;
+    for (k=0; k<stages; k++)
+    {
+        info->first_depth[k]   = job.first_depth[k];
+        info->stage_seconds[k] = job.cpu[k];
+    }
+    for (t=0; t<job.num_pairs; t++)
+    {
+        lat = job.t_end[t] - job.t_start[t];
+        info->latency_mean += lat/job.num_pairs;
+        if (lat > info->latency_max)
+            info->latency_max = lat;
+    }
+}
+
+pthread_cond_destroy(&job.moved);
+pthread_mutex_destroy(&job.lock);
+free(job.t_start);
+free(job.t_end);
+}
@@ -0,0 +1,60 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Level-pipelined Horn/Schunck flow of a frame sequence (see                */
+/* horn_schunck_pipeline_c.c).                                               */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_HORN_SCHUNCK_PIPELINE_INCLUDED
+#define OF_HORN_SCHUNCK_PIPELINE_INCLUDED
+
+#define HS_PIPELINE_MAX_STAGES 16 /* upper limit of the pipeline stages     */
+
+typedef struct
+{
+ int   stages;            /* stages used (at most one per warping level)     */
+ int   first_depth[HS_PIPELINE_MAX_STAGES]; /* coarsest recursion depth of   */
+                          /*    each stage; stage s solves first_depth[s]    */
+                          /*    down to first_depth[s+1]+1, the last one     */
+                          /*    down to depth 0                              */
+ int   threads;           /* threads running the stages, the calling one     */
+                          /*    included                                     */
+ double stage_seconds[HS_PIPELINE_MAX_STAGES]; /* CPU time of each stage    */
+                          /*    on its levels, all pairs                     */
+ double seconds;          /* wall time of all pairs                          */
+ double latency_mean;     /* time from the start of a pair on the first      */
+ double latency_max;      /*    stage to its end on the last one             */
+} hs_pipeline_info;
+
+void HORN_SCHUNCK_PIPELINE
+(
+ /*****************************************************/
+ float ***f,              /* in     : frames 0 .. num_frames-1                 */
+ int   num_frames,        /* in     : number of frames                         */
+ float ***u,              /* out    : x-component of the flow of pair t        */
+                          /*          (frames t, t+1), num_frames-1 planes     */
+ float ***v,              /* out    : y-component of the flow of pair t        */
+ int   nx,                /* in     : size in x-direction (all frames)         */
+ int   ny,                /* in     : size in y-direction (all frames)         */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy,                /* in     : grid spacing in y-direction              */
+ float m_alpha,           /* in     : smoothness weight                        */
+ float epsilon_d,         /* in     : diffusivity param data term              */
+ float epsilon_s,
+ float w_bright_grad,
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels,     /* in     : desired number of warping levels         */
+ const hs_options *opt,   /* in     : solver options, NULL for the defaults;   */
+                          /*          stats, cache and init_flow are ignored   */
+ int   stages,            /* in     : pipeline stages (threads), 1: in order   */
+ hs_pipeline_info *info   /* out    : stages and timing, NULL for none         */
+/*****************************************************/
+);
+
+#endif
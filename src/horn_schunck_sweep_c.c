@@ -0,0 +1,249 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Parameter sweep: the flow of one pair for many settings of alpha,         */
+/* epsilon_d, epsilon_s and w_bright_grad, scored against a ground truth.    */
+/*                                                                           */
+/* None of these parameters changes the resampled images, so the pyramids    */
+/* of f1 and f2 are built once and shared read-only by a pool of worker      */
+/* threads. The workers take the points in order from a shared counter and   */
+/* solve them with horn_schunck_solve_pyramids; every point gets the flow of */
+/* HORN_SCHUNCK_MAIN_OPT with its parameters. The errors are those of        */
+/* calculate_errors_2d.                                                      */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <pthread.h>
+#include "horn_schunck_sweep_c.h"
+
+typedef struct
+{
+ float **f1, **f2;        /* image pair                                      */
+ float **u_truth;         /* ground truth                                    */
+ float **v_truth;
+ float ***f1_pyr;         /* shared pyramids                                 */
+ float ***f2_pyr;
+ hs_sweep_point *points;  /* table of the sweep                              */
+ int   num_points;        /* number of points                                */
+ int   next;              /* next point to be solved                         */
+ pthread_mutex_t lock;    /* protects next                                   */
+ int   nx, ny, bx, by;    /* size and boundaries                             */
+ float hx, hy;            /* grid spacing                                    */
+ int   num_iter_inner, num_iter_outer;
+ float n_warp_eta, n_omega;
+ int   max_rec_depth;     /* maximum recursion depth (warping level -1)      */
+ hs_options opt;          /* options without stats, cache and initial flow   */
+} hs_sweep_job;
+
+/* ------------------------------------------------------------------------- */
+
+int hs_sweep_grid
+(
+ /*****************************************************/
+ const float *alpha,     /* in     : values of alpha                          */
+ int   n_alpha,          /* in     : number of values of alpha                */
+ const float *epsilon_d, /* in     : values of epsilon_d                      */
+ int   n_epsilon_d,      /* in     : number of values of epsilon_d            */
+ const float *epsilon_s, /* in     : values of epsilon_s                      */
+ int   n_epsilon_s,      /* in     : number of values of epsilon_s            */
+ const float *w_bright_grad, /* in : values of w_bright_grad                  */
+ int   n_w_bright_grad,  /* in     : number of values of w_bright_grad        */
+ hs_sweep_point **points /* out    : all combinations, alpha slowest          */
+/*****************************************************/
+)
+
+/* builds the table of the cartesian product of the values; returns the    */
+/* number of points, 0 on error                                            */
+
+{
+  /*****************************************************/
+  int   a, d, s, w;       /* value indices                                     */
+  int   n;                /* number of points                                  */
+  hs_sweep_point *p;      /* current point                                     */
+  /*****************************************************/
+
+  *points = NULL;
+  if ((n_alpha < 1) || (n_epsilon_d < 1) || (n_epsilon_s < 1) ||
+      (n_w_bright_grad < 1))
+  {
+    console_error("[hs_sweep_grid] every parameter needs a value\n");
+    return 0;
+  }
+  n = n_alpha * n_epsilon_d * n_epsilon_s * n_w_bright_grad;
+  *points = (hs_sweep_point*)calloc(n,sizeof(hs_sweep_point));
+  if (!*points)
+  {
+    console_error("[hs_sweep_grid] out of memory for %d points\n",n);
+    return 0;
+  }
+
+  p = *points;
+  for(a=0;a<n_alpha;a++)
+    for(d=0;d<n_epsilon_d;d++)
+      for(s=0;s<n_epsilon_s;s++)
+        for(w=0;w<n_w_bright_grad;w++)
+        {
+          p->alpha         = alpha[a];
+          p->epsilon_d     = epsilon_d[d];
+          p->epsilon_s     = epsilon_s[s];
+          p->w_bright_grad = w_bright_grad[w];
+          p++;
+        }
+  return n;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void *horn_schunck_sweep_worker
+(
+ void *arg               /* in+out : hs_sweep_job                             */
+)
+
+/* worker thread: solves and scores points until the table is exhausted */
+
+{
+  /*****************************************************/
+  hs_sweep_job *job;      /* sweep                                             */
+  hs_sweep_point *p;      /* current point                                     */
+  float **u, **v;         /* flow of the current point                         */
+  float ref_d, cal_d;     /* densities of calculate_errors_2d                  */
+  double t0;              /* start of the solve                                */
+  int   k;                /* index of the current point                        */
+  /*****************************************************/
+
+  job = (hs_sweep_job*)arg;
+  malloc_multi(2,2,sizeof(float),job->nx,job->ny,job->bx,job->by,0,0,&u,&v);
+
+  for (;;)
+  {
+    pthread_mutex_lock(&job->lock);
+    k = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (k >= job->num_points)
+      break;
+
+    p  = &job->points[k];
+    t0 = wall_time();
+    horn_schunck_solve_pyramids(job->f1, job->f2, job->f1_pyr, job->f2_pyr,
+                                u, v, job->nx, job->ny, job->bx, job->by,
+                                job->hx, job->hy, p->alpha, p->epsilon_d,
+                                p->epsilon_s, p->w_bright_grad,
+                                job->num_iter_inner, job->num_iter_outer,
+                                job->n_warp_eta, job->n_omega,
+                                job->max_rec_depth, &job->opt);
+    p->seconds = wall_time() - t0;
+    calculate_errors_2d(job->u_truth, job->v_truth, u, v, job->nx, job->ny,
+                        job->bx, job->by, &p->aae, &p->aepe, &ref_d, &cal_d);
+  }
+
+  free_multi(2,2,sizeof(float),job->nx,job->ny,job->bx,job->by,0,0,&u,&v);
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void HORN_SCHUNCK_SWEEP
+(
+                         /*****************************************************/
+float **f1,              /* in     : 1st image                                */
+float **f2,              /* in     : 2nd image                                */
+float **u_truth,         /* in     : x-component of the ground truth          */
+float **v_truth,         /* in     : y-component of the ground truth          */
+hs_sweep_point *points,  /* in+out : parameter points, errors and times       */
+int   num_points,        /* in     : number of points                         */
+int   nx,                /* in     : size in x-direction                      */
+int   ny,                /* in     : size in y-direction                      */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels,     /* in     : desired number of warping levels         */
+const hs_options *opt,   /* in     : solver options, NULL for the defaults    */
+int   threads            /* in     : worker threads                           */
+                         /*****************************************************/
+)
+
+/* solves and scores all points of a sweep on a pool of threads */
+
+{
+                        /*****************************************************/
+hs_sweep_job job;       /* shared state of the workers                       */
+pthread_t *workers;     /* worker threads                                    */
+int   *started;         /* 1 if worker k got its own thread                  */
+float **tmp;            /* temporary array for resampling                    */
+hs_options defaults;    /* options used for opt == NULL                      */
+int   n_warp_max_levels;/* maximum possible number of warping levels         */
+int   k;                /* worker                                            */
+                        /*****************************************************/
+
+if (num_points < 1)
+    return;
+if (!opt)
+{
+    hs_default_options(&defaults);
+    opt = &defaults;
+}
+if (threads < 1)
+    threads = 1;
+if (threads > num_points)
+    threads = num_points;
+
+job.f1 = f1;  job.f2 = f2;
+job.u_truth = u_truth;  job.v_truth = v_truth;
+job.points = points;  job.num_points = num_points;  job.next = 0;
+job.nx = nx;  job.ny = ny;  job.bx = bx;  job.by = by;
+job.hx = hx;  job.hy = hy;
+job.num_iter_inner = num_iter_inner;
+job.num_iter_outer = num_iter_outer;
+job.n_warp_eta = n_warp_eta;
+job.n_omega    = n_omega;
+job.opt        = *opt;
+job.opt.stats  = NULL;
+job.opt.cache  = NULL;
+job.opt.init_flow = 0;
+
+compute_max_warp_levels(nx,ny,n_warp_eta,&n_warp_max_levels);
+job.max_rec_depth = minimum(n_warp_levels,n_warp_max_levels)-1;
+
+/* ---- shared pyramids ---- */
+job.f1_pyr  = (float***)malloc((job.max_rec_depth+1)*sizeof(float**));
+job.f2_pyr  = (float***)malloc((job.max_rec_depth+1)*sizeof(float**));
+workers = (pthread_t*)malloc(threads*sizeof(pthread_t));
+started = (int*)calloc(threads,sizeof(int));
+if (!job.f1_pyr || !job.f2_pyr || !workers || !started)
+{
+    console_error("[HORN_SCHUNCK_SWEEP] out of memory\n");
+    free(job.f1_pyr);
+    free(job.f2_pyr);
+    free(workers);
+    free(started);
+    return;
+}
+malloc_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+horn_schunck_build_pyramid(f1,job.f1_pyr,nx,ny,bx,by,n_warp_eta,
+                           job.max_rec_depth,tmp);
+horn_schunck_build_pyramid(f2,job.f2_pyr,nx,ny,bx,by,n_warp_eta,
+                           job.max_rec_depth,tmp);
+free_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+
+/* ---- thread pool; the calling thread works as well ---- */
+pthread_mutex_init(&job.lock,NULL);
+for (k=1; k<threads; k++)
+    started[k] = (pthread_create(&workers[k],NULL,horn_schunck_sweep_worker,
+                                 &job) == 0);
+horn_schunck_sweep_worker(&job);
+for (k=1; k<threads; k++)
+    if (started[k])
+        pthread_join(workers[k],NULL);
+pthread_mutex_destroy(&job.lock);
+
+horn_schunck_free_pyramid(job.f1_pyr,nx,ny,bx,by,n_warp_eta,job.max_rec_depth);
+horn_schunck_free_pyramid(job.f2_pyr,nx,ny,bx,by,n_warp_eta,job.max_rec_depth);
+free(job.f1_pyr);
+free(job.f2_pyr);
+free(workers);
+free(started);
+}
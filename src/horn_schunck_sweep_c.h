@@ -0,0 +1,64 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Parameter sweep over a grid of model parameters (see                      */
+/* horn_schunck_sweep_c.c).                                                  */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_HORN_SCHUNCK_SWEEP_INCLUDED
+#define OF_HORN_SCHUNCK_SWEEP_INCLUDED
+
+typedef struct
+{
+ float alpha;             /* in     : smoothness weight                      */
+ float epsilon_d;         /* in     : diffusivity param data term            */
+ float epsilon_s;         /* in     : diffusivity param smoothness term      */
+ float w_bright_grad;     /* in     : weight gradient vs. brightness const.  */
+ float aae;               /* out    : average angular error in degrees       */
+ float aepe;              /* out    : average endpoint error in pixels       */
+ double seconds;          /* out    : wall time of the solve                 */
+} hs_sweep_point;
+
+int hs_sweep_grid
+(
+ /*****************************************************/
+ const float *alpha,      /* in     : values of alpha                          */
+ int   n_alpha,           /* in     : number of values of alpha                */
+ const float *epsilon_d,  /* in     : values of epsilon_d                      */
+ int   n_epsilon_d,       /* in     : number of values of epsilon_d            */
+ const float *epsilon_s,  /* in     : values of epsilon_s                      */
+ int   n_epsilon_s,       /* in     : number of values of epsilon_s            */
+ const float *w_bright_grad, /* in  : values of w_bright_grad                  */
+ int   n_w_bright_grad,   /* in     : number of values of w_bright_grad        */
+ hs_sweep_point **points  /* out    : all combinations, alpha slowest;         */
+                          /*          free() after use                        */
+/*****************************************************/
+);
+
+void HORN_SCHUNCK_SWEEP
+(
+ /*****************************************************/
+ float **f1,              /* in     : 1st image                                */
+ float **f2,              /* in     : 2nd image                                */
+ float **u_truth,         /* in     : x-component of the ground truth          */
+ float **v_truth,         /* in     : y-component of the ground truth          */
+ hs_sweep_point *points,  /* in+out : parameter points, errors and times       */
+ int   num_points,        /* in     : number of points                         */
+ int   nx,                /* in     : size in x-direction                      */
+ int   ny,                /* in     : size in y-direction                      */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy,                /* in     : grid spacing in y-direction              */
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels,     /* in     : desired number of warping levels         */
+ const hs_options *opt,   /* in     : solver options, NULL for the defaults    */
+ int   threads            /* in     : worker threads                           */
+/*****************************************************/
+);
+
+#endif
@@ -0,0 +1,436 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Tiled out-of-core Horn/Schunck flow for images that do not fit into       */
+/* memory as a whole.                                                        */
+/*                                                                           */
+/* The input PGMs and the output .flo file are memory mapped; no plane of    */
+/* the full size is ever allocated. The flow is computed in two passes:      */
+/*                                                                           */
+/*  1. coarse pass: both images are block averaged by the smallest power of  */
+/*     two F that makes them fit into one tile, and the flow of that pair    */
+/*     is computed with all warping levels.                                  */
+/*  2. fine pass: the image is cut into tiles of tile x tile pixels plus     */
+/*     overlap pixels on every side. Each tile starts from the coarse flow   */
+/*     (hs_options init_flow) and runs the warping levels from about 1/F of  */
+/*     the resolution up to the full one; only its inner part is written.   */
+/*                                                                           */
+/* Tiles are processed in bands of rows. Mapped pages of bands that are done */
+/* are released, so the memory use is bounded by the size of a tile and of   */
+/* the coarse pass, not by the size of the image.                            */
+/*                                                                           */
+/*****************************************************************************/
+
+#include "horn_schunck_tiled_c.h"
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_tiled_release
+(
+ /*****************************************************/
+ mapped_file *m,         /* in+out : mapping                                  */
+ size_t from,            /* in     : first byte no longer needed              */
+ size_t to               /* in     : end of the bytes no longer needed        */
+/*****************************************************/
+)
+
+/* drops the resident pages of a byte range of a mapping; read mappings   */
+/* reload them from the file, write mappings keep the data in the file    */
+
+{
+  /*****************************************************/
+  size_t page;            /* page size                                         */
+  /*****************************************************/
+
+  page = (size_t)sysconf(_SC_PAGESIZE);
+  if (to > m->size)
+    to = m->size;
+  from = (from + page - 1) / page * page;
+  to   = to / page * page;
+  if (to > from)
+    madvise((char*)m->data + from, to - from, MADV_DONTNEED);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_tiled_read
+(
+ /*****************************************************/
+ const unsigned char *src, /* in   : first sample of the PGM                  */
+ int   bytes,            /* in     : bytes per sample (1 or 2)                */
+ int   width,            /* in     : width of the PGM                         */
+ int   x0,               /* in     : left column of the tile                  */
+ int   y0,               /* in     : top row of the tile                      */
+ float **f,              /* out    : tile                                     */
+ int   nx,               /* in     : size of the tile in x-direction          */
+ int   ny,               /* in     : size of the tile in y-direction          */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* decodes a rectangle of a mapped PGM into a plane */
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  const unsigned char *p; /* first sample of row j                             */
+  /*****************************************************/
+
+  for(j=0;j<ny;j++)
+  {
+    p = src + ((size_t)(y0+j) * width + x0) * bytes;
+    if (bytes == 1)
+      for(i=0;i<nx;i++)
+        f[i+bx][j+by] = (float)p[i];
+    else
+      for(i=0;i<nx;i++)
+        f[i+bx][j+by] = (float)((p[2*i] << 8) | p[2*i+1]);
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_tiled_coarse
+(
+ /*****************************************************/
+ const unsigned char *src, /* in   : first sample of the PGM                  */
+ mapped_file *m,         /* in+out : mapping of the PGM                       */
+ size_t offset,          /* in     : offset of src in the mapping             */
+ int   bytes,            /* in     : bytes per sample (1 or 2)                */
+ int   width,            /* in     : width of the PGM                         */
+ int   height,           /* in     : height of the PGM                        */
+ int   F,                /* in     : block size                               */
+ float **fc,             /* out    : block averages                           */
+ float **cnt,            /* tmp    : samples per block                        */
+ int   ncx,              /* in     : width of fc, ceil(width / F)             */
+ int   ncy,              /* in     : height of fc, ceil(height / F)           */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* averages F x F blocks of a mapped PGM in one pass over its rows; blocks */
+/* at the right and lower edge average the pixels they have               */
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  size_t row;             /* bytes per row                                     */
+  const unsigned char *p; /* first sample of row j                             */
+  /*****************************************************/
+
+  set_matrix_2d(fc,ncx+2*bx,ncy+2*by,0,0,(float)0.0);
+  set_matrix_2d(cnt,ncx+2*bx,ncy+2*by,0,0,(float)0.0);
+  row = (size_t)width * bytes;
+
+  for(j=0;j<height;j++)
+  {
+    p = src + j * row;
+    if (bytes == 1)
+      for(i=0;i<width;i++)
+        fc[i/F+bx][j/F+by] += (float)p[i];
+    else
+      for(i=0;i<width;i++)
+        fc[i/F+bx][j/F+by] += (float)((p[2*i] << 8) | p[2*i+1]);
+    for(i=0;i<width;i++)
+      cnt[i/F+bx][j/F+by] += 1.0f;
+
+    /* rows of completed blocks are not read again */
+    if ((j+1) % F == 0)
+      horn_schunck_tiled_release(m, offset + (size_t)(j+1-F) * row,
+                                 offset + (size_t)(j+1) * row);
+  }
+
+  for(i=bx;i<ncx+bx;i++)
+    for(j=by;j<ncy+by;j++)
+      fc[i][j] /= cnt[i][j];
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_tiled_init
+(
+ /*****************************************************/
+ float **uc,             /* in     : coarse flow, x-component (coarse pixels) */
+ float **vc,             /* in     : coarse flow, y-component                 */
+ int   ncx,              /* in     : size of the coarse flow in x-direction   */
+ int   ncy,              /* in     : size of the coarse flow in y-direction   */
+ int   F,                /* in     : block size of the coarse pass            */
+ int   x0,               /* in     : left column of the tile                  */
+ int   y0,               /* in     : top row of the tile                      */
+ float **u,              /* out    : initial flow of the tile, x-component    */
+ float **v,              /* out    : initial flow of the tile, y-component    */
+ int   nx,               /* in     : size of the tile in x-direction          */
+ int   ny,               /* in     : size of the tile in y-direction          */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* bilinear interpolation of the coarse flow at the pixels of a tile, in  */
+/* pixels of the full resolution                                          */
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  int   ii,jj;            /* upper left coarse pixel                           */
+  float xc,yc;            /* coarse coordinates                                */
+  float di,dj;            /* subpixel position                                 */
+  /*****************************************************/
+
+  for(i=0;i<nx;i++)
+    for(j=0;j<ny;j++)
+    {
+      xc = ((float)(x0+i) + 0.5f) / F - 0.5f;
+      yc = ((float)(y0+j) + 0.5f) / F - 0.5f;
+      xc = (xc < 0.0f) ? 0.0f : ((xc > ncx-1) ? (float)(ncx-1) : xc);
+      yc = (yc < 0.0f) ? 0.0f : ((yc > ncy-1) ? (float)(ncy-1) : yc);
+      ii = (int)xc;
+      jj = (int)yc;
+      if (ii > ncx-2) ii = (ncx > 1) ? ncx-2 : 0;
+      if (jj > ncy-2) jj = (ncy > 1) ? ncy-2 : 0;
+      di = xc - ii;
+      dj = yc - jj;
+      ii += bx;
+      jj += by;
+      u[i+bx][j+by] = F * ((1.0f-di)*(1.0f-dj) * uc[ii  ][jj  ]
+                         +       di *(1.0f-dj) * uc[ii+1][jj  ]
+                         + (1.0f-di)*      dj  * uc[ii  ][jj+1]
+                         +       di *      dj  * uc[ii+1][jj+1]);
+      v[i+bx][j+by] = F * ((1.0f-di)*(1.0f-dj) * vc[ii  ][jj  ]
+                         +       di *(1.0f-dj) * vc[ii+1][jj  ]
+                         + (1.0f-di)*      dj  * vc[ii  ][jj+1]
+                         +       di *      dj  * vc[ii+1][jj+1]);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_tiled_write
+(
+ /*****************************************************/
+ char  *flo,             /* in+out : first flow vector of the mapped .flo     */
+ int   width,            /* in     : width of the flow file                   */
+ float **u,              /* in     : x-component of the tile flow             */
+ float **v,              /* in     : y-component of the tile flow             */
+ int   i0,               /* in     : first column to write, tile coordinates  */
+ int   j0,               /* in     : first row to write, tile coordinates     */
+ int   nx,               /* in     : number of columns to write               */
+ int   ny,               /* in     : number of rows to write                  */
+ int   x0,               /* in     : image column of tile column i0           */
+ int   y0,               /* in     : image row of tile row j0                 */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* stores the inner part of a tile flow in the mapped .flo file */
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float *p;               /* first vector of row j                             */
+  /*****************************************************/
+
+  for(j=0;j<ny;j++)
+  {
+    p = (float*)(flo + ((size_t)(y0+j) * width + x0) * 2 * sizeof(float));
+    for(i=0;i<nx;i++)
+    {
+      p[2*i]   = u[i0+i+bx][j0+j+by];
+      p[2*i+1] = v[i0+i+bx][j0+j+by];
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+int HORN_SCHUNCK_MAIN_TILED
+(
+                         /*****************************************************/
+const char *file1,       /* in     : 1st image, binary PGM                    */
+const char *file2,       /* in     : 2nd image, binary PGM of the same size   */
+const char *flo_file,    /* in     : flow output, Middlebury .flo             */
+int   tile,              /* in     : tile size without overlap                */
+int   overlap,           /* in     : overlap on every side of a tile          */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels,     /* in     : desired number of warping levels         */
+const hs_options *opt,   /* in     : solver options, NULL for the defaults    */
+hs_tiled_info *info      /* out    : layout and timing, NULL for none         */
+                         /*****************************************************/
+)
+
+/* computes the flow between two PGM files tile by tile and writes it to  */
+/* a .flo file; returns 1 on success and 0 on failure                     */
+
+{
+                        /*****************************************************/
+mapped_file m1, m2;     /* input mappings                                    */
+mapped_file mo;         /* output mapping                                    */
+size_t o1, o2;          /* offsets of the first samples                      */
+const unsigned char *s1, *s2; /* first samples                               */
+int   nx, ny, nx2, ny2; /* image sizes                                       */
+int   maxgv, bytes, bytes2;
+int   F;                /* block size of the coarse pass                     */
+int   ncx, ncy;         /* size of the coarse pass                           */
+float **f1c, **f2c;     /* coarse images                                     */
+float **uc, **vc;       /* coarse flow                                       */
+float **cnt;            /* samples per block                                 */
+int   levels;           /* warping levels per tile                           */
+int   ext;              /* largest tile with overlap                         */
+float **f1t, **f2t;     /* tile images                                       */
+float **ut, **vt;       /* tile flow                                         */
+int   tx, ty;           /* tile origin (inner part)                          */
+int   x0, y0, x1, y1;   /* tile with overlap, [x0,x1) x [y0,y1)              */
+int   tw, th;           /* inner size of the tile                            */
+char  *flo;             /* first flow vector in the output mapping           */
+float tag;              /* .flo tag                                          */
+hs_options topt;        /* options of the tiles                              */
+hs_tiled_info local;    /* info used for info == NULL                        */
+double t0;              /* start time                                        */
+int   n;                /* number of tiles                                   */
+                        /*****************************************************/
+
+if (!info)
+    info = &local;
+memset(info,0,sizeof(hs_tiled_info));
+if (opt)
+    topt = *opt;
+else
+    hs_default_options(&topt);
+topt.cache = NULL;
+
+if ((tile < 16) || (overlap < 0))
+{
+    console_error("[HORN_SCHUNCK_MAIN_TILED] tile %d / overlap %d too small\n",
+                  tile, overlap);
+    return 0;
+}
+
+/* ---- map the input and the output ---- */
+o1 = map_pnm_file(file1,'5',1,&m1,&nx,&ny,&maxgv,&bytes);
+if (!o1)
+    return 0;
+o2 = map_pnm_file(file2,'5',1,&m2,&nx2,&ny2,&maxgv,&bytes2);
+if (!o2)
+{
+    unmap_file(&m1);
+    return 0;
+}
+if ((nx != nx2) || (ny != ny2) || (bytes != bytes2) ||
+    !map_file_write(flo_file,12 + (size_t)nx * ny * 2 * sizeof(float),&mo))
+{
+    if ((nx != nx2) || (ny != ny2) || (bytes != bytes2))
+        console_error("[HORN_SCHUNCK_MAIN_TILED] %s and %s differ in size\n",
+                      file1, file2);
+    unmap_file(&m1);
+    unmap_file(&m2);
+    return 0;
+}
+s1 = (const unsigned char*)m1.data + o1;
+s2 = (const unsigned char*)m2.data + o2;
+madvise(m1.data,m1.size,MADV_NORMAL);
+madvise(m2.data,m2.size,MADV_NORMAL);
+
+tag = 202021.25f;
+memcpy(mo.data,&tag,4);
+memcpy((char*)mo.data+4,&nx,4);
+memcpy((char*)mo.data+8,&ny,4);
+flo = (char*)mo.data + 12;
+
+/* ---- coarse pass ---- */
+t0 = wall_time();
+F = 1;
+while ((long)((nx+F-1)/F) * ((ny+F-1)/F) > (long)tile * tile)
+    F *= 2;
+ncx = (nx+F-1)/F;
+ncy = (ny+F-1)/F;
+calloc_multi(2,2,sizeof(float),ncx,ncy,bx,by,0,0,&uc,&vc);
+malloc_multi(3,2,sizeof(float),ncx,ncy,bx,by,0,0,&f1c,&f2c,&cnt);
+horn_schunck_tiled_coarse(s1,&m1,o1,bytes,nx,ny,F,f1c,cnt,ncx,ncy,bx,by);
+horn_schunck_tiled_coarse(s2,&m2,o2,bytes,nx,ny,F,f2c,cnt,ncx,ncy,bx,by);
+topt.init_flow = 0;
+HORN_SCHUNCK_MAIN_OPT(f1c,f2c,uc,vc,ncx,ncy,bx,by,1.0f,1.0f,m_alpha,
+                      epsilon_d,epsilon_s,w_bright_grad,num_iter_inner,
+                      num_iter_outer,n_warp_eta,n_omega,n_warp_levels,&topt);
+free_multi(3,2,sizeof(float),ncx,ncy,bx,by,0,0,&f1c,&f2c,&cnt);
+info->seconds_coarse = wall_time() - t0;
+
+/* ---- fine pass ---- */
+t0 = wall_time();
+n = 0;
+levels = 1;
+if (F > 1)
+    levels = 1 + (int)floor(log(1.0/F)/log(n_warp_eta) + 0.5);
+if (levels > n_warp_levels)
+    levels = n_warp_levels;
+
+if (F == 1)
+{
+    /* the image is a single tile: the coarse pass is the result */
+    horn_schunck_tiled_write(flo,nx,uc,vc,0,0,nx,ny,0,0,bx,by);
+    n = 1;
+}
+else
+{
+    ext = tile + 2*overlap;
+    malloc_multi(4,2,sizeof(float),ext,ext,bx,by,0,0,&f1t,&f2t,&ut,&vt);
+    topt.init_flow = 1;
+    for(ty=0;ty<ny;ty+=tile)
+    {
+        th = (ty+tile < ny) ? tile : ny-ty;
+        for(tx=0;tx<nx;tx+=tile)
+        {
+            tw = (tx+tile < nx) ? tile : nx-tx;
+            x0 = (tx-overlap > 0) ? tx-overlap : 0;
+            y0 = (ty-overlap > 0) ? ty-overlap : 0;
+            x1 = (tx+tw+overlap < nx) ? tx+tw+overlap : nx;
+            y1 = (ty+th+overlap < ny) ? ty+th+overlap : ny;
+
+            horn_schunck_tiled_read(s1,bytes,nx,x0,y0,f1t,x1-x0,y1-y0,bx,by);
+            horn_schunck_tiled_read(s2,bytes,nx,x0,y0,f2t,x1-x0,y1-y0,bx,by);
+            horn_schunck_tiled_init(uc,vc,ncx,ncy,F,x0,y0,ut,vt,
+                                    x1-x0,y1-y0,bx,by);
+            HORN_SCHUNCK_MAIN_OPT(f1t,f2t,ut,vt,x1-x0,y1-y0,bx,by,1.0f,1.0f,
+                                  m_alpha,epsilon_d,epsilon_s,w_bright_grad,
+                                  num_iter_inner,num_iter_outer,n_warp_eta,
+                                  n_omega,levels,&topt);
+            horn_schunck_tiled_write(flo,nx,ut,vt,tx-x0,ty-y0,tw,th,tx,ty,
+                                     bx,by);
+            n++;
+        }
+
+        /* rows above the overlap of the next band are done */
+        y0 = (ty+tile-overlap > 0) ? ty+tile-overlap : 0;
+        if (y0 > ny)
+            y0 = ny;
+        horn_schunck_tiled_release(&m1,o1,o1 + (size_t)y0 * nx * bytes);
+        horn_schunck_tiled_release(&m2,o2,o2 + (size_t)y0 * nx * bytes);
+        horn_schunck_tiled_release(&mo,12,12 + (size_t)(ty+th) * nx * 2 *
+                                          sizeof(float));
+    }
+    free_multi(4,2,sizeof(float),ext,ext,bx,by,0,0,&f1t,&f2t,&ut,&vt);
+}
+info->seconds_tiles = wall_time() - t0;
+
+info->coarse_factor = F;
+info->coarse_nx     = ncx;
+info->coarse_ny     = ncy;
+info->tile_levels   = (F == 1) ? 0 : levels;
+info->tiles         = n;
+
+free_multi(2,2,sizeof(float),ncx,ncy,bx,by,0,0,&uc,&vc);
+unmap_file(&m1);
+unmap_file(&m2);
+unmap_file(&mo);
+return 1;
+}
@@ -0,0 +1,46 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Tiled out-of-core Horn/Schunck flow (see horn_schunck_tiled_c.c).         */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_HORN_SCHUNCK_TILED_INCLUDED
+#define OF_HORN_SCHUNCK_TILED_INCLUDED
+
+typedef struct
+{
+ int   coarse_factor;     /* block size of the coarse pass (power of 2)      */
+ int   coarse_nx;         /* size of the coarse pass                         */
+ int   coarse_ny;
+ int   tile_levels;       /* warping levels solved per tile                  */
+ int   tiles;             /* number of tiles                                 */
+ double seconds_coarse;   /* wall time of the coarse pass                    */
+ double seconds_tiles;    /* wall time of all tiles                          */
+} hs_tiled_info;
+
+int HORN_SCHUNCK_MAIN_TILED
+(
+ /*****************************************************/
+ const char *file1,       /* in     : 1st image, binary PGM                    */
+ const char *file2,       /* in     : 2nd image, binary PGM of the same size   */
+ const char *flo_file,    /* in     : flow output, Middlebury .flo             */
+ int   tile,              /* in     : tile size without overlap                */
+ int   overlap,           /* in     : overlap on every side of a tile          */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float m_alpha,           /* in     : smoothness weight                        */
+ float epsilon_d,         /* in     : diffusivity param data term              */
+ float epsilon_s,
+ float w_bright_grad,
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels,     /* in     : desired number of warping levels         */
+ const hs_options *opt,   /* in     : solver options, NULL for the defaults    */
+ hs_tiled_info *info      /* out    : layout and timing, NULL for none         */
+/*****************************************************/
+);
+
+#endif
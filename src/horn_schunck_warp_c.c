@@ -18,6 +18,8 @@
 #include "matrix_lib.c"
 #include "mg_trans_lib.c"
 #include "diffusivity_lib.c"
+#include "half_lib.c"
+#include "precision_lib.h"
 #include "horn_schunck_warp_c.h"
 
 /* ------------------------------------------------------------------------- */
@@ -85,7 +87,7 @@ void backward_registration
 (
                            /**************************************************/
     float **f1,            /* in  : 1st image                                */
-    float **f2,            /* in  : 2nd image                                */
+    float **f2,            /* in  : 2nd image, boundaries zero               */
     float **f2_bw,         /* out : 2nd image (motion compensated)           */
     float **u,             /* in     : x-component of displacement field     */
     float **v,             /* in     : y-component of displacement field     */
@@ -98,7 +100,8 @@ void backward_registration
                            /**************************************************/
     )
 
-/* creates warped version of image f2 by means of bilinear interpolation */
+/* creates warped version of image f2 by means of bilinear interpolation; */
+/* f2 is only read, the caller zeroes its boundaries                      */
 
 {
                            /**************************************************/
@@ -113,9 +116,6 @@ float hx_1,hy_1;           /* time saver                                     */
 hx_1=1.0/hx;
 hy_1=1.0/hy;
 
-/* set boundaries zero */ 
-set_bounds_2d(f2,nx,ny,bx,by,(float)0.0);
-
  for (i=bx; i<nx+bx; i++)
      for (j=by; j<ny+by; j++)
      {		
@@ -123,8 +123,9 @@ set_bounds_2d(f2,nx,ny,bx,by,(float)0.0);
 	 ii_fp=i+(u[i][j]*hx_1);
 	 jj_fp=j+(v[i][j]*hy_1);
 	               
-	 /* if the required image information is out of bounds */
-	 if ((ii_fp<bx)||(jj_fp<by)||(ii_fp>(nx+bx-1))||(jj_fp>(ny+by-1)))
+	 /* if the required image information is out of bounds (or the */
+	 /* flow is not finite)                                          */
+	 if (!((ii_fp>=bx)&&(jj_fp>=by)&&(ii_fp<=(nx+bx-1))&&(jj_fp<=(ny+by-1))))
 	   {
 	       /* assume zero flow, i.e. set warped 2nd image to 1st image */
 	       f2_bw[i][j]=f1[i][j];	       	       	       
@@ -216,21 +217,22 @@ void update_nonlinearities_reg
  int   bx,               /* in     : boundary size in x-direction             */
  int   by,                /* in     : boundary size in y-direction             */
  float hx,
- float hy
+ float hy,
+ bounds_tracker *bt      /* in+out : halo validity of u, v, du, dv            */
 /*****************************************************/
 )
 {
   int i,j;
-  float help;
+  of_real help;
   float **ux, **uy, **vx, **vy;
   float **dux, **duy, **dvx, **dvy;
   malloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&ux,&uy,&vx,&vy);
   malloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&dux,&duy,&dvx,&dvy);
   
-  mirror_bounds_2d(u, nx, ny, bx,by);
-  mirror_bounds_2d(v, nx, ny, bx,by);
-  mirror_bounds_2d(du, nx, ny, bx,by);
-  mirror_bounds_2d(dv, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, u, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, v, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, du, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, dv, nx, ny, bx,by);
 
   gradint_central( u, ux, uy, nx, ny, bx, by, hx, hy);
   gradint_central( v, vx, vy, nx, ny, bx, by, hx, hy);
@@ -243,14 +245,14 @@ void update_nonlinearities_reg
   for(i=bx;i<nx+bx;i++)
     for(j=by;j<ny+by;j++)
     {
-      help = (ux[i][j]+dux[i][j])*(ux[i][j]+dux[i][j])
-            +(vx[i][j]+dvx[i][j])*(vx[i][j]+dvx[i][j])
-            +(uy[i][j]+duy[i][j])*(uy[i][j]+duy[i][j])
-            +(vy[i][j]+dvy[i][j])*(vy[i][j]+dvy[i][j]);
+      help = (OF_ACC(ux[i][j])+dux[i][j])*(OF_ACC(ux[i][j])+dux[i][j])
+            +(OF_ACC(vx[i][j])+dvx[i][j])*(OF_ACC(vx[i][j])+dvx[i][j])
+            +(OF_ACC(uy[i][j])+duy[i][j])*(OF_ACC(uy[i][j])+duy[i][j])
+            +(OF_ACC(vy[i][j])+dvy[i][j])*(OF_ACC(vy[i][j])+dvy[i][j]);
       
       
       // Charbonnier function
-      psi_prime_s[i][j] = 1.0/sqrt( help/(lambda * lambda) + 1.0);
+      psi_prime_s[i][j] = OF_C(1.0)/OF_SQRT( help/(OF_ACC(lambda) * lambda) + OF_C(1.0));
     }
   
   
@@ -258,6 +260,65 @@ void update_nonlinearities_reg
   free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&dux,&duy,&dvx,&dvy);
 }
 
+/* ------------------------------------------------------------------------- */
+
+void update_nonlinearities_reg_low_memory
+(
+ /*****************************************************/
+ float **u,
+ float **v,
+ float **du,             /* in     : x-component of flow increment            */
+ float **dv,             /* in     : y-component of flow increment            */
+ float **psi_prime_s,    /* out    : nonlinearity smoothness term             */
+ float lambda,           /* in     : diffusivity parameter                    */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,
+ float hy,
+ bounds_tracker *bt      /* in+out : halo validity of u, v, du, dv            */
+/*****************************************************/
+)
+
+/* same as update_nonlinearities_reg; the central differences are formed  */
+/* per pixel instead of in eight gradient planes                          */
+
+{
+  int i,j;
+  of_real help;
+  of_real ux, uy, vx, vy;
+  of_real dux, duy, dvx, dvy;
+  of_real hx_1 = OF_C(1.0)/(OF_C(2.0)*hx);
+  of_real hy_1 = OF_C(1.0)/(OF_C(2.0)*hy);
+
+  mirror_bounds_2d_tracked(bt, u, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, v, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, du, nx, ny, bx,by);
+  mirror_bounds_2d_tracked(bt, dv, nx, ny, bx,by);
+
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      ux  = (OF_ACC(u[i+1][j]) - u[i-1][j])*hx_1;
+      uy  = (OF_ACC(u[i][j+1]) - u[i][j-1])*hy_1;
+      vx  = (OF_ACC(v[i+1][j]) - v[i-1][j])*hx_1;
+      vy  = (OF_ACC(v[i][j+1]) - v[i][j-1])*hy_1;
+      dux = (OF_ACC(du[i+1][j]) - du[i-1][j])*hx_1;
+      duy = (OF_ACC(du[i][j+1]) - du[i][j-1])*hy_1;
+      dvx = (OF_ACC(dv[i+1][j]) - dv[i-1][j])*hx_1;
+      dvy = (OF_ACC(dv[i][j+1]) - dv[i][j-1])*hy_1;
+
+      help = (OF_ACC(ux)+dux)*(OF_ACC(ux)+dux)
+            +(OF_ACC(vx)+dvx)*(OF_ACC(vx)+dvx)
+            +(OF_ACC(uy)+duy)*(OF_ACC(uy)+duy)
+            +(OF_ACC(vy)+dvy)*(OF_ACC(vy)+dvy);
+
+      // Charbonnier function
+      psi_prime_s[i][j] = OF_C(1.0)/OF_SQRT( help/(OF_ACC(lambda) * lambda) + OF_C(1.0));
+    }
+}
+
 
 
 /* ------------------------------------------------------------------------- */
@@ -283,28 +344,225 @@ int   by                /* in     : boundary size in y-direction             */
 )
 {
 int i,j;
-float help;
+of_real help;
 for(i=bx;i<nx+bx;i++)
     for(j=by;j<ny+by;j++)
     {
 		help =
-					J_11[i][j]*du[i][j]*du[i][j]
-			+       J_22[i][j]*dv[i][j]*dv[i][j]
-			+ 2.0 * J_12[i][j]*du[i][j]*dv[i][j]
-			+ 2.0 * J_13[i][j]*du[i][j]
-			+ 2.0 * J_23[i][j]*dv[i][j]
+					OF_ACC(J_11[i][j])*du[i][j]*du[i][j]
+			+       OF_ACC(J_22[i][j])*dv[i][j]*dv[i][j]
+			+ OF_C(2.0) * J_12[i][j]*du[i][j]*dv[i][j]
+			+ OF_C(2.0) * J_13[i][j]*du[i][j]
+			+ OF_C(2.0) * J_23[i][j]*dv[i][j]
 			+       J_33[i][j];
 
 			/* limited precision requires check for negative values */
 			if (help<0) help=0;
 
-      psi_prime_d[i][j] = 1.0/sqrt( help/(epsilon_d * epsilon_d) + 1.0);
+      psi_prime_d[i][j] = OF_C(1.0)/OF_SQRT( help/(OF_ACC(epsilon_d) * epsilon_d) + OF_C(1.0));
 	}
 }
 /* ------------------------------------------------------------------------- */
 
 /* ------------------------------------------------------------------------- */
 
+void horn_schunck_warp_sor_edge
+(
+ /*****************************************************/
+ float **J_11,           /* in     : entry 11 of the motion tensor            */
+ float **J_22,           /* in     : entry 22 of the motion tensor            */
+ float **J_12,           /* in     : entry 12 of the motion tensor            */
+ float **J_13,           /* in     : entry 13 of the motion tensor            */
+ float **J_23,           /* in     : entry 23 of the motion tensor            */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **psi_prime_d,    /* in     : nonlinearity data term                   */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx_2,             /* in     : alpha/(hx*hx)                            */
+ float hy_2,             /* in     : alpha/(hy*hy)                            */
+ float omega,            /* in     : SOR overrelaxation parameter             */
+ int   i,                /* in     : pixel on the first or last row/column    */
+ int   j                 /* in     :                                          */
+/*****************************************************/
+)
+
+/*
+ SOR update of one pixel at the image boundary; neighbours outside the
+ image have weight zero and are not read, so the halos may hold anything
+*/
+
+{
+  /*****************************************************/
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  of_real nu_xp,nu_xm;    /* du+u of the neighbours (0 outside the image)      */
+  of_real nu_yp,nu_ym;    /*                                                   */
+  of_real nv_xp,nv_xm;    /* dv+v of the neighbours (0 outside the image)      */
+  of_real nv_yp,nv_ym;    /*                                                   */
+  /*****************************************************/
+  
+  xp = xm = yp = ym = 0.0f;
+  nu_xp = nu_xm = nu_yp = nu_ym = 0.0f;
+  nv_xp = nv_xm = nv_yp = nv_ym = 0.0f;
+  if (i<nx+bx-1)
+  {
+    xp = hx_2 * (OF_ACC(psi_prime_s[i+1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_xp = OF_ACC(du[i+1][j]) + u[i+1][j];
+    nv_xp = OF_ACC(dv[i+1][j]) + v[i+1][j];
+  }
+  if (i>bx)
+  {
+    xm = hx_2 * (OF_ACC(psi_prime_s[i-1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_xm = OF_ACC(du[i-1][j]) + u[i-1][j];
+    nv_xm = OF_ACC(dv[i-1][j]) + v[i-1][j];
+  }
+  if (j<ny+by-1)
+  {
+    yp = hy_2 * (OF_ACC(psi_prime_s[i][j+1])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_yp = OF_ACC(du[i][j+1]) + u[i][j+1];
+    nv_yp = OF_ACC(dv[i][j+1]) + v[i][j+1];
+  }
+  if (j>by)
+  {
+    ym = hy_2 * (OF_ACC(psi_prime_s[i][j-1])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_ym = OF_ACC(du[i][j-1]) + u[i][j-1];
+    nv_ym = OF_ACC(dv[i][j-1]) + v[i][j-1];
+  }
+  
+  sum = xp + xm + yp + ym;
+  
+  du[i][j]= (OF_C(1.0)-omega) * du[i][j] +
+  omega *
+  (  - OF_ACC(psi_prime_d[i][j])*J_13[i][j]
+   - (OF_ACC(psi_prime_d[i][j])*J_12[i][j] * dv[i  ][j  ]
+      - OF_ACC(xm) * nu_xm
+      - OF_ACC(ym) * nu_ym
+      - OF_ACC(yp) * nu_yp
+      - OF_ACC(xp) * nu_xp
+      + OF_ACC(sum) * (               u[i  ][j  ])))
+  /(OF_ACC(psi_prime_d[i][j])*J_11[i][j]+sum);
+  
+  /* du[i][j] changed, the dv update sees the new value as before */
+  dv[i][j]= (OF_C(1.0)-omega) * dv[i][j] +
+  omega *
+  (  - OF_ACC(psi_prime_d[i][j])*J_23[i][j]
+   - (OF_ACC(psi_prime_d[i][j])*J_12[i][j] * du[i  ][j  ]
+      - OF_ACC(xm) * nv_xm
+      - OF_ACC(ym) * nv_ym
+      - OF_ACC(yp) * nv_yp
+      - OF_ACC(xp) * nv_xp
+      + OF_ACC(sum) * (               v[i  ][j  ])))
+  /(OF_ACC(psi_prime_d[i][j])*J_22[i][j]+sum);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_column
+(
+ /*****************************************************/
+ float **J_11,           /* in     : entry 11 of the motion tensor            */
+ float **J_22,           /* in     : entry 22 of the motion tensor            */
+ float **J_12,           /* in     : entry 12 of the motion tensor            */
+ float **J_13,           /* in     : entry 13 of the motion tensor            */
+ float **J_23,           /* in     : entry 23 of the motion tensor            */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **psi_prime_d,    /* in     : nonlinearity data term                   */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx_2,             /* in     : alpha/(hx*hx)                            */
+ float hy_2,             /* in     : alpha/(hy*hy)                            */
+ float omega,            /* in     : SOR overrelaxation parameter             */
+ int   i                 /* in     : column                                   */
+/*****************************************************/
+)
+
+/*
+ SOR update of column i of horn_schunck_warp_sor; the motion tensor is
+ only read in column i
+*/
+
+{
+  /*****************************************************/
+  int   j;                /* loop variable                                     */
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  /*****************************************************/
+  
+  /* first and last column */
+  if ((i==bx)||(i==nx+bx-1))
+  {
+    for(j=by;j<ny+by;j++)
+      horn_schunck_warp_sor_edge(J_11, J_22, J_12, J_13, J_23, du, dv, u, v,
+                                 psi_prime_d, psi_prime_s, nx, ny, bx, by,
+                                 hx_2, hy_2, omega, i, j);
+    return;
+  }
+  
+  /* first row */
+  horn_schunck_warp_sor_edge(J_11, J_22, J_12, J_13, J_23, du, dv, u, v,
+                             psi_prime_d, psi_prime_s, nx, ny, bx, by,
+                             hx_2, hy_2, omega, i, by);
+  
+  /* interior */
+  for(j=by+1;j<ny+by-1;j++)
+  {
+    /* compute weights */
+    xp =  hx_2 * (OF_ACC(psi_prime_s[i+1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    xm =  hx_2 * (OF_ACC(psi_prime_s[i-1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    yp =  hy_2 * (OF_ACC(psi_prime_s[i][j+1])+psi_prime_s[i][j])/OF_C(2.0);
+    ym =  hy_2 * (OF_ACC(psi_prime_s[i][j-1])+psi_prime_s[i][j])/OF_C(2.0);
+    
+    sum = xp + xm + yp + ym;
+    
+    /* perform SOR iteration */
+    
+    du[i][j]= (OF_C(1.0)-omega) * du[i][j] +
+    omega *
+    /* Gauss-Seidel step */
+    (  - OF_ACC(psi_prime_d[i][j])*J_13[i][j]
+     - (OF_ACC(psi_prime_d[i][j])*J_12[i][j] * dv[i  ][j  ]
+        - xm  * (OF_ACC(du[i-1][j  ]) + u[i-1][j  ])
+        - ym  * (OF_ACC(du[i  ][j-1]) + u[i  ][j-1])
+        - yp  * (OF_ACC(du[i  ][j+1]) + u[i  ][j+1])
+        - xp  * (OF_ACC(du[i+1][j  ]) + u[i+1][j  ])
+        + OF_ACC(sum) * (               u[i  ][j  ])))
+    /(OF_ACC(psi_prime_d[i][j])*J_11[i][j]+sum);
+    
+    
+    dv[i][j]= (OF_C(1.0)-omega) * dv[i][j] +
+    omega *
+    /* Gauss-Seidel step */
+    (  - OF_ACC(psi_prime_d[i][j])*J_23[i][j]
+     - (OF_ACC(psi_prime_d[i][j])*J_12[i][j] * du[i  ][j  ]
+        - xm  * (OF_ACC(dv[i-1][j  ]) + v[i-1][j  ])
+        - ym  * (OF_ACC(dv[i  ][j-1]) + v[i  ][j-1])
+        - yp  * (OF_ACC(dv[i  ][j+1]) + v[i  ][j+1])
+        - xp  * (OF_ACC(dv[i+1][j  ]) + v[i+1][j  ])
+        + OF_ACC(sum) * (               v[i  ][j  ])))
+    /(OF_ACC(psi_prime_d[i][j])*J_22[i][j]+sum);
+  }
+  
+  /* last row */
+  if (ny>1)
+    horn_schunck_warp_sor_edge(J_11, J_22, J_12, J_13, J_23, du, dv, u, v,
+                               psi_prime_d, psi_prime_s, nx, ny, bx, by,
+                               hx_2, hy_2, omega, i, ny+by-1);
+}
+
+/* ------------------------------------------------------------------------- */
+
 void horn_schunck_warp_sor
 (
  /*****************************************************/
@@ -332,15 +590,16 @@ void horn_schunck_warp_sor
 )
 
 /*
- Computes one SOR iteration
- */
+ Computes one SOR iteration. The first and last row and column go through
+ horn_schunck_warp_sor_edge, the interior needs no boundary predicates and
+ reads no halos, so no boundaries have to be set or mirrored per sweep.
+ The pixels are visited in the original order.
+*/
 
 {
   /*****************************************************/
-  int   i,j;              /* loop variables                                    */
+  int   i;                /* loop variable                                     */
   float hx_2,hy_2;        /* time saver variables                              */
-  float xp,xm,yp,ym;      /* neighbourhood weights                             */
-  float sum;              /* central weight                                    */
   /*****************************************************/
   
   
@@ -348,202 +607,2029 @@ void horn_schunck_warp_sor
   hx_2=alpha/(hx*hx);
   hy_2=alpha/(hy*hy);
   
-  
-  /* set boundaries zero */
+  for(i=bx;i<nx+bx;i++)
+    horn_schunck_warp_sor_column(J_11, J_22, J_12, J_13, J_23, du, dv, u, v,
+                                 psi_prime_d, psi_prime_s, nx, ny, bx, by,
+                                 hx_2, hy_2, omega, i);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* records of the interleaved layout (hs_options interleaved): the flow    */
+/* record holds du, dv, u, v of a pixel, the tensor record J_11, J_22,     */
+/* J_12, J_13, J_23 and psi_prime_d                                        */
+#define HS_FLOW_RECORD   4
+#define HS_TENSOR_RECORD 6
+
+void hs_interleave
+(
+ /*****************************************************/
+ float **p,              /* in     : plane                                    */
+ float **rec,            /* out    : records, rec[i][n*j+slot] = p[i][j]      */
+ int   n,                /* in     : floats per record                        */
+ int   slot,             /* in     : position of p in the record              */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
 
-  set_bounds_2d(du,nx,ny,bx,by,0.0);
-  set_bounds_2d(dv,nx,ny,bx,by,0.0);
+/* copies the inner pixels of a plane into one slot of the records */
+
+{
+  int   i,j;
   
-  /* mirror boundary	*/
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+      rec[i][n*j+slot] = p[i][j];
+}
+
+/* ------------------------------------------------------------------------- */
+
+void hs_deinterleave
+(
+ /*****************************************************/
+ float **rec,            /* in     : records                                  */
+ float **p,              /* out    : plane, p[i][j] = rec[i][n*j+slot]        */
+ int   n,                /* in     : floats per record                        */
+ int   slot,             /* in     : position of p in the record              */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
+)
+
+/* copies one slot of the records of the inner pixels back into a plane */
+
+{
+  int   i,j;
   
-  mirror_bounds_2d(u,nx,ny,bx,by);
-  mirror_bounds_2d(v,nx,ny,bx,by);
-  mirror_bounds_2d(psi_prime_s,nx,ny,bx,by);
-  mirror_bounds_2d(psi_prime_d,nx,ny,bx,by);
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+      p[i][j] = rec[i][n*j+slot];
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_interleaved_edge
+(
+ /*****************************************************/
+ float **T,              /* in     : tensor records                           */
+ float **W,              /* in+out : flow records                             */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx_2,             /* in     : alpha/(hx*hx)                            */
+ float hy_2,             /* in     : alpha/(hy*hy)                            */
+ float omega,            /* in     : SOR overrelaxation parameter             */
+ int   i,                /* in     : pixel on the first or last row/column    */
+ int   j                 /* in     :                                          */
+/*****************************************************/
+)
 
+/* horn_schunck_warp_sor_edge on the records, with the same arithmetic */
+
+{
+  /*****************************************************/
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  of_real nu_xp,nu_xm;    /* du+u of the neighbours (0 outside the image)      */
+  of_real nu_yp,nu_ym;    /*                                                   */
+  of_real nv_xp,nv_xm;    /* dv+v of the neighbours (0 outside the image)      */
+  of_real nv_yp,nv_ym;    /*                                                   */
+  float   *t, *w, *n;     /* records of the pixel and of a neighbour           */
+  /*****************************************************/
+  
+  t = T[i] + HS_TENSOR_RECORD*j;
+  w = W[i] + HS_FLOW_RECORD*j;
+  xp = xm = yp = ym = 0.0f;
+  nu_xp = nu_xm = nu_yp = nu_ym = 0.0f;
+  nv_xp = nv_xm = nv_yp = nv_ym = 0.0f;
+  if (i<nx+bx-1)
+  {
+    n = W[i+1] + HS_FLOW_RECORD*j;
+    xp = hx_2 * (OF_ACC(psi_prime_s[i+1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_xp = OF_ACC(n[0]) + n[2];
+    nv_xp = OF_ACC(n[1]) + n[3];
+  }
+  if (i>bx)
+  {
+    n = W[i-1] + HS_FLOW_RECORD*j;
+    xm = hx_2 * (OF_ACC(psi_prime_s[i-1][j])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_xm = OF_ACC(n[0]) + n[2];
+    nv_xm = OF_ACC(n[1]) + n[3];
+  }
+  if (j<ny+by-1)
+  {
+    n = w + HS_FLOW_RECORD;
+    yp = hy_2 * (OF_ACC(psi_prime_s[i][j+1])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_yp = OF_ACC(n[0]) + n[2];
+    nv_yp = OF_ACC(n[1]) + n[3];
+  }
+  if (j>by)
+  {
+    n = w - HS_FLOW_RECORD;
+    ym = hy_2 * (OF_ACC(psi_prime_s[i][j-1])+psi_prime_s[i][j])/OF_C(2.0);
+    nu_ym = OF_ACC(n[0]) + n[2];
+    nv_ym = OF_ACC(n[1]) + n[3];
+  }
+  
+  sum = xp + xm + yp + ym;
   
+  w[0]= (OF_C(1.0)-omega) * w[0] +
+  omega *
+  (  - OF_ACC(t[5])*t[3]
+   - (OF_ACC(t[5])*t[2] * w[1]
+      - OF_ACC(xm) * nu_xm
+      - OF_ACC(ym) * nu_ym
+      - OF_ACC(yp) * nu_yp
+      - OF_ACC(xp) * nu_xp
+      + OF_ACC(sum) * (               w[2])))
+  /(OF_ACC(t[5])*t[0]+sum);
+  
+  w[1]= (OF_C(1.0)-omega) * w[1] +
+  omega *
+  (  - OF_ACC(t[5])*t[4]
+   - (OF_ACC(t[5])*t[2] * w[0]
+      - OF_ACC(xm) * nv_xm
+      - OF_ACC(ym) * nv_ym
+      - OF_ACC(yp) * nv_yp
+      - OF_ACC(xp) * nv_xp
+      + OF_ACC(sum) * (               w[3])))
+  /(OF_ACC(t[5])*t[1]+sum);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_interleaved
+(
+ /*****************************************************/
+ float **T,              /* in     : tensor records                           */
+ float **W,              /* in+out : flow records                             */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float alpha,            /* in     : smoothness weight                        */
+ float omega             /* in     : SOR overrelaxation parameter             */
+/*****************************************************/
+)
+
+/*
+ horn_schunck_warp_sor on the interleaved layout. A pixel update reads
+ one tensor record, the flow records of the pixel and its 4 neighbours
+ and psi_prime_s: 3 streams instead of 11 planes. The pixels are visited
+ in the same order with the same arithmetic, so the flow is the same.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float hx_2,hy_2;        /* time saver variables                              */
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  float *t, *w;           /* records of the pixel                              */
+  float *wm, *wp;         /* records of the left and right neighbour           */
+  float *s, *sm, *sp;     /* psi_prime_s of the column and its neighbours      */
+  /*****************************************************/
   
+  hx_2=alpha/(hx*hx);
+  hy_2=alpha/(hy*hy);
   
   for(i=bx;i<nx+bx;i++)
-    for(j=by;j<ny+by;j++)
+  {
+    /* first and last column */
+    if ((i==bx)||(i==nx+bx-1))
+    {
+      for(j=by;j<ny+by;j++)
+        horn_schunck_warp_sor_interleaved_edge(T, W, psi_prime_s, nx, ny,
+                                               bx, by, hx_2, hy_2, omega,
+                                               i, j);
+      continue;
+    }
+    
+    /* first row */
+    horn_schunck_warp_sor_interleaved_edge(T, W, psi_prime_s, nx, ny, bx, by,
+                                           hx_2, hy_2, omega, i, by);
+    
+    /* interior */
+    s  = psi_prime_s[i];
+    sm = psi_prime_s[i-1];
+    sp = psi_prime_s[i+1];
+    for(j=by+1;j<ny+by-1;j++)
     {
-      /* compute weights */
-      xp =  (i<nx+bx-1) * hx_2 * (psi_prime_s[i+1][j]+psi_prime_s[i][j])/2.0;
-      xm =  (i>bx)      * hx_2 * (psi_prime_s[i-1][j]+psi_prime_s[i][j])/2.0;
-      yp =  (j<ny+by-1) * hy_2 * (psi_prime_s[i][j+1]+psi_prime_s[i][j])/2.0;
-      ym =  (j>by)      * hy_2 * (psi_prime_s[i][j-1]+psi_prime_s[i][j])/2.0;
+      t  = T[i]   + HS_TENSOR_RECORD*j;
+      w  = W[i]   + HS_FLOW_RECORD*j;
+      wm = W[i-1] + HS_FLOW_RECORD*j;
+      wp = W[i+1] + HS_FLOW_RECORD*j;
       
-      sum = xp + xm + yp + ym;
+      xp =  hx_2 * (OF_ACC(sp[j])+s[j])/OF_C(2.0);
+      xm =  hx_2 * (OF_ACC(sm[j])+s[j])/OF_C(2.0);
+      yp =  hy_2 * (OF_ACC(s[j+1])+s[j])/OF_C(2.0);
+      ym =  hy_2 * (OF_ACC(s[j-1])+s[j])/OF_C(2.0);
       
-      /* perform SOR iteration */
+      sum = xp + xm + yp + ym;
       
-      du[i][j]= (1.0-omega) * du[i][j] +
+      w[0]= (OF_C(1.0)-omega) * w[0] +
       omega *
-      /* Gauss-Seidel step */
-      (  - psi_prime_d[i][j]*J_13[i][j]
-       - (psi_prime_d[i][j]*J_12[i][j] * dv[i  ][j  ]
-          - xm  * (du[i-1][j  ] + u[i-1][j  ])
-          - ym  * (du[i  ][j-1] + u[i  ][j-1])
-          - yp  * (du[i  ][j+1] + u[i  ][j+1])
-          - xp  * (du[i+1][j  ] + u[i+1][j  ])
-          + sum * (               u[i  ][j  ])))
-      /(psi_prime_d[i][j]*J_11[i][j]+sum);
-      
+      (  - OF_ACC(t[5])*t[3]
+       - (OF_ACC(t[5])*t[2] * w[1]
+          - xm  * (OF_ACC(wm[0]) + wm[2])
+          - ym  * (OF_ACC(w[-HS_FLOW_RECORD]) + w[2-HS_FLOW_RECORD])
+          - yp  * (OF_ACC(w[ HS_FLOW_RECORD]) + w[2+HS_FLOW_RECORD])
+          - xp  * (OF_ACC(wp[0]) + wp[2])
+          + OF_ACC(sum) * (               w[2])))
+      /(OF_ACC(t[5])*t[0]+sum);
       
-      dv[i][j]= (1.0-omega) * dv[i][j] +
+      w[1]= (OF_C(1.0)-omega) * w[1] +
       omega *
-      /* Gauss-Seidel step */
-      (  - psi_prime_d[i][j]*J_23[i][j]
-       - (psi_prime_d[i][j]*J_12[i][j] * du[i  ][j  ]
-          - xm  * (dv[i-1][j  ] + v[i-1][j  ])
-          - ym  * (dv[i  ][j-1] + v[i  ][j-1])
-          - yp  * (dv[i  ][j+1] + v[i  ][j+1])
-          - xp  * (dv[i+1][j  ] + v[i+1][j  ])
-          + sum * (               v[i  ][j  ])))
-      /(psi_prime_d[i][j]*J_22[i][j]+sum);
+      (  - OF_ACC(t[5])*t[4]
+       - (OF_ACC(t[5])*t[2] * w[0]
+          - xm  * (OF_ACC(wm[1]) + wm[3])
+          - ym  * (OF_ACC(w[1-HS_FLOW_RECORD]) + w[3-HS_FLOW_RECORD])
+          - yp  * (OF_ACC(w[1+HS_FLOW_RECORD]) + w[3+HS_FLOW_RECORD])
+          - xp  * (OF_ACC(wp[1]) + wp[3])
+          + OF_ACC(sum) * (               w[3])))
+      /(OF_ACC(t[5])*t[1]+sum);
     }
-  
+    
+    /* last row */
+    if (ny>1)
+      horn_schunck_warp_sor_interleaved_edge(T, W, psi_prime_s, nx, ny, bx,
+                                             by, hx_2, hy_2, omega, i,
+                                             ny+by-1);
+  }
 }
 
-
-
 /* ------------------------------------------------------------------------- */
-void compute_motion_tensor
+
+void hs_pack_tensor
 (
-                        /*****************************************************/
-float **f1,             /* in     : 1st image                                */
-float **f2,             /* in     : 2nd image                                */
-int   nx,               /* in     : size in x-direction                      */
-int   ny,               /* in     : size in y-direction                      */
-int   bx,               /* in     : boundary size in x-direction             */
-int   by,               /* in     : boundary size in y-direction             */
-float hx,               /* in     : grid spacing in x-direction              */
-float hy,               /* in     : grid spacing in y-direction              */
-float lambda,
-float **J_11,           /* out    : entry 11 of the motion tensor            */
-float **J_22,           /* out    : entry 22 of the motion tensor            */
-float **J_33,           /* out    : entry 33 of the motion tensor            */
-float **J_12,           /* out    : entry 12 of the motion tensor            */
-float **J_13,           /* out    : entry 13 of the motion tensor            */
-float **J_23            /* out    : entry 23 of the motion tensor            */
-                        /*****************************************************/
+ /*****************************************************/
+ float **J[5],           /* in     : J_11, J_22, J_12, J_13, J_23             */
+ unsigned short **Jp[5], /* out    : the planes in 16 bit storage             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   storage           /* in     : HS_STORAGE_FLOAT16 or _BFLOAT16          */
+/*****************************************************/
 )
 
 /*
- Computes the motion tensor entries from a given image pair
+ Converts the inner pixels of the tensor entries read by the SOR sweeps to
+ 16 bit storage. The brightness tensor has rank one, J_12^2 = J_11 J_22,
+ and independent rounding makes half of its 2x2 blocks indefinite, which
+ lets SOR diverge; |J_12| is therefore limited to sqrt(J_11 J_22) rounded
+ towards zero, with one more unit in the last place off where the float
+ test still fails.
 */
 
 {
-                        /*****************************************************/
-int     i,j;            /* loop variables                                    */
-float   **fx;           /* first order image derivatives                     */
-float   **fy;           /* first order image derivatives                     */
-float   **ft;           /* first order image derivatives                     */
-float   **fxx;          /* second order image derivatives                    */
-float   **fxy;          /* second order image derivatives                    */
-float   **fyy;          /* second order image derivatives                    */
-float   **fxt;          /* second order image derivatives                    */
-float   **fyt;          /* second order image derivatives                    */
-float   hx_1,hy_1;      /* time saver variables                              */
-                        /*****************************************************/
-
-float theta_x, theta_y, theta;// normalization factors for gradient-constant assumptions
-
-/* allocate memory */
-
-malloc_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,&fyy,&fxt,&fyt);
-
-/* define time saver variables */
-hx_1=1.0/(2.0*hx);
-hy_1=1.0/(2.0*hy);
-
-/* mirror boundaries */
-mirror_bounds_2d(f1,nx,ny,bx,by);
-mirror_bounds_2d(f2,nx,ny,bx,by);
-
-/* compute first oder derivatives */        
-for(i=bx;i<nx+bx;i++)
+  int   i,j,k;
+  float a11,a22,a12;      /* rounded entries                                   */
+  float bound;            /* sqrt(a11 a22), the largest admissible |a12|       */
+  unsigned short m, mb;   /* magnitude codes of a12 and of the bound           */
+  
+  for(k=0;k<5;k++)
+    for(i=bx;i<nx+bx;i++)
+      if (storage == HS_STORAGE_BFLOAT16)
+        float_to_bfloat16_array(J[k][i]+by, Jp[k][i]+by, ny);
+      else
+        float_to_half_array(J[k][i]+by, Jp[k][i]+by, ny);
+  
+  for(i=bx;i<nx+bx;i++)
     for(j=by;j<ny+by;j++)
     {
-	fx[i][j] = 0.5*(f1[i+1][j]-f1[i-1][j]+f2[i+1][j]-f2[i-1][j])*hx_1;
-	fy[i][j] = 0.5*(f1[i][j+1]-f1[i][j-1]+f2[i][j+1]-f2[i][j-1])*hy_1;
-	ft[i][j] = (f2[i][j]-f1[i][j]);	
+      if (storage == HS_STORAGE_BFLOAT16)
+      {
+        a11 = bfloat16_to_float(Jp[0][i][j]);
+        a22 = bfloat16_to_float(Jp[1][i][j]);
+        a12 = bfloat16_to_float(Jp[2][i][j]);
+      }
+      else
+      {
+        a11 = half_to_float(Jp[0][i][j]);
+        a22 = half_to_float(Jp[1][i][j]);
+        a12 = half_to_float(Jp[2][i][j]);
+      }
+      if (a12*a12 <= a11*a22)
+        continue;
+      
+      /* code of the bound, rounded towards zero; the magnitude bits are */
+      /* a monotone code                                                 */
+      bound = (a11*a22 > 0.0f) ? (float)sqrt((double)a11*a22) : 0.0f;
+      if (storage == HS_STORAGE_BFLOAT16)
+      {
+        mb = float_to_bfloat16(bound) & 0x7fff;
+        if ((mb > 0) && (bfloat16_to_float(mb) > bound))
+          mb--;
+      }
+      else
+      {
+        mb = float_to_half(bound) & 0x7fff;
+        if ((mb > 0) && (half_to_float(mb) > bound))
+          mb--;
+      }
+      m = Jp[2][i][j] & 0x7fff;
+      if (mb < m)
+        m = mb;
+      
+      /* the float root may lie just above the true one */
+      a12 = (storage == HS_STORAGE_BFLOAT16) ? bfloat16_to_float(m)
+                                             : half_to_float(m);
+      if ((a12*a12 > a11*a22) && (m > 0))
+        m--;
+      Jp[2][i][j] = (unsigned short)((Jp[2][i][j] & 0x8000) | m);
     }
+}
 
-/* mirror boundaries */
-mirror_bounds_2d(fx,nx,ny,bx,by);
-mirror_bounds_2d(fy,nx,ny,bx,by);
-mirror_bounds_2d(ft,nx,ny,bx,by);
+/* ------------------------------------------------------------------------- */
 
-/* compute second order derivatives */
-for(i=bx;i<nx+bx;i++)
-    for(j=by;j<ny+by;j++)
-    {
-	fxx[i][j]=(fx[i+1][j  ]-fx[i-1][j  ])*hx_1;
-	fxy[i][j]=(fy[i+1][j  ]-fy[i-1][j  ])*hx_1;
-	fyy[i][j]=(fy[i  ][j+1]-fy[i  ][j-1])*hy_1;
-	fxt[i][j]=(ft[i+1][j  ]-ft[i-1][j  ])*hx_1;
-	fyt[i][j]=(ft[i  ][j+1]-ft[i  ][j-1])*hy_1;
-    }
+void hs_unpack_column
+(
+ /*****************************************************/
+ unsigned short **Jp,    /* in     : plane in 16 bit storage                  */
+ float *col,             /* out    : its column i as float                    */
+ int   i,                /* in     : column                                   */
+ int   ny,               /* in     : size in y-direction                      */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   storage           /* in     : HS_STORAGE_FLOAT16 or _BFLOAT16          */
+/*****************************************************/
+)
+{
+  if (storage == HS_STORAGE_BFLOAT16)
+    bfloat16_to_float_array(Jp[i]+by, col+by, ny);
+  else
+    half_to_float_array(Jp[i]+by, col+by, ny);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_packed
+(
+ /*****************************************************/
+ unsigned short **Jp[5], /* in     : J_11, J_22, J_12, J_13, J_23 in 16 bit   */
+ float **Jv[5],          /* in     : views whose rows all point to col        */
+ float *col[5],          /* tmp    : one float column per tensor entry        */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **psi_prime_d,    /* in     : nonlinearity data term                   */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float alpha,            /* in     : smoothness weight                        */
+ float omega,            /* in     : SOR overrelaxation parameter             */
+ int   storage           /* in     : HS_STORAGE_FLOAT16 or _BFLOAT16          */
+/*****************************************************/
+)
+
+/*
+ horn_schunck_warp_sor on a packed tensor: before column i is swept, its
+ tensor entries are unpacked to float columns. The SOR kernels only read
+ the tensor in the column they update, so views whose rows all point to
+ these columns stand in for the planes.
+*/
+
+{
+  int   i,k;              /* loop variables                                    */
+  float hx_2,hy_2;        /* time saver variables                              */
+  
+  hx_2=alpha/(hx*hx);
+  hy_2=alpha/(hy*hy);
+  
+  for(i=bx;i<nx+bx;i++)
+  {
+    for(k=0;k<5;k++)
+      hs_unpack_column(Jp[k], col[k], i, ny, by, storage);
+    horn_schunck_warp_sor_column(Jv[0], Jv[1], Jv[2], Jv[3], Jv[4], du, dv,
+                                 u, v, psi_prime_d, psi_prime_s, nx, ny, bx,
+                                 by, hx_2, hy_2, omega, i);
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_assemble
+(
+ /*****************************************************/
+ float **J_11,           /* in     : entry 11 of the motion tensor            */
+ float **J_22,           /* in     : entry 22 of the motion tensor            */
+ float **J_12,           /* in     : entry 12 of the motion tensor            */
+ float **J_13,           /* in     : entry 13 of the motion tensor            */
+ float **J_23,           /* in     : entry 23 of the motion tensor            */
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **psi_prime_d,    /* in     : nonlinearity data term                   */
+ float **psi_prime_s,    /* in     : nonlinearity smoothness term             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float alpha,            /* in     : smoothness weight                        */
+ float **wx,             /* out    : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* out    : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* out    : inverse diagonal of the du equation      */
+ float **ia22,           /* out    : inverse diagonal of the dv equation      */
+ float **a12,            /* out    : coupling between du and dv               */
+ float **bu,             /* out    : right hand side of the du equation       */
+ float **bv,             /* out    : right hand side of the dv equation       */
+ bounds_tracker *bt      /* in+out : halo validity of u and v                 */
+/*****************************************************/
+)
+
+/*
+ Assembles the linear system solved by horn_schunck_warp_sor_precomputed.
+ The weights only change with the nonlinearities, so this is done once per
+ outer iteration. wx and wy are zero across the image boundary (the
+ boundaries of wx and wy must be zero on entry), so the sweeps need no
+ boundary predicates; u and v are constant within a level and go into the
+ right hand sides.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float hx_2,hy_2;        /* time saver variables                              */
+  of_real xm,ym;          /* neighbourhood weights                             */
+  of_real sum;            /* central weight                                    */
+  /*****************************************************/
+  
+  /* define time saver variables */
+  hx_2=alpha/(hx*hx);
+  hy_2=alpha/(hy*hy);
+  
+  mirror_bounds_2d_tracked(bt,u,nx,ny,bx,by);
+  mirror_bounds_2d_tracked(bt,v,nx,ny,bx,by);
+  
+  /* edge weights, zero across the last row and column */
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      wx[i][j] = (i<nx+bx-1) * hx_2 * (OF_ACC(psi_prime_s[i+1][j])+psi_prime_s[i][j])/OF_C(2.0);
+      wy[i][j] = (j<ny+by-1) * hy_2 * (OF_ACC(psi_prime_s[i][j+1])+psi_prime_s[i][j])/OF_C(2.0);
+    }
+  
+  /* diagonals and right hand sides */
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      xm  = wx[i-1][j];
+      ym  = wy[i][j-1];
+      sum = OF_ACC(wx[i][j]) + xm + wy[i][j] + ym;
+      
+      ia11[i][j] = OF_C(1.0)/(OF_ACC(psi_prime_d[i][j])*J_11[i][j]+sum);
+      ia22[i][j] = OF_C(1.0)/(OF_ACC(psi_prime_d[i][j])*J_22[i][j]+sum);
+      a12[i][j]  = OF_ACC(psi_prime_d[i][j])*J_12[i][j];
+      
+      bu[i][j] = - OF_ACC(psi_prime_d[i][j])*J_13[i][j]
+                 + OF_ACC(xm)       * u[i-1][j  ] + OF_ACC(ym)       * u[i  ][j-1]
+                 + OF_ACC(wy[i][j]) * u[i  ][j+1] + OF_ACC(wx[i][j]) * u[i+1][j  ]
+                 - OF_ACC(sum)      * u[i  ][j  ];
+      bv[i][j] = - OF_ACC(psi_prime_d[i][j])*J_23[i][j]
+                 + OF_ACC(xm)       * v[i-1][j  ] + OF_ACC(ym)       * v[i  ][j-1]
+                 + OF_ACC(wy[i][j]) * v[i  ][j+1] + OF_ACC(wx[i][j]) * v[i+1][j  ]
+                 - OF_ACC(sum)      * v[i  ][j  ];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_sor_precomputed
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float omega             /* in     : SOR overrelaxation parameter             */
+/*****************************************************/
+)
+
+/*
+ Computes one SOR iteration on the system assembled by
+ horn_schunck_warp_sor_assemble (same update as horn_schunck_warp_sor, but
+ without divides and with 9 instead of 11 planes per pixel)
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  of_real xp,xm,yp,ym;    /* neighbourhood weights                             */
+  of_real omega_1;        /* time saver variable                               */
+  /*****************************************************/
+  
+  omega_1 = OF_ACC(1.0f) - omega;
+  
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      xp = wx[i  ][j  ];
+      xm = wx[i-1][j  ];
+      yp = wy[i  ][j  ];
+      ym = wy[i  ][j-1];
+      
+      du[i][j] = OF_ACC(omega_1) * du[i][j] + OF_ACC(omega) * ia11[i][j] *
+                 ( OF_ACC(bu[i][j]) - OF_ACC(a12[i][j]) * dv[i][j]
+                 + OF_ACC(xm) * du[i-1][j] + OF_ACC(ym) * du[i][j-1]
+                 + OF_ACC(yp) * du[i][j+1] + OF_ACC(xp) * du[i+1][j]);
+      
+      dv[i][j] = OF_ACC(omega_1) * dv[i][j] + OF_ACC(omega) * ia22[i][j] *
+                 ( OF_ACC(bv[i][j]) - OF_ACC(a12[i][j]) * du[i][j]
+                 + OF_ACC(xm) * dv[i-1][j] + OF_ACC(ym) * dv[i][j-1]
+                 + OF_ACC(yp) * dv[i][j+1] + OF_ACC(xp) * dv[i+1][j]);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_residual
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in     : x-component of flow increment            */
+ float **dv,             /* in     : y-component of flow increment            */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ double *norm            /* out    : euclidean norm of the residual           */
+/*****************************************************/
+)
+
+/*
+ Computes the residual of the system assembled by
+ horn_schunck_warp_sor_assemble for the current increments
+*/
+
+{
+  /*****************************************************/
+  int    i,j;             /* loop variables                                    */
+  float  ru,rv;           /* residual of the du and dv equation                */
+  double sum;             /* sum of squares                                    */
+  /*****************************************************/
+  
+  sum = 0.0;
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      ru = bu[i][j] - a12[i][j] * dv[i][j] - du[i][j] / ia11[i][j]
+         + wx[i-1][j] * du[i-1][j] + wy[i][j-1] * du[i][j-1]
+         + wy[i  ][j] * du[i][j+1] + wx[i  ][j] * du[i+1][j];
+      rv = bv[i][j] - a12[i][j] * du[i][j] - dv[i][j] / ia22[i][j]
+         + wx[i-1][j] * dv[i-1][j] + wy[i][j-1] * dv[i][j-1]
+         + wy[i  ][j] * dv[i][j+1] + wx[i  ][j] * dv[i+1][j];
+      sum += (double)ru * ru + (double)rv * rv;
+    }
+  
+  *norm = sqrt(sum);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define HS_OMEGA_POWER_ITER 30  /* power iterations of the omega estimate */
+
+float horn_schunck_warp_estimate_omega
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   num_iter          /* in     : number of power iterations               */
+/*****************************************************/
+)
+
+/*
+ Estimates the optimal SOR relaxation factor of the system assembled by
+ horn_schunck_warp_sor_assemble. The spectral radius rho of the Jacobi
+ iteration with 2x2 blocks (du,dv) per pixel is approximated by power
+ iterations that start from a constant field (close to the slowest,
+ smoothest error mode); point Jacobi is no option, the du-dv coupling can
+ make it diverge where SOR still converges. omega = 2 / (1 + sqrt(1-rho^2))
+ is Young's optimum for consistently ordered systems, limited to
+ [1, HS_OMEGA_MAX].
+ Returns 0 if the work planes could not be allocated.
+*/
+
+{
+  /*****************************************************/
+  int    i,j,k;           /* loop variables                                    */
+  float  **eu,**ev;       /* current power iterate                             */
+  float  **nu,**nv;       /* next power iterate                                */
+  float  **swap;          /* pointer exchange                                  */
+  double norm_old;        /* norm of the current iterate                       */
+  double norm_new;        /* norm of the next iterate                          */
+  double rho;             /* estimated Jacobi spectral radius                  */
+  double omega;           /* estimated relaxation factor                       */
+  float  su,sv;           /* neighbour sums                                    */
+  float  d11,d22,det;     /* 2x2 diagonal block and its determinant            */
+  /*****************************************************/
+  
+  if (!calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&eu,&ev,&nu,&nv))
+      return 0.0f;
+  
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+      eu[i][j] = ev[i][j] = 1.0f;
+  norm_old = sqrt(2.0 * nx * ny);
+  
+  rho = 0.0;
+  for(k=0;k<num_iter;k++)
+  {
+    norm_new = 0.0;
+    for(i=bx;i<nx+bx;i++)
+      for(j=by;j<ny+by;j++)
+      {
+        su  = wx[i-1][j] * eu[i-1][j] + wy[i][j-1] * eu[i][j-1]
+            + wy[i  ][j] * eu[i][j+1] + wx[i  ][j] * eu[i+1][j];
+        sv  = wx[i-1][j] * ev[i-1][j] + wy[i][j-1] * ev[i][j-1]
+            + wy[i  ][j] * ev[i][j+1] + wx[i  ][j] * ev[i+1][j];
+        d11 = 1.0f / ia11[i][j];
+        d22 = 1.0f / ia22[i][j];
+        det = d11 * d22 - a12[i][j] * a12[i][j];
+        nu[i][j] = (d22 * su - a12[i][j] * sv) / det;
+        nv[i][j] = (d11 * sv - a12[i][j] * su) / det;
+        norm_new += (double)nu[i][j] * nu[i][j]
+                  + (double)nv[i][j] * nv[i][j];
+      }
+    norm_new = sqrt(norm_new);
+    if (norm_old == 0.0)
+        break;
+    rho = norm_new / norm_old;
+    norm_old = norm_new;
+    swap = eu; eu = nu; nu = swap;
+    swap = ev; ev = nv; nv = swap;
+  }
+  
+  free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&eu,&ev,&nu,&nv);
+  
+  if (rho >= 1.0)
+      return HS_OMEGA_MAX;
+  omega = 2.0 / (1.0 + sqrt(1.0 - rho * rho));
+  if (omega > HS_OMEGA_MAX)
+      omega = HS_OMEGA_MAX;
+  if (omega < 1.0)
+      omega = 1.0;
+  return (float)omega;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define HS_LINE_BLOCK 64  /* lines per batch of the x-line solver */
+
+void horn_schunck_warp_line_x
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **g11,            /* tmp    : eliminated upper diagonal block, 11      */
+ float **g12,            /* tmp    : eliminated upper diagonal block, 12      */
+ float **g22,            /* tmp    : eliminated upper diagonal block, 22      */
+ float **d1,             /* tmp    : eliminated right hand side, du           */
+ float **d2,             /* tmp    : eliminated right hand side, dv           */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   parity,           /* in     : solve the lines j = by+parity, +2, ...   */
+ float omega             /* in     : overrelaxation of the line solutions     */
+/*****************************************************/
+)
+
+/*
+ Solves the du-dv system exactly along every second line in x-direction,
+ with the lines in between fixed. Each line is block tridiagonal with the
+ 2x2 blocks (du,dv) of a pixel on the diagonal. The Thomas recurrences run
+ along i for a batch of HS_LINE_BLOCK lines at once, so the innermost
+ loop runs over the contiguous index j. The elimination of a batch is stored
+ in consecutive columns of the work planes, so only the loads of the
+ system are strided. The weights are zero across the image boundary, so
+ the first and last row need no special case.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  int   k,kb,n;           /* work plane column, first column, lines in batch   */
+  int   jb;               /* first line of a batch                             */
+  float w,wp;             /* weights to the previous and next pixel            */
+  float m11,m12,m22;      /* eliminated diagonal block                         */
+  float idet;             /* inverse determinant of the diagonal block         */
+  float cu,cv;            /* eliminated right hand side                        */
+  /*****************************************************/
+  
+#ifdef _OPENMP
+#pragma omp parallel for private(i,j,k,kb,n,w,wp,m11,m12,m22,idet,cu,cv) \
+                         schedule(static)
+#endif
+  for(jb=by+parity;jb<ny+by;jb+=2*HS_LINE_BLOCK)
+  {
+    /* lines jb, jb+2, ..., jb+2(n-1) use the work plane columns kb..kb+n-1 */
+    n  = minimum(HS_LINE_BLOCK,(ny+by-jb+1)/2);
+    kb = by + (jb-by-parity)/2;
+    
+    /* forward elimination */
+    for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
+      for(k=0;k<n;k++)
+      {
+        j   = jb + 2*k;
+        w   = wx[i-1][j];
+        wp  = wx[i  ][j];
+        m11 = 1.0f / ia11[i][j] - w * g11[i-1][kb+k];
+        m12 = a12[i][j]         - w * g12[i-1][kb+k];
+        m22 = 1.0f / ia22[i][j] - w * g22[i-1][kb+k];
+        idet = 1.0f / (m11 * m22 - m12 * m12);
+        cu  = bu[i][j] + wy[i][j-1] * du[i][j-1] + wy[i][j] * du[i][j+1]
+            + w * d1[i-1][kb+k];
+        cv  = bv[i][j] + wy[i][j-1] * dv[i][j-1] + wy[i][j] * dv[i][j+1]
+            + w * d2[i-1][kb+k];
+        d1 [i][kb+k] = (m22 * cu - m12 * cv) * idet;
+        d2 [i][kb+k] = (m11 * cv - m12 * cu) * idet;
+        g11[i][kb+k] =  wp * m22 * idet;
+        g12[i][kb+k] = -wp * m12 * idet;
+        g22[i][kb+k] =  wp * m11 * idet;
+      }
+    
+    /* back substitution into d1, d2; g is zero in the last row */
+    for(i=nx+bx-2;i>=bx;i--)
+#pragma GCC ivdep
+      for(k=kb;k<kb+n;k++)
+      {
+        d1[i][k] += g11[i][k] * d1[i+1][k] + g12[i][k] * d2[i+1][k];
+        d2[i][k] += g12[i][k] * d1[i+1][k] + g22[i][k] * d2[i+1][k];
+      }
+    
+    for(i=bx;i<nx+bx;i++)
+      for(k=0;k<n;k++)
+      {
+        du[i][jb+2*k] += omega * (d1[i][kb+k] - du[i][jb+2*k]);
+        dv[i][jb+2*k] += omega * (d2[i][kb+k] - dv[i][jb+2*k]);
+      }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_line_y
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **g11,            /* tmp    : eliminated upper diagonal block, 11      */
+ float **g12,            /* tmp    : eliminated upper diagonal block, 12      */
+ float **g22,            /* tmp    : eliminated upper diagonal block, 22      */
+ float **d1,             /* tmp    : eliminated right hand side, du           */
+ float **d2,             /* tmp    : eliminated right hand side, dv           */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   parity,           /* in     : solve the lines i = bx+parity, +2, ...   */
+ float omega             /* in     : overrelaxation of the line solutions     */
+/*****************************************************/
+)
+
+/*
+ Same as horn_schunck_warp_line_x for every second line in y-direction.
+ The lines are contiguous in memory; each one is a separate Thomas
+ recurrence along j.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float w,wp;             /* weights to the previous and next pixel            */
+  float m11,m12,m22;      /* eliminated diagonal block                         */
+  float idet;             /* inverse determinant of the diagonal block         */
+  float cu,cv;            /* eliminated right hand side                        */
+  /*****************************************************/
+  
+#ifdef _OPENMP
+#pragma omp parallel for private(j,w,wp,m11,m12,m22,idet,cu,cv) \
+                         schedule(static)
+#endif
+  for(i=bx+parity;i<nx+bx;i+=2)
+  {
+    /* forward elimination */
+    for(j=by;j<ny+by;j++)
+    {
+      w   = wy[i][j-1];
+      wp  = wy[i][j  ];
+      m11 = 1.0f / ia11[i][j] - w * g11[i][j-1];
+      m12 = a12[i][j]         - w * g12[i][j-1];
+      m22 = 1.0f / ia22[i][j] - w * g22[i][j-1];
+      idet = 1.0f / (m11 * m22 - m12 * m12);
+      cu  = bu[i][j] + wx[i-1][j] * du[i-1][j] + wx[i][j] * du[i+1][j]
+          + w * d1[i][j-1];
+      cv  = bv[i][j] + wx[i-1][j] * dv[i-1][j] + wx[i][j] * dv[i+1][j]
+          + w * d2[i][j-1];
+      d1 [i][j] = (m22 * cu - m12 * cv) * idet;
+      d2 [i][j] = (m11 * cv - m12 * cu) * idet;
+      g11[i][j] =  wp * m22 * idet;
+      g12[i][j] = -wp * m12 * idet;
+      g22[i][j] =  wp * m11 * idet;
+    }
+    
+    /* back substitution into d1, d2; g is zero in the last column */
+    for(j=ny+by-2;j>=by;j--)
+    {
+      d1[i][j] += g11[i][j] * d1[i][j+1] + g12[i][j] * d2[i][j+1];
+      d2[i][j] += g12[i][j] * d1[i][j+1] + g22[i][j] * d2[i][j+1];
+    }
+    
+    for(j=by;j<ny+by;j++)
+    {
+      du[i][j] += omega * (d1[i][j] - du[i][j]);
+      dv[i][j] += omega * (d2[i][j] - dv[i][j]);
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_warp_line_gs
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **g11,            /* tmp    : eliminated upper diagonal block, 11      */
+ float **g12,            /* tmp    : eliminated upper diagonal block, 12      */
+ float **g22,            /* tmp    : eliminated upper diagonal block, 22      */
+ float **d1,             /* tmp    : eliminated right hand side, du           */
+ float **d2,             /* tmp    : eliminated right hand side, dv           */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float omega             /* in     : overrelaxation, 1 for Gauss-Seidel       */
+/*****************************************************/
+)
+
+/*
+ Computes one alternating line Gauss-Seidel iteration on the system
+ assembled by horn_schunck_warp_sor_assemble: zebra line relaxation in
+ x-direction, then in y-direction. Unlike pointwise SOR this couples all
+ pixels of a line at once, which pays off where psi_prime_s makes the
+ smoothness term strongly anisotropic. The lines of one colour are
+ independent, so they can be solved in parallel. The work planes must
+ have zero boundaries.
+*/
+
+{
+  /*****************************************************/
+  int   p;                /* line colour                                       */
+  /*****************************************************/
+  
+  for(p=0;p<2;p++)
+    horn_schunck_warp_line_x(wx,wy,ia11,ia22,a12,bu,bv,du,dv,
+                             g11,g12,g22,d1,d2,nx,ny,bx,by,p,omega);
+  for(p=0;p<2;p++)
+    horn_schunck_warp_line_y(wx,wy,ia11,ia22,a12,bu,bv,du,dv,
+                             g11,g12,g22,d1,d2,nx,ny,bx,by,p,omega);
+}
+
+/* ------------------------------------------------------------------------- */
+
+double sum_columns
+(
+ /*****************************************************/
+ double *part,           /* in     : partial sums, one per column             */
+ int   nx,               /* in     : size in x-direction                      */
+ int   bx                /* in     : boundary size in x-direction             */
+/*****************************************************/
+)
+
+/*
+ Adds up the column sums of a dot product in a fixed order, so the result
+ does not depend on the number of threads that computed them
+*/
+
+{
+  int    i;               /* loop variable                                     */
+  double sum;             /* sum of the columns                                */
+  
+  sum = 0.0;
+  for(i=bx;i<nx+bx;i++)
+    sum += part[i];
+  return sum;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define HS_PCG_MIN_DET 1e-3f  /* smallest relative determinant of a block */
+
+void horn_schunck_warp_pcg
+(
+ /*****************************************************/
+ float **wx,             /* in     : weight between (i,j) and (i+1,j)         */
+ float **wy,             /* in     : weight between (i,j) and (i,j+1)         */
+ float **ia11,           /* in     : inverse diagonal of the du equation      */
+ float **ia22,           /* in     : inverse diagonal of the dv equation      */
+ float **a12,            /* in     : coupling between du and dv               */
+ float **bu,             /* in     : right hand side of the du equation       */
+ float **bv,             /* in     : right hand side of the dv equation       */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **ru,             /* tmp    : residual, du                             */
+ float **rv,             /* tmp    : residual, dv                             */
+ float **pu,             /* tmp    : search direction, du                     */
+ float **pv,             /* tmp    : search direction, dv                     */
+ float **qu,             /* tmp    : A p, then preconditioned residual, du    */
+ float **qv,             /* tmp    : A p, then preconditioned residual, dv    */
+ float **d11,            /* tmp    : diagonal of the du equation              */
+ float **d22,            /* tmp    : diagonal of the dv equation              */
+ float **m11,            /* tmp    : preconditioner, entry 11                 */
+ float **m12,            /* tmp    : preconditioner, entry 12                 */
+ float **m22,            /* tmp    : preconditioner, entry 22                 */
+ double *part,           /* tmp    : column sums, size nx+2*bx                */
+ double *part_r,         /* tmp    : column sums of r'r, size nx+2*bx         */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ int   precond,          /* in     : 1: point Jacobi, 2: 2x2 block Jacobi     */
+ int   max_iter,         /* in     : maximum number of iterations             */
+ float tolerance,        /* in     : > 0: stop once the residual has dropped  */
+                         /*          by this factor                           */
+ int   *num_iter         /* out    : iterations done                          */
+/*****************************************************/
+)
+
+/*
+ Solves the system assembled by horn_schunck_warp_sor_assemble with the
+ preconditioned conjugate gradient method, starting from the current
+ increments. The system is symmetric and positive definite: the smoothness
+ term is a weighted graph Laplacian, the data term adds the positive
+ semidefinite 2x2 blocks psi_prime_d * J per pixel. The 2x2 block
+ preconditioner inverts these blocks together with the diagonal of the
+ smoothness term, point Jacobi ignores the coupling a12. Where the block
+ is too close to singular for float (J of rank one, weak smoothness) its
+ determinant cancels, these pixels fall back to point Jacobi. The
+ matrix is applied without storing it; the work planes must have zero
+ boundaries (the weights across the image boundary are zero, but the
+ halo values still enter the products). One iteration costs about three
+ SOR sweeps.
+*/
+
+{
+  /*****************************************************/
+  int    i,j,k;           /* loop variables                                    */
+  float  su,sv;           /* neighbour sums                                    */
+  float  det;             /* determinant of the 2x2 block                      */
+  float  alpha,beta;      /* step size, conjugation factor                     */
+  double rz,rz_new;       /* residual times preconditioned residual            */
+  double pq;              /* search direction times A p                        */
+  double rr,rr_0;         /* squared residual norm, initial one                */
+  /*****************************************************/
+  
+  *num_iter = 0;
+  
+  /* diagonals, initial residual r = b - A x and p = M^-1 r */
+#ifdef _OPENMP
+#pragma omp parallel for private(j,su,sv,det) schedule(static)
+#endif
+  for(i=bx;i<nx+bx;i++)
+  {
+#pragma GCC ivdep
+    for(j=by;j<ny+by;j++)
+    {
+      d11[i][j] = 1.0f / ia11[i][j];
+      d22[i][j] = 1.0f / ia22[i][j];
+      det = d11[i][j] * d22[i][j] - a12[i][j] * a12[i][j];
+      if ((precond == 2) && (det > HS_PCG_MIN_DET * d11[i][j] * d22[i][j]))
+      {
+        m11[i][j] =  d22[i][j] / det;
+        m12[i][j] = -a12[i][j] / det;
+        m22[i][j] =  d11[i][j] / det;
+      }
+      else
+      {
+        m11[i][j] = ia11[i][j];
+        m12[i][j] = 0.0f;
+        m22[i][j] = ia22[i][j];
+      }
+      
+      su = wx[i-1][j] * du[i-1][j] + wy[i][j-1] * du[i][j-1]
+         + wy[i  ][j] * du[i][j+1] + wx[i  ][j] * du[i+1][j];
+      sv = wx[i-1][j] * dv[i-1][j] + wy[i][j-1] * dv[i][j-1]
+         + wy[i  ][j] * dv[i][j+1] + wx[i  ][j] * dv[i+1][j];
+      ru[i][j] = bu[i][j] + su - d11[i][j] * du[i][j] - a12[i][j] * dv[i][j];
+      rv[i][j] = bv[i][j] + sv - d22[i][j] * dv[i][j] - a12[i][j] * du[i][j];
+    }
+  }
+  
+  /* pass k=0 only preconditions the initial residual */
+  rz = rr_0 = 0.0;
+  for(k=0;k<=max_iter;k++)
+  {
+    if (k > 0)
+    {
+      /* q = A p, p'q */
+#ifdef _OPENMP
+#pragma omp parallel for private(j,su,sv) schedule(static)
+#endif
+      for(i=bx;i<nx+bx;i++)
+      {
+#pragma GCC ivdep
+        for(j=by;j<ny+by;j++)
+        {
+          su = wx[i-1][j] * pu[i-1][j] + wy[i][j-1] * pu[i][j-1]
+             + wy[i  ][j] * pu[i][j+1] + wx[i  ][j] * pu[i+1][j];
+          sv = wx[i-1][j] * pv[i-1][j] + wy[i][j-1] * pv[i][j-1]
+             + wy[i  ][j] * pv[i][j+1] + wx[i  ][j] * pv[i+1][j];
+          qu[i][j] = d11[i][j] * pu[i][j] + a12[i][j] * pv[i][j] - su;
+          qv[i][j] = d22[i][j] * pv[i][j] + a12[i][j] * pu[i][j] - sv;
+        }
+        part[i] = 0.0;
+        for(j=by;j<ny+by;j++)
+          part[i] += (double)pu[i][j] * qu[i][j]
+                   + (double)pv[i][j] * qv[i][j];
+      }
+      pq = sum_columns(part,nx,bx);
+      if (pq <= 0.0)
+          break;
+      alpha = (float)(rz / pq);
+      
+      /* x += alpha p, r -= alpha q */
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(static)
+#endif
+      for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
+        for(j=by;j<ny+by;j++)
+        {
+          du[i][j] += alpha * pu[i][j];
+          dv[i][j] += alpha * pv[i][j];
+          ru[i][j] -= alpha * qu[i][j];
+          rv[i][j] -= alpha * qv[i][j];
+        }
+      (*num_iter)++;
+    }
+    
+    /* q = M^-1 r, r'q and r'r */
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(static)
+#endif
+    for(i=bx;i<nx+bx;i++)
+    {
+#pragma GCC ivdep
+      for(j=by;j<ny+by;j++)
+      {
+        qu[i][j] = m11[i][j] * ru[i][j] + m12[i][j] * rv[i][j];
+        qv[i][j] = m12[i][j] * ru[i][j] + m22[i][j] * rv[i][j];
+      }
+      part[i] = part_r[i] = 0.0;
+      for(j=by;j<ny+by;j++)
+      {
+        part[i]   += (double)ru[i][j] * qu[i][j]
+                   + (double)rv[i][j] * qv[i][j];
+        part_r[i] += (double)ru[i][j] * ru[i][j]
+                   + (double)rv[i][j] * rv[i][j];
+      }
+    }
+    rz_new = sum_columns(part,nx,bx);
+    rr     = sum_columns(part_r,nx,bx);
+    
+    if (k == 0)
+        rr_0 = rr;
+    if ((rr == 0.0) || (k == max_iter) ||
+        ((tolerance > 0.0f) && (rr <= (double)tolerance * tolerance * rr_0)))
+        break;
+    
+    /* p = M^-1 r + beta p */
+    beta = (k == 0) ? 0.0f : (float)(rz_new / rz);
+    rz   = rz_new;
+#ifdef _OPENMP
+#pragma omp parallel for private(j) schedule(static)
+#endif
+    for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
+      for(j=by;j<ny+by;j++)
+      {
+        pu[i][j] = qu[i][j] + beta * pu[i][j];
+        pv[i][j] = qv[i][j] + beta * pv[i][j];
+      }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+
+
+void compute_first_derivatives_column
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   i,                /* in     : column                                   */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx_1,             /* in     : 1/(2 hx)                                 */
+float hy_1,             /* in     : 1/(2 hy)                                 */
+float *fx,              /* out    : column i of the x-derivative             */
+float *fy,              /* out    : column i of the y-derivative             */
+float *ft               /* out    : column i of the temporal derivative      */
+                        /*****************************************************/
+)
+
+/* computes column i of compute_first_derivatives */
+
+{
+                        /*****************************************************/
+int     j;              /* loop variable                                     */
+int     im,ip;          /* left and right neighbour column (clamped)         */
+int     jl;             /* last row                                          */
+                        /*****************************************************/
+
+jl=ny+by-1;
+im = (i>bx)      ? i-1 : i;
+ip = (i<nx+bx-1) ? i+1 : i;
+
+/* first and last row */
+fy[by] = OF_C(0.5)*(OF_ACC(f1[i][minimum(by+1,jl)])-f1[i][by]
+             +f2[i][minimum(by+1,jl)]-f2[i][by])*hy_1;
+fy[jl] = OF_C(0.5)*(OF_ACC(f1[i][jl])-f1[i][maximum(jl-1,by)]
+             +f2[i][jl]-f2[i][maximum(jl-1,by)])*hy_1;
+
+/* interior rows */
+for(j=by+1;j<jl;j++)
+    fy[j] = OF_C(0.5)*(OF_ACC(f1[i][j+1])-f1[i][j-1]+f2[i][j+1]-f2[i][j-1])*hy_1;
+
+for(j=by;j<ny+by;j++)
+{
+    fx[j] = OF_C(0.5)*(OF_ACC(f1[ip][j])-f1[im][j]+f2[ip][j]-f2[im][j])*hx_1;
+    ft[j] = (f2[i][j]-f1[i][j]);
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_first_derivatives
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float **fx,             /* out    : averaged x-derivative of the pair        */
+float **fy,             /* out    : averaged y-derivative of the pair        */
+float **ft              /* out    : temporal derivative                      */
+                        /*****************************************************/
+)
+
+/*
+ Computes the first order derivatives shared by all data terms. Mirrored
+ boundaries of width one equal the nearest pixel inside, so the neighbours
+ are clamped to the image instead: per column for x, and by peeling the
+ first and last row for y. The images' halos are not read.
+*/
+
+{
+                        /*****************************************************/
+int     i;              /* loop variable                                     */
+float   hx_1,hy_1;      /* time saver variables                              */
+                        /*****************************************************/
+
+/* define time saver variables */
+hx_1=1.0/(2.0*hx);
+hy_1=1.0/(2.0*hy);
+
+/* compute first oder derivatives */        
+for(i=bx;i<nx+bx;i++)
+    compute_first_derivatives_column(f1,f2,i,nx,ny,bx,by,hx_1,hy_1,
+                                     fx[i],fy[i],ft[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_second_derivatives_column
+(
+                        /*****************************************************/
+float *fx_m,            /* in     : x-derivative, left neighbour column      */
+float *fx_p,            /* in     : x-derivative, right neighbour column     */
+float *fy_m,            /* in     : y-derivative, left neighbour column      */
+float *fy_c,            /* in     : y-derivative, this column                */
+float *fy_p,            /* in     : y-derivative, right neighbour column     */
+float *ft_m,            /* in     : t-derivative, left neighbour column      */
+float *ft_c,            /* in     : t-derivative, this column                */
+float *ft_p,            /* in     : t-derivative, right neighbour column     */
+int   ny,               /* in     : size in y-direction                      */
+int   by,               /* in     : boundary size in y-direction             */
+float hx_1,             /* in     : 1/(2 hx)                                 */
+float hy_1,             /* in     : 1/(2 hy)                                 */
+float *fxx,             /* out    : second order image derivatives           */
+float *fxy,             /* out    : second order image derivatives           */
+float *fyy,             /* out    : second order image derivatives           */
+float *fxt,             /* out    : second order image derivatives           */
+float *fyt              /* out    : second order image derivatives           */
+                        /*****************************************************/
+)
+
+/* computes one column of compute_second_derivatives from the clamped */
+/* neighbour columns of the first order derivatives                   */
+
+{
+                        /*****************************************************/
+int     j;              /* loop variable                                     */
+int     jl;             /* last row                                          */
+                        /*****************************************************/
+
+jl=ny+by-1;
+
+/* first and last row */
+fyy[by]=(fy_c[minimum(by+1,jl)]-fy_c[by])*hy_1;
+fyt[by]=(ft_c[minimum(by+1,jl)]-ft_c[by])*hy_1;
+fyy[jl]=(fy_c[jl]-fy_c[maximum(jl-1,by)])*hy_1;
+fyt[jl]=(ft_c[jl]-ft_c[maximum(jl-1,by)])*hy_1;
+
+/* interior rows */
+for(j=by+1;j<jl;j++)
+{
+    fyy[j]=(fy_c[j+1]-fy_c[j-1])*hy_1;
+    fyt[j]=(ft_c[j+1]-ft_c[j-1])*hy_1;
+}
+
+for(j=by;j<ny+by;j++)
+{
+    fxx[j]=(fx_p[j]-fx_m[j])*hx_1;
+    fxy[j]=(fy_p[j]-fy_m[j])*hx_1;
+    fxt[j]=(ft_p[j]-ft_m[j])*hx_1;
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_second_derivatives
+(
+                        /*****************************************************/
+float **fx,             /* in     : x-derivative                             */
+float **fy,             /* in     : y-derivative                             */
+float **ft,             /* in     : t-derivative                             */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float **fxx,            /* out    : second order image derivatives           */
+float **fxy,            /* out    : second order image derivatives           */
+float **fyy,            /* out    : second order image derivatives           */
+float **fxt,            /* out    : second order image derivatives           */
+float **fyt             /* out    : second order image derivatives           */
+                        /*****************************************************/
+)
+
+/*
+ Computes the second order derivatives needed by gradient constancy; the
+ boundaries are handled as in compute_first_derivatives
+*/
+
+{
+                        /*****************************************************/
+int     i;              /* loop variable                                     */
+int     im,ip;          /* left and right neighbour column (clamped)         */
+float   hx_1,hy_1;      /* time saver variables                              */
+                        /*****************************************************/
+
+/* define time saver variables */
+hx_1=1.0/(2.0*hx);
+hy_1=1.0/(2.0*hy);
+
+/* compute second order derivatives */
+for(i=bx;i<nx+bx;i++)
+{
+    im = (i>bx)      ? i-1 : i;
+    ip = (i<nx+bx-1) ? i+1 : i;
+    compute_second_derivatives_column(fx[im],fx[ip],fy[im],fy[i],fy[ip],
+                                      ft[im],ft[i],ft[ip],ny,by,hx_1,hy_1,
+                                      fxx[i],fxy[i],fyy[i],fxt[i],fyt[i]);
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_brightness_column
+(
+                        /*****************************************************/
+float *fx,              /* in     : first order derivatives of one column    */
+float *fy,
+float *ft,
+int   ny,               /* in     : size in y-direction                      */
+int   by,               /* in     : boundary size in y-direction             */
+float *J_11,            /* out    : the column of the motion tensor entries  */
+float *J_22,
+float *J_33,
+float *J_12,
+float *J_13,
+float *J_23
+                        /*****************************************************/
+)
+
+/* one column of compute_motion_tensor_brightness */
+
+{
+                        /*****************************************************/
+int     j;              /* loop variable                                     */
+of_acc  theta;          /* normalisation factor                              */
+                        /*****************************************************/
+
+for(j=by;j<ny+by;j++)
+{  
+    theta = (of_real)(1/(OF_ACC(fx[j])*fx[j]+OF_ACC(fy[j])*fy[j]+OF_C(0.1)));
+
+    J_11[j] = theta*fx[j] * fx[j];
+    J_22[j] = theta*fy[j] * fy[j];
+    J_33[j] = theta*ft[j] * ft[j];
+    J_12[j] = theta*fx[j] * fy[j];
+    J_13[j] = theta*fx[j] * ft[j];
+    J_23[j] = theta*fy[j] * ft[j];
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_gradient_column
+(
+                        /*****************************************************/
+float *fxx,             /* in     : second order derivatives of one column   */
+float *fxy,
+float *fyy,
+float *fxt,
+float *fyt,
+int   ny,               /* in     : size in y-direction                      */
+int   by,               /* in     : boundary size in y-direction             */
+float *J_11,            /* out    : the column of the motion tensor entries  */
+float *J_22,
+float *J_33,
+float *J_12,
+float *J_13,
+float *J_23
+                        /*****************************************************/
+)
+
+/* one column of compute_motion_tensor_gradient */
+
+{
+                        /*****************************************************/
+int     j;              /* loop variable                                     */
+of_real theta_x,theta_y;/* normalisation factors                             */
+                        /*****************************************************/
+
+for(j=by;j<ny+by;j++)
+{  
+    theta_x = 1/(OF_ACC(fxx[j]) * fxx[j] + OF_ACC(fxy[j]) * fxy[j] + OF_C(0.1));
+    theta_y = 1/(OF_ACC(fxy[j]) * fxy[j] + OF_ACC(fyy[j]) * fyy[j] + OF_C(0.1));
+
+    J_11[j] = OF_ACC(theta_x)*fxx[j] * fxx[j] + OF_ACC(theta_y)*fxy[j] * fxy[j];
+    J_22[j] = OF_ACC(theta_x)*fxy[j] * fxy[j] + OF_ACC(theta_y)*fyy[j] * fyy[j];
+    J_33[j] = OF_ACC(theta_x)*fxt[j] * fxt[j] + OF_ACC(theta_y)*fyt[j] * fyt[j];
+    J_12[j] = OF_ACC(theta_x)*fxx[j] * fxy[j] + OF_ACC(theta_y)*fxy[j] * fyy[j];
+    J_13[j] = OF_ACC(theta_x)*fxx[j] * fxt[j] + OF_ACC(theta_y)*fxy[j] * fyt[j];
+    J_23[j] = OF_ACC(theta_x)*fxy[j] * fxt[j] + OF_ACC(theta_y)*fyy[j] * fyt[j];
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_mixed_column
+(
+                        /*****************************************************/
+float *fx,              /* in     : first order derivatives of one column    */
+float *fy,
+float *ft,
+float *fxx,             /* in     : second order derivatives of one column   */
+float *fxy,
+float *fyy,
+float *fxt,
+float *fyt,
+int   ny,               /* in     : size in y-direction                      */
+int   by,               /* in     : boundary size in y-direction             */
+float lambda,           /* in     : weight gradient vs. brightness constancy */
+float *J_11,            /* out    : the column of the motion tensor entries  */
+float *J_22,
+float *J_33,
+float *J_12,
+float *J_13,
+float *J_23
+                        /*****************************************************/
+)
+
+/* one column of compute_motion_tensor_mixed */
+
+{
+                        /*****************************************************/
+int     j;              /* loop variable                                     */
+                        /*****************************************************/
+
+of_real theta_x, theta_y, theta;// normalization factors for gradient-constant assumptions
+
+for(j=by;j<ny+by;j++)
+{  
+    theta_x = 1/(OF_ACC(fxx[j]) * fxx[j] + OF_ACC(fxy[j]) * fxy[j] + OF_C(0.1));
+    theta_y = 1/(OF_ACC(fxy[j]) * fxy[j] + OF_ACC(fyy[j]) * fyy[j] + OF_C(0.1));
+    theta = 1/(OF_ACC(fx[j])*fx[j]+OF_ACC(fy[j])*fy[j]+OF_C(0.1));
+
+    J_11[j] = lambda*(OF_ACC(theta_x)*fxx[j] * fxx[j] + OF_ACC(theta_y)*fxy[j]
+                    * fxy[j]) + (OF_C(1.0)-lambda)*theta*fx[j] * fx[j];
+    J_22[j] = lambda*(OF_ACC(theta_x)*fxy[j] * fxy[j] + OF_ACC(theta_y)*fyy[j]
+                    * fyy[j]) + (OF_C(1.0)-lambda)*theta*fy[j] * fy[j];
+    J_33[j] = lambda*(OF_ACC(theta_x)*fxt[j] * fxt[j] + OF_ACC(theta_y)*fyt[j]
+                    * fyt[j]) + (OF_C(1.0)-lambda)*theta*ft[j] * ft[j];
+    J_12[j] = lambda*(OF_ACC(theta_x)*fxx[j] * fxy[j] + OF_ACC(theta_y)*fxy[j]
+                    * fyy[j]) + (OF_C(1.0)-lambda)*theta*fx[j] * fy[j];
+    J_13[j] = lambda*(OF_ACC(theta_x)*fxx[j] * fxt[j] + OF_ACC(theta_y)*fxy[j]
+                    * fyt[j]) + (OF_C(1.0)-lambda)*theta*fx[j] * ft[j];
+    J_23[j] = lambda*(OF_ACC(theta_x)*fxy[j] * fxt[j] + OF_ACC(theta_y)*fyy[j]
+                    * fyt[j]) + (OF_C(1.0)-lambda)*theta*fy[j] * ft[j];
+}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_brightness
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float **J_11,           /* out    : entry 11 of the motion tensor            */
+float **J_22,           /* out    : entry 22 of the motion tensor            */
+float **J_33,           /* out    : entry 33 of the motion tensor            */
+float **J_12,           /* out    : entry 12 of the motion tensor            */
+float **J_13,           /* out    : entry 13 of the motion tensor            */
+float **J_23            /* out    : entry 23 of the motion tensor            */
+                        /*****************************************************/
+)
+
+/*
+ Motion tensor of normalised brightness constancy (w_bright_grad = 0);
+ only the first order derivatives are computed
+*/
+
+{
+                        /*****************************************************/
+int     i;              /* loop variable                                     */
+float   **fx;           /* first order image derivatives                     */
+float   **fy;           /* first order image derivatives                     */
+float   **ft;           /* first order image derivatives                     */
+                        /*****************************************************/
+
+/* allocate memory */
+malloc_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft);
+
+compute_first_derivatives(f1,f2,nx,ny,bx,by,hx,hy,fx,fy,ft);
+
+/* compute motion tensor entries */   
+for(i=bx;i<nx+bx;i++)
+    compute_motion_tensor_brightness_column(fx[i],fy[i],ft[i],ny,by,
+                                            J_11[i],J_22[i],J_33[i],
+                                            J_12[i],J_13[i],J_23[i]);
+
+/* free memory */
+free_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_gradient
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float **J_11,           /* out    : entry 11 of the motion tensor            */
+float **J_22,           /* out    : entry 22 of the motion tensor            */
+float **J_33,           /* out    : entry 33 of the motion tensor            */
+float **J_12,           /* out    : entry 12 of the motion tensor            */
+float **J_13,           /* out    : entry 13 of the motion tensor            */
+float **J_23            /* out    : entry 23 of the motion tensor            */
+                        /*****************************************************/
+)
+
+/*
+ Motion tensor of normalised gradient constancy (w_bright_grad = 1);
+ the brightness normalisation theta is not needed
+*/
+
+{
+                        /*****************************************************/
+int     i;              /* loop variable                                     */
+float   **fx;           /* first order image derivatives                     */
+float   **fy;           /* first order image derivatives                     */
+float   **ft;           /* first order image derivatives                     */
+float   **fxx;          /* second order image derivatives                    */
+float   **fxy;          /* second order image derivatives                    */
+float   **fyy;          /* second order image derivatives                    */
+float   **fxt;          /* second order image derivatives                    */
+float   **fyt;          /* second order image derivatives                    */
+                        /*****************************************************/
+
+/* allocate memory */
+malloc_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,&fyy,&fxt,&fyt);
+
+compute_first_derivatives(f1,f2,nx,ny,bx,by,hx,hy,fx,fy,ft);
+compute_second_derivatives(fx,fy,ft,nx,ny,bx,by,hx,hy,fxx,fxy,fyy,fxt,fyt);
+
+/* compute motion tensor entries */   
+for(i=bx;i<nx+bx;i++)
+    compute_motion_tensor_gradient_column(fxx[i],fxy[i],fyy[i],fxt[i],fyt[i],
+                                          ny,by,J_11[i],J_22[i],J_33[i],
+                                          J_12[i],J_13[i],J_23[i]);
+
+/* free memory */
+free_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,
+           &fyy,&fxt,&fyt);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_mixed
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float lambda,           /* in     : weight gradient vs. brightness constancy */
+float **J_11,           /* out    : entry 11 of the motion tensor            */
+float **J_22,           /* out    : entry 22 of the motion tensor            */
+float **J_33,           /* out    : entry 33 of the motion tensor            */
+float **J_12,           /* out    : entry 12 of the motion tensor            */
+float **J_13,           /* out    : entry 13 of the motion tensor            */
+float **J_23            /* out    : entry 23 of the motion tensor            */
+                        /*****************************************************/
+)
+
+/*
+ Motion tensor of normalised brightness constancy + lambda * normalised
+ gradient constancy
+*/
+
+{
+                        /*****************************************************/
+int     i;              /* loop variable                                     */
+float   **fx;           /* first order image derivatives                     */
+float   **fy;           /* first order image derivatives                     */
+float   **ft;           /* first order image derivatives                     */
+float   **fxx;          /* second order image derivatives                    */
+float   **fxy;          /* second order image derivatives                    */
+float   **fyy;          /* second order image derivatives                    */
+float   **fxt;          /* second order image derivatives                    */
+float   **fyt;          /* second order image derivatives                    */
+                        /*****************************************************/
+
+/* allocate memory */
+malloc_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,&fyy,&fxt,&fyt);
+
+compute_first_derivatives(f1,f2,nx,ny,bx,by,hx,hy,fx,fy,ft);
+compute_second_derivatives(fx,fy,ft,nx,ny,bx,by,hx,hy,fxx,fxy,fyy,fxt,fyt);
+
+/* compute motion tensor entries entries */   
+for(i=bx;i<nx+bx;i++)
+    compute_motion_tensor_mixed_column(fx[i],fy[i],ft[i],fxx[i],fxy[i],
+                                       fyy[i],fxt[i],fyt[i],ny,by,lambda,
+                                       J_11[i],J_22[i],J_33[i],
+                                       J_12[i],J_13[i],J_23[i]);
+
+/* free memory */
+free_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,
+           &fyy,&fxt,&fyt);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor_low_memory
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float lambda,           /* in     : weight gradient vs. brightness constancy */
+float **J_11,           /* out    : entry 11 of the motion tensor            */
+float **J_22,           /* out    : entry 22 of the motion tensor            */
+float **J_33,           /* out    : entry 33 of the motion tensor            */
+float **J_12,           /* out    : entry 12 of the motion tensor            */
+float **J_13,           /* out    : entry 13 of the motion tensor            */
+float **J_23            /* out    : entry 23 of the motion tensor            */
+                        /*****************************************************/
+)
+
+/*
+ Same tensor as compute_motion_tensor, without derivative planes: the
+ first order derivatives are computed one column ahead into a ring of
+ three columns, from which the second order derivatives of the current
+ column are taken. The scratch memory is 14 columns instead of 3 or 8
+ planes.
+*/
+
+{
+                        /*****************************************************/
+int     i,k;            /* loop variables                                    */
+int     im,ip;          /* left and right neighbour column (clamped)         */
+float   hx_1,hy_1;      /* time saver variables                              */
+float   *fx[3];         /* first order derivatives, ring of columns i%3      */
+float   *fy[3];
+float   *ft[3];
+float   *fxx,*fxy,*fyy; /* second order derivatives of the current column    */
+float   *fxt,*fyt;
+                        /*****************************************************/
+
+/* allocate memory */
+malloc_multi(14,1,sizeof(float),ny,by,0,&fx[0],&fx[1],&fx[2],&fy[0],&fy[1],
+             &fy[2],&ft[0],&ft[1],&ft[2],&fxx,&fxy,&fyy,&fxt,&fyt);
+
+/* define time saver variables */
+hx_1=1.0/(2.0*hx);
+hy_1=1.0/(2.0*hy);
+
+compute_first_derivatives_column(f1,f2,bx,nx,ny,bx,by,hx_1,hy_1,
+                                 fx[bx%3],fy[bx%3],ft[bx%3]);
+for(i=bx;i<nx+bx;i++)
+{
+    im = (i>bx)      ? i-1 : i;
+    ip = (i<nx+bx-1) ? i+1 : i;
+    if (ip != i)
+    {
+        k = ip%3;
+        compute_first_derivatives_column(f1,f2,ip,nx,ny,bx,by,hx_1,hy_1,
+                                         fx[k],fy[k],ft[k]);
+    }
+
+    if (lambda == 0.0f)
+    {
+        k = i%3;
+        compute_motion_tensor_brightness_column(fx[k],fy[k],ft[k],ny,by,
+                                                J_11[i],J_22[i],J_33[i],
+                                                J_12[i],J_13[i],J_23[i]);
+        continue;
+    }
+
+    compute_second_derivatives_column(fx[im%3],fx[ip%3],fy[im%3],fy[i%3],
+                                      fy[ip%3],ft[im%3],ft[i%3],ft[ip%3],
+                                      ny,by,hx_1,hy_1,fxx,fxy,fyy,fxt,fyt);
+    k = i%3;
+    if (lambda == 1.0f)
+        compute_motion_tensor_gradient_column(fxx,fxy,fyy,fxt,fyt,ny,by,
+                                              J_11[i],J_22[i],J_33[i],
+                                              J_12[i],J_13[i],J_23[i]);
+    else
+        compute_motion_tensor_mixed_column(fx[k],fy[k],ft[k],fxx,fxy,fyy,
+                                           fxt,fyt,ny,by,lambda,
+                                           J_11[i],J_22[i],J_33[i],
+                                           J_12[i],J_13[i],J_23[i]);
+}
+
+/* free memory */
+free_multi(14,1,sizeof(float),ny,by,0,&fx[0],&fx[1],&fx[2],&fy[0],&fy[1],
+           &fy[2],&ft[0],&ft[1],&ft[2],&fxx,&fxy,&fyy,&fxt,&fyt);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compute_motion_tensor
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image                                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float lambda,           /* in     : weight gradient vs. brightness constancy */
+float **J_11,           /* out    : entry 11 of the motion tensor            */
+float **J_22,           /* out    : entry 22 of the motion tensor            */
+float **J_33,           /* out    : entry 33 of the motion tensor            */
+float **J_12,           /* out    : entry 12 of the motion tensor            */
+float **J_13,           /* out    : entry 13 of the motion tensor            */
+float **J_23            /* out    : entry 23 of the motion tensor            */
+                        /*****************************************************/
+)
+
+/*
+ Computes the motion tensor entries from a given image pair; the pure
+ brightness and pure gradient constancy cases have kernels of their own
+ that skip the terms weighted with zero
+*/
+
+{
+if (lambda == 0.0f)
+    compute_motion_tensor_brightness(f1,f2,nx,ny,bx,by,hx,hy,
+                                     J_11,J_22,J_33,J_12,J_13,J_23);
+else if (lambda == 1.0f)
+    compute_motion_tensor_gradient(f1,f2,nx,ny,bx,by,hx,hy,
+                                   J_11,J_22,J_33,J_12,J_13,J_23);
+else
+    compute_motion_tensor_mixed(f1,f2,nx,ny,bx,by,hx,hy,lambda,
+                                J_11,J_22,J_33,J_12,J_13,J_23);
+}
 
+/* ------------------------------------------------------------------------- */
 
-/* compute motion tensor entries entries */   
-for(i=bx;i<nx+bx;i++)
+void tvl1_dual_step
+(
+ /*****************************************************/
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ float **ub,             /* in     : extrapolated x-component of increment    */
+ float **vb,             /* in     : extrapolated y-component of increment    */
+ float **pu1,            /* in+out : dual variable of u, x-direction          */
+ float **pu2,            /* in+out : dual variable of u, y-direction          */
+ float **pv1,            /* in+out : dual variable of v, x-direction          */
+ float **pv2,            /* in+out : dual variable of v, y-direction          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float alpha,            /* in     : smoothness weight (radius of the dual)   */
+ float sigma             /* in     : dual step size                           */
+/*****************************************************/
+)
+
+/*
+ Dual ascent of the primal-dual TV-L1 iteration: p += sigma * grad(w)
+ for the flow w = (u+ub, v+vb), followed by the projection onto the disc
+ |p| <= alpha. The gradient uses forward differences and is zero across
+ the last row and column, so p stays zero there.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float sx,sy;            /* sigma divided by the grid spacing                 */
+  float mx,my;            /* zero in the last row or column, 1 otherwise       */
+  float wc,a,b;           /* central flow value, dual candidates               */
+  float n;                /* projection factor min(1, alpha/|p|)               */
+  /*****************************************************/
+  
+  sx = sigma / hx;
+  sy = sigma / hy;
+  
+#ifdef _OPENMP
+#pragma omp parallel for private(j,mx,my,wc,a,b,n) schedule(static)
+#endif
+  for(i=bx;i<nx+bx;i++)
+  {
+    mx = (float)(i<nx+bx-1) * sx;
+#pragma GCC ivdep
+    for(j=by;j<ny+by;j++)
+    {
+      my = (float)(j<ny+by-1) * sy;
+      
+      wc = u[i][j] + ub[i][j];
+      a  = pu1[i][j] + mx * (u[i+1][j] + ub[i+1][j] - wc);
+      b  = pu2[i][j] + my * (u[i][j+1] + ub[i][j+1] - wc);
+      n  = alpha / sqrtf(a*a + b*b);
+      n  = (n < 1.0f) ? n : 1.0f;
+      pu1[i][j] = a * n;
+      pu2[i][j] = b * n;
+      
+      wc = v[i][j] + vb[i][j];
+      a  = pv1[i][j] + mx * (v[i+1][j] + vb[i+1][j] - wc);
+      b  = pv2[i][j] + my * (v[i][j+1] + vb[i][j+1] - wc);
+      n  = alpha / sqrtf(a*a + b*b);
+      n  = (n < 1.0f) ? n : 1.0f;
+      pv1[i][j] = a * n;
+      pv2[i][j] = b * n;
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void tvl1_primal_step
+(
+ /*****************************************************/
+ float **fx,             /* in     : x-derivative of the pair                 */
+ float **fy,             /* in     : y-derivative of the pair                 */
+ float **ft,             /* in     : temporal derivative                      */
+ float **ig2,            /* in     : 1 / (fx^2 + fy^2), 0 where it vanishes   */
+ float **pu1,            /* in     : dual variable of u, x-direction          */
+ float **pu2,            /* in     : dual variable of u, y-direction          */
+ float **pv1,            /* in     : dual variable of v, x-direction          */
+ float **pv2,            /* in     : dual variable of v, y-direction          */
+ float **du,             /* in+out : x-component of flow increment            */
+ float **dv,             /* in+out : y-component of flow increment            */
+ float **ub,             /* out    : extrapolated x-component of increment    */
+ float **vb,             /* out    : extrapolated y-component of increment    */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float hx,               /* in     : grid spacing in x-direction              */
+ float hy,               /* in     : grid spacing in y-direction              */
+ float tau               /* in     : primal step size                         */
+/*****************************************************/
+)
+
+/*
+ Primal descent of the primal-dual TV-L1 iteration: a step along the
+ divergence of p, then the proximal map of tau*|ft + fx du + fy dv|
+ (the thresholding of Zach, Pock and Bischof, written as a step of
+ -r/|grad f|^2 along grad f clamped to [-tau,tau]), then the extrapolation
+ wb = 2 w_new - w_old. The divergence is the negative adjoint of the
+ gradient in tvl1_dual_step; the boundaries of p must be zero.
+*/
+
+{
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  float tx,ty;            /* tau divided by the grid spacing                   */
+  float uh,vh;            /* flow increment after the divergence step          */
+  float r;                /* linearised data residual                          */
+  float s;                /* step along the image gradient                     */
+  /*****************************************************/
+  
+  tx = tau / hx;
+  ty = tau / hy;
+  
+#ifdef _OPENMP
+#pragma omp parallel for private(j,uh,vh,r,s) schedule(static)
+#endif
+  for(i=bx;i<nx+bx;i++)
+#pragma GCC ivdep
     for(j=by;j<ny+by;j++)
-    {  
- 
-	/* set up motion tensor */
-
-	/* normalized Gradient constancy */
-
-    theta_x = 1/(fxx[i][j] * fxx[i][j] + fxy[i][j] * fxy[i][j] + 0.1);
-    theta_y = 1/(fxy[i][j] * fxy[i][j] + fyy[i][j] * fyy[i][j] + 0.1);
-    theta = 1/(fx[i][j]*fx[i][j]+fy[i][j]*fy[i][j]+0.1);
-//      theta_x = 1.0;
-//      theta_y = 1.0;
-//      theta = 1.0;
-//	J_11[i][j] = theta_x*fxx[i][j] * fxx[i][j] + theta_y*fxy[i][j] * fxy[i][j];
-//	J_22[i][j] = theta_x*fxy[i][j] * fxy[i][j] + theta_y*fyy[i][j] * fyy[i][j];
-//	J_33[i][j] = theta_x*fxt[i][j] * fxt[i][j] + theta_y*fyt[i][j] * fyt[i][j];
-//	J_12[i][j] = theta_x*fxx[i][j] * fxy[i][j] + theta_y*fxy[i][j] * fyy[i][j];
-//	J_13[i][j] = theta_x*fxx[i][j] * fxt[i][j] + theta_y*fxy[i][j] * fyt[i][j];
-//	J_23[i][j] = theta_x*fxy[i][j] * fxt[i][j] + theta_y*fyy[i][j] * fyt[i][j];
-	  	
-	
-	/* Brightness constancy */
-	/*
-	J_11[i][j] = fx[i][j] * fx[i][j];
-	J_22[i][j] = fy[i][j] * fy[i][j];
-	J_33[i][j] = ft[i][j] * ft[i][j];
-	J_12[i][j] = fx[i][j] * fy[i][j];
-	J_13[i][j] = fx[i][j] * ft[i][j];
-	J_23[i][j] = fy[i][j] * ft[i][j];
-	*/
-
-	/* Brightness constancy + 50* Gradient constancy */
-//
+    {
+      uh = du[i][j] + tx * (pu1[i][j] - pu1[i-1][j])
+                    + ty * (pu2[i][j] - pu2[i][j-1]);
+      vh = dv[i][j] + tx * (pv1[i][j] - pv1[i-1][j])
+                    + ty * (pv2[i][j] - pv2[i][j-1]);
       
-	J_11[i][j] = lambda*(theta_x*fxx[i][j] * fxx[i][j] + theta_y*fxy[i][j]
-                       * fxy[i][j]) + (1.0-lambda)*theta*fx[i][j] * fx[i][j];
-	J_22[i][j] = lambda*(theta_x*fxy[i][j] * fxy[i][j] + theta_y*fyy[i][j]
-                       * fyy[i][j]) + (1.0-lambda)*theta*fy[i][j] * fy[i][j];
-	J_33[i][j] = lambda*(theta_x*fxt[i][j] * fxt[i][j] + theta_y*fyt[i][j]
-                       * fyt[i][j]) + (1.0-lambda)*theta*ft[i][j] * ft[i][j];
-	J_12[i][j] = lambda*(theta_x*fxx[i][j] * fxy[i][j] + theta_y*fxy[i][j]
-                       * fyy[i][j]) + (1.0-lambda)*theta*fx[i][j] * fy[i][j];
-	J_13[i][j] = lambda*(theta_x*fxx[i][j] * fxt[i][j] + theta_y*fxy[i][j]
-                       * fyt[i][j]) + (1.0-lambda)*theta*fx[i][j] * ft[i][j];
-	J_23[i][j] = lambda*(theta_x*fxy[i][j] * fxt[i][j] + theta_y*fyy[i][j]
-                       * fyt[i][j]) + (1.0-lambda)*theta*fy[i][j] * ft[i][j];
+      r  = ft[i][j] + fx[i][j] * uh + fy[i][j] * vh;
+      s  = - r * ig2[i][j];
+      s  = (s >  tau) ?  tau : s;
+      s  = (s < -tau) ? -tau : s;
+      uh += s * fx[i][j];
+      vh += s * fy[i][j];
+      
+      ub[i][j] = 2.0f * uh - du[i][j];
+      vb[i][j] = 2.0f * vh - dv[i][j];
+      du[i][j] = uh;
+      dv[i][j] = vh;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void tvl1_warp_level
+(
+                        /*****************************************************/
+float **f1,             /* in     : 1st image                                */
+float **f2,             /* in     : 2nd image, warped with (u,v)             */
+float **du,             /* out    : x-component of flow increment            */
+float **dv,             /* out    : y-component of flow increment            */
+float **u,              /* in     : x-component of flow field                */
+float **v,              /* in     : y-component of flow field                */
+int   nx,               /* in     : size in x-direction                      */
+int   ny,               /* in     : size in y-direction                      */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx,               /* in     : grid spacing in x-direction              */
+float hy,               /* in     : grid spacing in y-direction              */
+float m_alpha,          /* in     : smoothness weight                        */
+int   num_iter,         /* in     : primal-dual iterations                   */
+bounds_tracker *bt      /* in+out : halo validity of the flow planes         */
+                        /*****************************************************/
+)
+
+/*
+ Computes the flow increment of one warping level for the TV-L1 model
+ min  m_alpha * (TV(u+du) + TV(v+dv)) + |ft + fx du + fy dv|
+ with the primal-dual algorithm of Chambolle and Pock. Every update is
+ local and uses values of the previous step only (Jacobi style), so the
+ loops vectorise and split over threads. The step sizes
+ tau = sigma = 1 / ||grad|| satisfy tau * sigma * ||grad||^2 <= 1.
+*/
+
+{
+                        /*****************************************************/
+int     i,j,k;          /* loop variables                                    */
+float   **fx,**fy,**ft; /* first order derivatives of the pair               */
+float   **ig2;          /* inverse squared gradient length                   */
+float   **ub,**vb;      /* extrapolated increments                           */
+float   **pu1,**pu2;    /* dual variables of u                               */
+float   **pv1,**pv2;    /* dual variables of v                               */
+float   g2;             /* squared gradient length                           */
+float   tau;            /* step size                                         */
+                        /*****************************************************/
+
+/* dual variables and extrapolations need zero boundaries */
+malloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&ig2);
+calloc_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&ub,&vb,&pu1,&pu2,&pv1,&pv2);
 
+compute_first_derivatives(f1,f2,nx,ny,bx,by,hx,hy,fx,fy,ft);
+for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+	g2 = fx[i][j] * fx[i][j] + fy[i][j] * fy[i][j];
+	ig2[i][j] = (g2 > 1.0e-9f) ? 1.0f / g2 : 0.0f;
     }
 
+/* the flow is read one pixel beyond the last row and column */
+mirror_bounds_2d_tracked(bt,u,nx,ny,bx,by);
+mirror_bounds_2d_tracked(bt,v,nx,ny,bx,by);
 
+set_matrix_2d(du,nx+2*bx,ny+2*by,0,0,(float)0.0);
+set_matrix_2d(dv,nx+2*bx,ny+2*by,0,0,(float)0.0);
 
+tau = 1.0f / sqrtf(4.0f/(hx*hx) + 4.0f/(hy*hy));
+for(k=0;k<num_iter;k++)
+{
+    tvl1_dual_step(u,v,ub,vb,pu1,pu2,pv1,pv2,nx,ny,bx,by,hx,hy,m_alpha,tau);
+    tvl1_primal_step(fx,fy,ft,ig2,pu1,pu2,pv1,pv2,du,dv,ub,vb,
+                     nx,ny,bx,by,hx,hy,tau);
+}
+bounds_mark_dirty(bt,du);
+bounds_mark_dirty(bt,dv);
 
-/* free memory */
-free_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&fxx,&fxy,
-           &fyy,&fxt,&fyt);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&fx,&fy,&ft,&ig2);
+free_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&ub,&vb,&pu1,&pu2,&pv1,&pv2);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -569,79 +2655,613 @@ float epsilon_s,       /* in     : diffusivity type data term               */
 float w_bright_grad,
 int   num_iter_inner,   /* in     : inner solver iterations                  */
 int   num_iter_outer,   /* in     : outer nonlin update iterations           */
-float n_omega           /* in     : SOR overrelaxation parameter             */
+float n_omega,          /* in     : SOR overrelaxation parameter             */
+bounds_tracker *bt,     /* in+out : halo validity of the flow planes         */
+const hs_options *opt,  /* in     : solver options                           */
+hs_cache_level *cached  /* in+out : cached motion tensor of the level (used  */
+                        /*          if valid, else filled), NULL for none    */
+                        /*****************************************************/
+)
+
+
+{
+                        /*****************************************************/
+int    i,j;             /* loop variable                                     */
+float  **J_11;          /* entry 11 of the motion tensor                     */
+float  **J_22;          /* entry 22 of the motion tensor                     */
+float  **J_33;          /* entry 33 of the motion tensor                     */
+float  **J_12;          /* entry 12 of the motion tensor                     */
+float  **J_13;          /* entry 13 of the motion tensor                     */
+float  **J_23;          /* entry 23 of the motion tensor                     */
+float  **psi_prime_d;   /* nonlinearitys of data term                        */
+float  **psi_prime_s;
+float  **wx, **wy;      /* precomputed SOR edge weights                      */
+float  **ia11, **ia22;  /* precomputed inverse SOR diagonals                 */
+float  **a12;           /* precomputed coupling du - dv                      */
+float  **bu, **bv;      /* precomputed right hand sides                      */
+float  **g11, **g12;    /* work planes of the line solver                    */
+float  **g22, **d1, **d2;
+float  **ru, **rv;      /* work planes of the PCG solver                     */
+float  **pu, **pv;
+float  **qu, **qv;
+float  **d11, **d22;
+float  **m11, **m12, **m22;
+double *part, *part_r;  /* column sums of the PCG dot products               */
+int    pcg_iter;        /* PCG iterations done in one solve                  */
+int    assembled;       /* SOR system is assembled in the planes above       */
+float  omega;           /* SOR overrelaxation parameter of this level        */
+double res, res_0;      /* residual norm, initial residual norm              */
+long   sweeps;          /* SOR sweeps done on this level                     */
+int    packed;          /* motion tensor kept in 16 bit storage              */
+unsigned short **Jp[5]; /* packed J_11, J_22, J_12, J_13, J_23              */
+float  **Jv[5];         /* views of the unpacked columns                     */
+float  *col[5];         /* unpacked column of each packed entry              */
+float  **J[5];          /* the same entries as float planes                  */
+int    k;               /* tensor entry                                      */
+int    interleaved;     /* plain SOR sweeps the interleaved records          */
+float  **T;             /* tensor records of the interleaved layout          */
+float  **W;             /* flow records of the interleaved layout            */
+                        /*****************************************************/
+
+
+
+/* ---- alloc memory ---- */
+if (cached)
+{
+    J_11 = cached->J[0];  J_22 = cached->J[1];  J_33 = cached->J[2];
+    J_12 = cached->J[3];  J_13 = cached->J[4];  J_23 = cached->J[5];
+}
+else
+    malloc_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&J_11,&J_22,&J_33,&J_12,
+                 &J_13,&J_23);
+malloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&psi_prime_d,&psi_prime_s);
+/* the omega estimate and the residual need the assembled system */
+assembled = opt->sor_weights || opt->adaptive_omega || opt->line_relax ||
+            opt->pcg || (opt->inner_tolerance > 0.0f);
+if (assembled)
+    calloc_multi(7,2,sizeof(float),nx,ny,bx,by,0,0,&wx,&wy,&ia11,&ia22,&a12,
+                 &bu,&bv);
+if (opt->line_relax)
+    calloc_multi(5,2,sizeof(float),nx,ny,bx,by,0,0,&g11,&g12,&g22,&d1,&d2);
+if (opt->pcg)
+{
+    calloc_multi(11,2,sizeof(float),nx,ny,bx,by,0,0,&ru,&rv,&pu,&pv,&qu,&qv,
+                 &d11,&d22,&m11,&m12,&m22);
+    calloc_multi(2,1,sizeof(double),nx,bx,0,&part,&part_r);
+}
+/* the assembled solvers read the tensor only once per outer iteration; */
+/* the recompute cache keeps float tensors                              */
+packed = (opt->tensor_storage != HS_STORAGE_FLOAT32) && !assembled &&
+         !opt->cache;
+interleaved = opt->interleaved && !assembled && !packed;
+omega  = opt->line_relax ? opt->line_omega : n_omega;
+sweeps = 0;
+
+/* ---- initialise displacement field with zero ----  */
+set_matrix_2d(du,nx+2*bx,ny+2*by,0,0,(float)0.0);
+set_matrix_2d(dv,nx+2*bx,ny+2*by,0,0,(float)0.0);
+bounds_mark_dirty(bt,du);
+bounds_mark_dirty(bt,dv);
+
+
+/* ---- compute motion tensor ---- */
+if ((!cached || !cached->valid) && opt->low_memory)
+    compute_motion_tensor_low_memory(f1,f2,nx,ny,bx,by,hx,hy,w_bright_grad,
+                                     J_11,J_22,J_33,J_12,J_13,J_23);
+else if (!cached || !cached->valid)
+    compute_motion_tensor(f1,f2,nx,ny,bx,by,hx,hy,w_bright_grad,
+                          J_11,J_22,J_33,J_12,J_13,J_23);
+if (cached)
+    cached->valid = 1;
+
+/* ---- copy of the tensor in 16 bit storage for the sweeps ---- */
+/* the data term nonlinearity keeps reading the float tensor: its      */
+/* quadratic form nearly cancels at the solution, and 16 bit entries    */
+/* would leave mostly rounding noise there                              */
+if (packed)
+{
+    J[0] = J_11;  J[1] = J_22;  J[2] = J_12;  J[3] = J_13;  J[4] = J_23;
+    malloc_multi(5,2,sizeof(unsigned short),nx,ny,bx,by,0,0,&Jp[0],&Jp[1],
+                 &Jp[2],&Jp[3],&Jp[4]);
+    hs_pack_tensor(J,Jp,nx,ny,bx,by,opt->tensor_storage);
+    malloc_multi(5,1,sizeof(float),ny,by,0,&col[0],&col[1],&col[2],&col[3],
+                 &col[4]);
+    Jv[0] = (float**)malloc(5*(nx+2*bx)*sizeof(float*));
+    for(k=0;k<5;k++)
+    {
+        Jv[k] = Jv[0] + k*(nx+2*bx);
+        for(i=0;i<nx+2*bx;i++)
+            Jv[k][i] = col[k];
+    }
+}
+
+/* ---- interleaved records for the sweeps ---- */
+/* the tensor, u and v are constant on the level and du, dv are only    */
+/* changed by the sweeps, so only psi_prime_d goes in and du, dv come   */
+/* out per outer iteration                                              */
+if (interleaved)
+{
+    malloc_multi(1,2,sizeof(float),nx,HS_TENSOR_RECORD*ny,bx,
+                 HS_TENSOR_RECORD*by,0,0,&T);
+    malloc_multi(1,2,sizeof(float),nx,HS_FLOW_RECORD*ny,bx,
+                 HS_FLOW_RECORD*by,0,0,&W);
+    J[0] = J_11;  J[1] = J_22;  J[2] = J_12;  J[3] = J_13;  J[4] = J_23;
+    for(k=0;k<5;k++)
+        hs_interleave(J[k],T,HS_TENSOR_RECORD,k,nx,ny,bx,by);
+    hs_interleave(du,W,HS_FLOW_RECORD,0,nx,ny,bx,by);
+    hs_interleave(dv,W,HS_FLOW_RECORD,1,nx,ny,bx,by);
+    hs_interleave(u, W,HS_FLOW_RECORD,2,nx,ny,bx,by);
+    hs_interleave(v, W,HS_FLOW_RECORD,3,nx,ny,bx,by);
+}
+
+
+
+
+/* ---- perform SOR iterations ---- */
+for(j=0;j<num_iter_outer;j++)
+{
+	update_nonlinearities(J_11, J_22, J_33, J_12, J_13, J_23, du, dv,
+                        psi_prime_d, epsilon_d, nx,
+                        ny, bx, by);
+  
+  if (opt->low_memory)
+    update_nonlinearities_reg_low_memory(u,v,du,dv,psi_prime_s,epsilon_s,
+                                         nx,ny,bx,by,hx,hy,bt);
+  else
+    update_nonlinearities_reg(u,v,du,dv,psi_prime_s,epsilon_s,nx,ny,bx,by,
+                              hx,hy,bt);
+  if (assembled)
+  {
+	horn_schunck_warp_sor_assemble(J_11, J_22, J_12, J_13, J_23, u, v,
+								psi_prime_d, psi_prime_s, nx, ny, bx, by, hx, hy,
+								m_alpha, wx, wy, ia11, ia22, a12, bu, bv, bt);
+	/* one estimate per level, from the system of the first outer iteration */
+	if (opt->adaptive_omega && !opt->pcg && !opt->line_relax && (j == 0))
+	{
+		omega = horn_schunck_warp_estimate_omega(wx, wy, ia11, ia22, a12,
+										nx, ny, bx, by, HS_OMEGA_POWER_ITER);
+		if (omega == 0.0f)
+			omega = n_omega;
+	}
+	if (opt->pcg)
+	{
+		horn_schunck_warp_pcg(wx, wy, ia11, ia22, a12, bu, bv, du, dv,
+							ru, rv, pu, pv, qu, qv, d11, d22, m11, m12, m22,
+							part, part_r, nx, ny, bx, by, opt->pcg,
+							num_iter_inner, opt->inner_tolerance, &pcg_iter);
+		sweeps += pcg_iter;
+	}
+	else
+	{
+		if (opt->inner_tolerance > 0.0f)
+			horn_schunck_warp_residual(wx, wy, ia11, ia22, a12, bu, bv,
+									du, dv, nx, ny, bx, by, &res_0);
+		for(i=1;i<=num_iter_inner;i++)
+		{
+			if (opt->line_relax)
+				horn_schunck_warp_line_gs(wx, wy, ia11, ia22, a12, bu, bv,
+										du, dv, g11, g12, g22, d1, d2,
+										nx, ny, bx, by, omega);
+			else
+				horn_schunck_warp_sor_precomputed(wx, wy, ia11, ia22, a12, bu, bv,
+												du, dv, nx, ny, bx, by, omega);
+			sweeps++;
+			if (opt->inner_tolerance > 0.0f)
+			{
+				horn_schunck_warp_residual(wx, wy, ia11, ia22, a12, bu, bv,
+										du, dv, nx, ny, bx, by, &res);
+				if (res <= opt->inner_tolerance * res_0)
+					break;
+			}
+		}
+	}
+  }
+  else if (interleaved)
+  {
+	hs_interleave(psi_prime_d,T,HS_TENSOR_RECORD,5,nx,ny,bx,by);
+	for(i=1;i<=num_iter_inner;i++)
+	{
+		horn_schunck_warp_sor_interleaved(T, W, psi_prime_s, nx, ny, bx, by,
+							hx, hy, m_alpha, n_omega);
+		sweeps++;
+	}
+	if (num_iter_inner > 0)
+	{
+		hs_deinterleave(W,du,HS_FLOW_RECORD,0,nx,ny,bx,by);
+		hs_deinterleave(W,dv,HS_FLOW_RECORD,1,nx,ny,bx,by);
+	}
+  }
+  else
+	for(i=1;i<=num_iter_inner;i++)
+	{
+		if (packed)
+			horn_schunck_warp_sor_packed(Jp, Jv, col, du, dv, u, v,
+							psi_prime_d, psi_prime_s, nx, ny, bx, by, hx, hy,
+							m_alpha, n_omega, opt->tensor_storage);
+		else
+			horn_schunck_warp_sor(J_11, J_22, J_33, J_12, J_13, J_23,
+							du, dv, u, v, psi_prime_d, psi_prime_s,nx, ny, bx, by, hx, hy,
+							m_alpha, n_omega);
+		sweeps++;
+	}
+  if (num_iter_inner > 0)
+  {
+	bounds_mark_dirty(bt,du);
+	bounds_mark_dirty(bt,dv);
+  }
+  
+
+}
+
+if (opt->stats)
+{
+  opt->stats->sor_sweeps  += sweeps;
+  opt->stats->sor_updates += (double)sweeps * nx * ny;
+  if ((opt->stats->omega_min == 0.0f) || (omega < opt->stats->omega_min))
+      opt->stats->omega_min = omega;
+  if (omega > opt->stats->omega_max)
+      opt->stats->omega_max = omega;
+}
+
+/* ---- free memory ---- */
+  if (packed)
+  {
+    free_multi(5,2,sizeof(unsigned short),nx,ny,bx,by,0,0,&Jp[0],&Jp[1],
+               &Jp[2],&Jp[3],&Jp[4]);
+    free_multi(5,1,sizeof(float),ny,by,0,&col[0],&col[1],&col[2],&col[3],
+               &col[4]);
+    free(Jv[0]);
+  }
+  if (interleaved)
+  {
+    free_multi(1,2,sizeof(float),nx,HS_TENSOR_RECORD*ny,bx,
+               HS_TENSOR_RECORD*by,0,0,&T);
+    free_multi(1,2,sizeof(float),nx,HS_FLOW_RECORD*ny,bx,
+               HS_FLOW_RECORD*by,0,0,&W);
+  }
+  if (!cached)
+    free_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&J_11,&J_22,&J_33,&J_12,
+               &J_13,&J_23);
+  free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&psi_prime_d,&psi_prime_s);
+  if (assembled)
+    free_multi(7,2,sizeof(float),nx,ny,bx,by,0,0,&wx,&wy,&ia11,&ia22,&a12,
+               &bu,&bv);
+  if (opt->line_relax)
+    free_multi(5,2,sizeof(float),nx,ny,bx,by,0,0,&g11,&g12,&g22,&d1,&d2);
+  if (opt->pcg)
+  {
+    free_multi(11,2,sizeof(float),nx,ny,bx,by,0,0,&ru,&rv,&pu,&pv,&qu,&qv,
+               &d11,&d22,&m11,&m12,&m22);
+    free_multi(2,1,sizeof(double),nx,bx,0,&part,&part_r);
+  }
+
+}
+
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_build_pyramid
+(
+ /*****************************************************/
+ float **f,              /* in     : image (original resolution)              */
+ float ***pyr,           /* out    : resampled image per recursion depth,     */
+                         /*          allocated here, boundaries zero          */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   max_rec_depth,    /* in     : maximum recursion depth                  */
+ float **tmp             /* in+out : temporary array for resampling           */
+/*****************************************************/
+)
+
+/* resamples f to the resolution of every recursion depth of                 */
+/* HORN_SCHUNCK_WARP, exactly as the warping does it on each level           */
+
+{
+  /*****************************************************/
+  int   d;                /* recursion depth                                   */
+  int   mx, my;           /* size on depth d                                   */
+  /*****************************************************/
+
+  for(d=0;d<=max_rec_depth;d++)
+  {
+    mx = (d==0) ? nx : (int)ceil(nx*pow(n_warp_eta,d));
+    my = (d==0) ? ny : (int)ceil(ny*pow(n_warp_eta,d));
+    malloc_multi(1,2,sizeof(float),mx,my,bx,by,0,0,&pyr[d]);
+    resample_2d(f,nx,ny,bx,by,pyr[d],mx,my,tmp);
+    set_bounds_2d(pyr[d],mx,my,bx,by,(float)0.0);
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void horn_schunck_free_pyramid
+(
+ /*****************************************************/
+ float ***pyr,           /* in+out : pyramid of horn_schunck_build_pyramid    */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   max_rec_depth     /* in     : maximum recursion depth                  */
+/*****************************************************/
+)
+
+/* frees the planes of a pyramid */
+
+{
+  /*****************************************************/
+  int   d;                /* recursion depth                                   */
+  int   mx, my;           /* size on depth d                                   */
+  /*****************************************************/
+
+  for(d=0;d<=max_rec_depth;d++)
+  {
+    mx = (d==0) ? nx : (int)ceil(nx*pow(n_warp_eta,d));
+    my = (d==0) ? ny : (int)ceil(ny*pow(n_warp_eta,d));
+    free_multi(1,2,sizeof(float),mx,my,bx,by,0,0,&pyr[d]);
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+void hs_cache_init
+(
+ hs_cache *c             /* out    : empty cache                              */
+)
+
+/* sets up an empty cache with the default tensor budget */
+
+{
+memset(c,0,sizeof(hs_cache));
+c->tensor_budget = HS_CACHE_TENSOR_BUDGET;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void hs_cache_invalidate
+(
+ hs_cache *c             /* in+out : cache, emptied and memory released       */
+)
+
+/* drops all cached stages; the budget and the counters are kept */
+
+{
+  /*****************************************************/
+  int   d;                /* recursion depth                                   */
+  hs_cache_level *l;      /* tensor of depth d                                 */
+  /*****************************************************/
+
+  if (c->f1)
+  {
+    horn_schunck_free_pyramid(c->f1_pyr,c->nx,c->ny,c->bx,c->by,
+                              c->n_warp_eta,c->depth-1);
+    horn_schunck_free_pyramid(c->f2_pyr,c->nx,c->ny,c->bx,c->by,
+                              c->n_warp_eta,c->depth-1);
+    for(d=0;d<c->depth;d++)
+    {
+      l = &c->level[d];
+      if (l->nx)
+        free_multi(6,2,sizeof(float),l->nx,l->ny,c->bx,c->by,0,0,
+                   &l->J[0],&l->J[1],&l->J[2],&l->J[3],&l->J[4],&l->J[5]);
+    }
+    free_multi(2,2,sizeof(float),c->nx,c->ny,c->bx,c->by,0,0,&c->u,&c->v);
+    free(c->f1_pyr);
+    free(c->f2_pyr);
+    free(c->level);
+  }
+  c->f1 = c->f2 = NULL;
+  c->f1_pyr = c->f2_pyr = NULL;
+  c->level = NULL;
+  c->depth = 0;
+  c->tensor_bytes = 0;
+  c->result_valid = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int hs_cache_prepare
+(
+ /*****************************************************/
+ hs_cache *c,            /* in+out : cache                                    */
+ float **f1,             /* in     : 1st image                                */
+ float **f2,             /* in     : 2nd image                                */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by,               /* in     : boundary size in y-direction             */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   max_rec_depth     /* in     : maximum recursion depth                  */
+/*****************************************************/
+)
+
+/* makes the cached pyramids valid for the pair and all recursion depths  */
+/* up to max_rec_depth, rebuilding them (and dropping everything that     */
+/* depends on them) if the pair or the reduction factor changed; returns  */
+/* 0 if out of memory                                                     */
+
+{
+  /*****************************************************/
+  float **tmp;            /* temporary array for resampling                    */
+  /*****************************************************/
+
+  if ((c->f1 == f1) && (c->f2 == f2) && (c->nx == nx) && (c->ny == ny) &&
+      (c->bx == bx) && (c->by == by) && (c->n_warp_eta == n_warp_eta) &&
+      (c->depth > max_rec_depth))
+    return 1;
+
+  hs_cache_invalidate(c);
+  c->f1_pyr = (float***)malloc((max_rec_depth+1)*sizeof(float**));
+  c->f2_pyr = (float***)malloc((max_rec_depth+1)*sizeof(float**));
+  c->level  = (hs_cache_level*)calloc(max_rec_depth+1,sizeof(hs_cache_level));
+  if (!c->f1_pyr || !c->f2_pyr || !c->level ||
+      !malloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&c->u,&c->v))
+  {
+    console_error("[hs_cache_prepare] out of memory\n");
+    free(c->f1_pyr);
+    free(c->f2_pyr);
+    free(c->level);
+    c->f1_pyr = c->f2_pyr = NULL;
+    c->level = NULL;
+    return 0;
+  }
+  malloc_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+  horn_schunck_build_pyramid(f1,c->f1_pyr,nx,ny,bx,by,n_warp_eta,
+                             max_rec_depth,tmp);
+  horn_schunck_build_pyramid(f2,c->f2_pyr,nx,ny,bx,by,n_warp_eta,
+                             max_rec_depth,tmp);
+  free_multi(1,2,sizeof(float),nx,ny,bx,by,0,0,&tmp);
+
+  c->f1 = f1;
+  c->f2 = f2;
+  c->nx = nx;
+  c->ny = ny;
+  c->bx = bx;
+  c->by = by;
+  c->n_warp_eta = n_warp_eta;
+  c->depth = max_rec_depth+1;
+  c->pyramid_builds++;
+  return 1;
+}
+
+/* ------------------------------------------------------------------------- */
 
-                        /*****************************************************/
+unsigned long long hs_flow_hash
+(
+ /*****************************************************/
+ float **u,              /* in     : x-component of flow field                */
+ float **v,              /* in     : y-component of flow field                */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ int   bx,               /* in     : boundary size in x-direction             */
+ int   by                /* in     : boundary size in y-direction             */
+/*****************************************************/
 )
 
+/* 64 bit FNV-1a hash of the bit patterns of the flow inside the image */
 
 {
-                        /*****************************************************/
-int    i,j;             /* loop variable                                     */
-float  **J_11;          /* entry 11 of the motion tensor                     */
-float  **J_22;          /* entry 22 of the motion tensor                     */
-float  **J_33;          /* entry 33 of the motion tensor                     */
-float  **J_12;          /* entry 12 of the motion tensor                     */
-float  **J_13;          /* entry 13 of the motion tensor                     */
-float  **J_23;          /* entry 23 of the motion tensor                     */
-float  **psi_prime_d;   /* nonlinearitys of data term                        */
-float  **psi_prime_s;
-                        /*****************************************************/
+  /*****************************************************/
+  int   i,j;              /* loop variables                                    */
+  unsigned int b;         /* bits of one value                                 */
+  unsigned long long h;   /* hash                                              */
+  /*****************************************************/
 
+  h = 14695981039346656037ULL;
+  for(i=bx;i<nx+bx;i++)
+    for(j=by;j<ny+by;j++)
+    {
+      memcpy(&b,&u[i][j],sizeof(b));
+      h = (h ^ b) * 1099511628211ULL;
+      memcpy(&b,&v[i][j],sizeof(b));
+      h = (h ^ b) * 1099511628211ULL;
+    }
+  return h;
+}
 
+/* ------------------------------------------------------------------------- */
 
-/* ---- alloc memory ---- */
-malloc_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&J_11,&J_22,&J_33,&J_12,&J_13,
-             &J_23,&psi_prime_d, &psi_prime_s);
+hs_cache_level *hs_cache_tensor
+(
+ /*****************************************************/
+ hs_cache *c,            /* in+out : cache with valid pyramids                */
+ int   rec_depth,        /* in     : recursion depth                          */
+ float **u,              /* in     : incoming flow of the level, x-component  */
+ float **v,              /* in     : incoming flow of the level, y-component  */
+ int   nx,               /* in     : size in x-direction                      */
+ int   ny,               /* in     : size in y-direction                      */
+ float w_bright_grad     /* in     : weight of gradient constancy             */
+/*****************************************************/
+)
 
-/* ---- initialise displacement field with zero ----  */
-set_matrix_2d(du,nx+2*bx,ny+2*by,0,0,(float)0.0);
-set_matrix_2d(dv,nx+2*bx,ny+2*by,0,0,(float)0.0);
+/* returns the tensor entry of a level, valid if its tensor belongs to    */
+/* the incoming flow u, v, or invalid to be filled by the caller; NULL if */
+/* the level does not fit into the tensor budget                          */
 
+{
+  /*****************************************************/
+  hs_cache_level *l;      /* entry of the level                                */
+  unsigned long long key; /* hash of u, v                                      */
+  long  bytes;            /* size of the six tensor planes                     */
+  /*****************************************************/
 
-/* ---- compute motion tensor ---- */
-compute_motion_tensor(f1,f2,nx,ny,bx,by,hx,hy,w_bright_grad,
-                      J_11,J_22,J_33,J_12,J_13,J_23);
+  l = &c->level[rec_depth];
+  if (!l->nx)
+  {
+    bytes = 6L*(nx+2*c->bx)*(ny+2*c->by)*(long)sizeof(float);
+    if (c->tensor_bytes + bytes > c->tensor_budget)
+      return NULL;
+    if (!malloc_multi(6,2,sizeof(float),nx,ny,c->bx,c->by,0,0,
+                      &l->J[0],&l->J[1],&l->J[2],&l->J[3],&l->J[4],&l->J[5]))
+      return NULL;
+    l->nx = nx;
+    l->ny = ny;
+    l->valid = 0;
+    c->tensor_bytes += bytes;
+  }
+
+  key = hs_flow_hash(u,v,nx,ny,c->bx,c->by);
+  if (l->valid && (l->key == key) && (l->w_bright_grad == w_bright_grad))
+  {
+    c->tensor_hits++;
+    return l;
+  }
+  l->valid = 0;
+  l->key = key;
+  l->w_bright_grad = w_bright_grad;
+  c->tensor_misses++;
+  return l;
+}
 
+/* ------------------------------------------------------------------------- */
 
+void horn_schunck_level_size
+(
+ /*****************************************************/
+ int   nx_orig,          /* in     : size in x-direction (original resolution)*/
+ int   ny_orig,          /* in     : size in y-direction (original resolution)*/
+ float hx_orig,          /* in     : spacing in x-direction (original resol.) */
+ float hy_orig,          /* in     : spacing in y-direction (original resol.) */
+ float n_warp_eta,       /* in     : warping reduction factor between levels  */
+ int   rec_depth,        /* in     : recursion depth of the level             */
+ int   *nx,              /* out    : size in x-direction on that level        */
+ int   *ny,              /* out    : size in y-direction on that level        */
+ float *hx,              /* out    : spacing in x-direction on that level     */
+ float *hy               /* out    : spacing in y-direction on that level     */
+/*****************************************************/
+)
 
+/* grid of a warping level: depth 0 is the original grid, depth d shrinks   */
+/* it to ceil(n*eta^d) pixels that cover the same domain                    */
 
-/* ---- perform SOR iterations ---- */
-for(j=0;j<num_iter_outer;j++)
 {
-	update_nonlinearities(J_11, J_22, J_33, J_12, J_13, J_23, du, dv,
-                        psi_prime_d, epsilon_d, nx,
-                        ny, bx, by);
-  
-  update_nonlinearities_reg(u,v,du,dv,psi_prime_s,epsilon_s,nx,ny,bx,by,
-                            hx,hy);
-	for(i=1;i<=num_iter_inner;i++)
-	{
-		horn_schunck_warp_sor(J_11, J_22, J_33, J_12, J_13, J_23,
-							du, dv, u, v, psi_prime_d, psi_prime_s,nx, ny, bx, by, hx, hy,
-							m_alpha, n_omega);
-	}
-  
-
-}
-
-/* ---- free memory ---- */
-  free_multi(8,2,sizeof(float),nx,ny,bx,by,0,0,&J_11,&J_22,&J_33,&J_12,&J_13,
-               &J_23,&psi_prime_d, &psi_prime_s);
-
+  if (rec_depth == 0)
+  {
+    *nx = nx_orig;  *ny = ny_orig;
+    *hx = hx_orig;  *hy = hy_orig;
+    return;
+  }
+  *nx = (int)ceil(nx_orig*pow(n_warp_eta,rec_depth));
+  *ny = (int)ceil(ny_orig*pow(n_warp_eta,rec_depth));
+  *hx = (float)nx_orig/(float)*nx;
+  *hy = (float)ny_orig/(float)*ny;
 }
 
-
 /* ------------------------------------------------------------------------- */
 
 
-void HORN_SCHUNCK_WARP
+void horn_schunck_warp_step
 (
                         /*****************************************************/
 float **f1_orig,        /* in     : 1st image (original resolution)          */
 float **f2_orig,        /* in     : 2nd image (original resolution)          */
 int   nx_orig,          /* in     : size in x-direction (original resolution)*/
 int   ny_orig,          /* in     : size in y-direction (original resoluiton)*/
+float ***f1_pyr,        /* in     : 1st image per recursion depth, or NULL   */
+float ***f2_pyr,        /* in     : 2nd image per recursion depth, or NULL   */
 float **f1_res,         /* in+out : 1st image, resampled                     */
 float **f2_res,         /* in+out : 2nd image, resampled                     */
 float **f2_res_warp,    /* in+out : 2nd image, resampled  and warped         */
@@ -665,53 +3285,65 @@ int   num_iter_outer,   /* in     : outer nonlin update iterations           */
 float n_omega,          /* in     : SOR overrelaxation parameter             */
 float n_warp_eta,       /* in     : warping reduction factor between levels  */
 int   max_rec_depth,    /* in     : maximum recursion depth                  */
-int   rec_depth         /* in     : current recursion depth                  */
+int   rec_depth,        /* in     : recursion depth of this level            */
+bounds_tracker *bt,     /* in+out : halo validity of the flow planes         */
+const hs_options *opt   /* in     : solver options                           */
 
                         /*****************************************************/
 )
 
-/* implements warping for the Horn and Schunck method */
+/* one warping level of the Horn and Schunck method: u, v hold the flow  */
+/* of the next coarser level (nothing on the coarsest one) and get the    */
+/* flow of this level; with f1_pyr and f2_pyr the resampled images are    */
+/* taken from these pyramids (see horn_schunck_build_pyramid) instead of  */
+/* f1_res and f2_res                                                       */
 
 {
 
                              /************************************************/
 int   nx_coarse,ny_coarse;   /* dimensions on previous coarser grid          */
 float hx_coarse,hy_coarse;   /* grid sizes on previous coarser grid          */
+hs_cache_level *cached;      /* cached motion tensor of this level           */
                              /************************************************/
   
 
 /* compute dimensions and grid sizes for previous coarser grid */	
-nx_coarse=(int)ceil(nx_orig*pow(n_warp_eta,rec_depth+1));
-ny_coarse=(int)ceil(ny_orig*pow(n_warp_eta,rec_depth+1));
-hx_coarse=(float)nx_orig/(float)nx_coarse;
-hy_coarse=(float)ny_orig/(float)ny_coarse;
-
-
-/* start at coarsest level by recursively calling the routine */
-if (rec_depth<max_rec_depth)
-{
-HORN_SCHUNCK_WARP(f1_orig, f2_orig, nx_orig, ny_orig,
-		  f1_res, f2_res, f2_res_warp,
-		  du, dv, u, v, tmp,
-		  nx_coarse, ny_coarse, bx, by, hx_coarse, hy_coarse,	       
-		  m_alpha, epsilon_d,epsilon_s, w_bright_grad,
-		  num_iter_inner,num_iter_outer, n_omega, n_warp_eta, 
-		  max_rec_depth,rec_depth+1);
-}
+horn_schunck_level_size(nx_orig,ny_orig,hx_fine,hy_fine,n_warp_eta,
+                        rec_depth+1,&nx_coarse,&ny_coarse,&hx_coarse,
+                        &hy_coarse);
 
 
 
 /* ---- resample images ---------------------------------------------------- */
 
 /* restrict original image pair to resolution of current level */ 
-resample_2d(f1_orig,nx_orig,ny_orig,bx,by,f1_res,nx_fine,ny_fine,tmp);
-resample_2d(f2_orig,nx_orig,ny_orig,bx,by,f2_res,nx_fine,ny_fine,tmp);
+if (f1_pyr)
+{
+    f1_res = f1_pyr[rec_depth];
+    f2_res = f2_pyr[rec_depth];
+}
+else
+{
+    resample_2d(f1_orig,nx_orig,ny_orig,bx,by,f1_res,nx_fine,ny_fine,tmp);
+    resample_2d(f2_orig,nx_orig,ny_orig,bx,by,f2_res,nx_fine,ny_fine,tmp);
+    /* the warping interpolates towards zero boundaries */
+    set_bounds_2d(f2_res,nx_fine,ny_fine,bx,by,(float)0.0);
+}
 
 
 /* ---- get overall flow field from previous resolution level -------------- */
 
 /* if on coarsest resolution */
-if(rec_depth==max_rec_depth)
+if((rec_depth==max_rec_depth) && opt->init_flow)
+ {
+     /* restrict the initial flow (in pixels of the original resolution) */
+     if ((nx_fine != nx_orig) || (ny_fine != ny_orig))
+     {
+         resample_2d(u,nx_orig,ny_orig,bx,by,u,nx_fine,ny_fine,tmp);
+         resample_2d(v,nx_orig,ny_orig,bx,by,v,nx_fine,ny_fine,tmp);
+     }
+ }
+else if(rec_depth==max_rec_depth)
  {            
      /* set flow field zero */
      set_matrix_2d(u,nx_fine+2*bx,ny_fine+2*by,0,0,(float)0.0);
@@ -724,37 +3356,213 @@ if(rec_depth==max_rec_depth)
      resample_2d(u,nx_coarse,ny_coarse,bx,by,u,nx_fine,ny_fine,tmp);
      resample_2d(v,nx_coarse,ny_coarse,bx,by,v,nx_fine,ny_fine,tmp);     
  }
+bounds_mark_dirty(bt,u);
+bounds_mark_dirty(bt,v);
 
 /* ---- set up difference problem at current resolution -------------------- */
+
+/* the motion tensor of an unchanged incoming flow comes from the cache */
+cached = NULL;
+if (opt->cache && !opt->tvl1)
+    cached = hs_cache_tensor(opt->cache,rec_depth,u,v,nx_fine,ny_fine,
+                             w_bright_grad);
                 
 /* warp second image by overall flow field from previous coarser resolution */
-backward_registration(f1_res,f2_res,f2_res_warp,u,v,
-		              nx_fine,ny_fine,bx,by,hx_fine,hy_fine);
+if (!cached || !cached->valid)
+    backward_registration(f1_res,f2_res,f2_res_warp,u,v,
+		                  nx_fine,ny_fine,bx,by,hx_fine,hy_fine);
 
 
 
 /* ---- solve difference problem at current resolution --------------------- */
      
 /* solve difference problem at current resolution to obtain increment */
-HORN_SCHUNCK_WARP_LEVEL(f1_res, f2_res_warp, du, dv, u, v,
-                        nx_fine, ny_fine, bx, by, hx_fine, hy_fine,
-                        m_alpha, epsilon_d, epsilon_s, w_bright_grad,
-                        num_iter_inner, num_iter_outer, n_omega);
+if (opt->tvl1)
+{
+    tvl1_warp_level(f1_res, f2_res_warp, du, dv, u, v,
+                    nx_fine, ny_fine, bx, by, hx_fine, hy_fine,
+                    m_alpha, opt->tvl1_iterations, bt);
+    if (opt->stats)
+    {
+        opt->stats->sor_sweeps  += opt->tvl1_iterations;
+        opt->stats->sor_updates += (double)opt->tvl1_iterations
+                                   * nx_fine * ny_fine;
+    }
+}
+else
+    HORN_SCHUNCK_WARP_LEVEL(f1_res, f2_res_warp, du, dv, u, v,
+                            nx_fine, ny_fine, bx, by, hx_fine, hy_fine,
+                            m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+                            num_iter_inner, num_iter_outer, n_omega, bt, opt,
+                            cached);
 
 /* ---- compute overall flow field at current resolution ------------------- */
   
 /* sum up flow increment */
 add_matrix_2d(u,du,u,nx_fine,ny_fine,bx,by);
 add_matrix_2d(v,dv,v,nx_fine,ny_fine,bx,by);
+bounds_mark_dirty(bt,u);
+bounds_mark_dirty(bt,v);
 //  printf (" current depth: -- %d -- \n", rec_depth);
 }
 
+/* ------------------------------------------------------------------------- */
+
+
+void HORN_SCHUNCK_WARP
+(
+                        /*****************************************************/
+float **f1_orig,        /* in     : 1st image (original resolution)          */
+float **f2_orig,        /* in     : 2nd image (original resolution)          */
+int   nx_orig,          /* in     : size in x-direction (original resolution)*/
+int   ny_orig,          /* in     : size in y-direction (original resoluiton)*/
+float ***f1_pyr,        /* in     : 1st image per recursion depth, or NULL   */
+float ***f2_pyr,        /* in     : 2nd image per recursion depth, or NULL   */
+float **f1_res,         /* in+out : 1st image, resampled                     */
+float **f2_res,         /* in+out : 2nd image, resampled                     */
+float **f2_res_warp,    /* in+out : 2nd image, resampled  and warped         */
+float **du,             /* in+out : x-component of flow increment            */
+float **dv,             /* in+out : y-component of flow increment            */
+float **u,              /* in+out : x-component of flow field                */
+float **v,              /* in+out : y-component of flow field                */
+float **tmp,            /* in+out : temporary aray for resampling            */
+int   nx_fine,          /* in     : size in x-direction (current resolution) */
+int   ny_fine,          /* in     : size in y-direction (current resolution) */
+int   bx,               /* in     : boundary size in x-direction             */
+int   by,               /* in     : boundary size in y-direction             */
+float hx_fine,          /* in     : spacing in x-direction (current resol.)  */
+float hy_fine,          /* in     : spacing in y-direction (current resol.)  */
+float m_alpha,          /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,   /* in     : inner solver iterations                  */
+int   num_iter_outer,   /* in     : outer nonlin update iterations           */
+float n_omega,          /* in     : SOR overrelaxation parameter             */
+float n_warp_eta,       /* in     : warping reduction factor between levels  */
+int   max_rec_depth,    /* in     : maximum recursion depth                  */
+int   rec_depth,        /* in     : finest recursion depth to be solved      */
+bounds_tracker *bt,     /* in+out : halo validity of the flow planes         */
+const hs_options *opt   /* in     : solver options                           */
+
+                        /*****************************************************/
+)
+
+/* implements warping for the Horn and Schunck method: solves the levels  */
+/* from max_rec_depth (coarsest) down to rec_depth one after the other,   */
+/* each starting from the flow of the one before                          */
+
+{
+                        /*****************************************************/
+int   d;                /* recursion depth of the current level              */
+int   nx, ny;           /* size of the current level                         */
+float hx, hy;           /* grid spacing of the current level                 */
+                        /*****************************************************/
+
+for (d=max_rec_depth; d>=rec_depth; d--)
+{
+    if (d == rec_depth)
+    {
+        nx = nx_fine;  ny = ny_fine;
+        hx = hx_fine;  hy = hy_fine;
+    }
+    else
+        horn_schunck_level_size(nx_orig,ny_orig,hx_fine,hy_fine,n_warp_eta,
+                                d,&nx,&ny,&hx,&hy);
+    horn_schunck_warp_step(f1_orig, f2_orig, nx_orig, ny_orig, f1_pyr, f2_pyr,
+                           f1_res, f2_res, f2_res_warp, du, dv, u, v, tmp,
+                           nx, ny, bx, by, hx, hy,
+                           m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+                           num_iter_inner, num_iter_outer, n_omega,
+                           n_warp_eta, max_rec_depth, d, bt, opt);
+}
+}
+
 
 
 /* ------------------------------------------------------------------------- */
 
+void horn_schunck_solve_pyramids
+(
+                         /*****************************************************/
+float **f1,              /* in     : 1st image                                */
+float **f2,              /* in     : 2nd image                                */
+float ***f1_pyr,         /* in     : pyramid of f1, read only                 */
+float ***f2_pyr,         /* in     : pyramid of f2, read only                 */
+float **u,               /* out    : x-component of displacement field        */
+float **v,               /* out    : y-component of displacement field        */
+int   nx,                /* in     : size in x-direction                      */
+int   ny,                /* in     : size in y-direction                      */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   max_rec_depth,     /* in     : maximum recursion depth of the pyramids  */
+const hs_options *opt    /* in     : solver options without cache             */
+                         /*****************************************************/
+)
+
+/* HORN_SCHUNCK_MAIN_OPT on prebuilt pyramids; the pyramids are only read, */
+/* so several threads may solve on the same pyramids at once              */
 
-void HORN_SCHUNCK_MAIN
+{
+                        /*****************************************************/
+float **du;             /* x-component of flow increment                     */
+float **dv;             /* y-component of flow increment                     */
+float **f2_res_warp;    /* 2nd image, resampled  and warped                  */
+float **tmp;            /* temporary array for resampling                    */
+bounds_tracker bt;      /* halo validity of the flow planes                  */
+                        /*****************************************************/
+
+/* the warped image is only needed after the resampling of a level, so */
+/* the low memory mode keeps it in the resampling buffer                */
+if (opt->low_memory)
+{
+    malloc_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&tmp);
+    f2_res_warp = tmp;
+}
+else
+    malloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f2_res_warp,&tmp);
+
+bounds_tracker_init(&bt);
+if (opt->stats)
+{
+    opt->stats->sor_sweeps  = 0;
+    opt->stats->sor_updates = 0.0;
+    opt->stats->omega_min  = 0.0f;
+    opt->stats->omega_max  = 0.0f;
+}
+HORN_SCHUNCK_WARP(f1, f2, nx, ny, f1_pyr, f2_pyr,
+		  NULL, NULL, f2_res_warp,
+		  du, dv, u, v, tmp,
+		  nx, ny, bx, by, hx, hy,
+		  m_alpha, epsilon_d, epsilon_s, w_bright_grad,
+		  num_iter_inner, num_iter_outer, n_omega, n_warp_eta,
+		  max_rec_depth,0,&bt,opt);
+if (opt->stats)
+{
+    opt->stats->halo_refreshes = bt.refreshes;
+    opt->stats->halo_skipped   = bt.skipped;
+}
+
+if (opt->low_memory)
+    free_multi(3,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&tmp);
+else
+    free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f2_res_warp,&tmp);
+}
+
+/* ------------------------------------------------------------------------- */
+
+
+void HORN_SCHUNCK_MAIN_OPT
 (
                          /*****************************************************/
 float **f1,              /* in     : 1st image                                */
@@ -775,7 +3583,8 @@ int   num_iter_inner,    /* in     : inner solver iterations                  */
 int   num_iter_outer,    /* in     : outer nonlin update iterations           */
 float n_warp_eta,        /* in     : warping reduction factor between levels  */
 float n_omega,
-int   n_warp_levels      /* in     : desired number of warping levels         */
+int   n_warp_levels,     /* in     : desired number of warping levels         */
+const hs_options *opt    /* in     : solver options, NULL for the defaults    */
                          /*****************************************************/
 )
 
@@ -792,8 +3601,21 @@ float **f2_res_warp;    /* 2nd image, resampled  and warped                  */
 float **tmp;            /* temporary array for resampling                    */
 int   max_rec_depth;    /* maximum recursion depth (warping level -1)        */
 int   n_warp_max_levels;/* maximum possible number of warping levels         */
+hs_options defaults;    /* options used for opt == NULL or without cache     */
+bounds_tracker bt;      /* halo validity of the flow planes                  */
+hs_cache *cache;        /* recompute cache, NULL for none                    */
+float ***f1_pyr;        /* cached pyramid of f1, NULL: resample per level    */
+float ***f2_pyr;        /* cached pyramid of f2                              */
+float key[10];          /* model parameters of this call                     */
+int   ikey[9];          /* iteration counts and options of this call         */
                         /*****************************************************/
 
+if (!opt)
+{
+    hs_default_options(&defaults);
+    opt = &defaults;
+}
+
 
 
 /* compute maximal number of warping levels given the downsampling factor eta 
@@ -805,28 +3627,181 @@ compute_max_warp_levels(nx,ny,n_warp_eta,&n_warp_max_levels);
 max_rec_depth=minimum(n_warp_levels,n_warp_max_levels)-1;
 
 
+/* ---- reuse cached stages ---- */
+
+cache  = opt->cache;
+f1_pyr = f2_pyr = NULL;
+if (cache)
+{
+    key[0] = hx;         key[1] = hy;          key[2] = m_alpha;
+    key[3] = epsilon_d;  key[4] = epsilon_s;   key[5] = w_bright_grad;
+    key[6] = n_warp_eta; key[7] = n_omega;     key[8] = opt->inner_tolerance;
+    key[9] = opt->line_omega;
+    ikey[0] = num_iter_inner;    ikey[1] = num_iter_outer;
+    ikey[2] = n_warp_levels;     ikey[3] = opt->sor_weights;
+    ikey[4] = opt->adaptive_omega; ikey[5] = opt->line_relax;
+    ikey[6] = opt->pcg;          ikey[7] = opt->tvl1;
+    ikey[8] = opt->tvl1_iterations;
+
+    if (!hs_cache_prepare(cache,f1,f2,nx,ny,bx,by,n_warp_eta,max_rec_depth))
+    {
+        /* solve without the cache */
+        defaults = *opt;
+        defaults.cache = NULL;
+        opt   = &defaults;
+        cache = NULL;
+    }
+    else if (cache->result_valid && !opt->init_flow &&
+             !memcmp(key,cache->key,sizeof(key)) &&
+             !memcmp(ikey,cache->ikey,sizeof(ikey)))
+    {
+        /* same pair, same parameters: return the last result */
+        copy_matrix_2d(cache->u,u,nx+2*bx,ny+2*by,0,0);
+        copy_matrix_2d(cache->v,v,nx+2*bx,ny+2*by,0,0);
+        cache->result_hits++;
+        if (opt->stats)
+            memset(opt->stats,0,sizeof(hs_stats));
+        return;
+    }
+    else
+    {
+        f1_pyr = cache->f1_pyr;
+        f2_pyr = cache->f2_pyr;
+    }
+}
+
+
 /* ---- alloc memory ---- */
 
-malloc_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
-             &f2_res_warp,&tmp);
+/* the warped image is only needed after the resampling of a level, so */
+/* the low memory mode keeps it in the resampling buffer                */
+if (opt->low_memory)
+{
+    malloc_multi(5,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
+                 &tmp);
+    f2_res_warp = tmp;
+}
+else
+    malloc_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
+                 &f2_res_warp,&tmp);
 
 /* call Horn/Schunck warping routine with desired number of levels */
-HORN_SCHUNCK_WARP(f1, f2, nx, ny,
+bounds_tracker_init(&bt);
+if (opt->stats)
+{
+    opt->stats->sor_sweeps  = 0;
+    opt->stats->sor_updates = 0.0;
+    opt->stats->omega_min  = 0.0f;
+    opt->stats->omega_max  = 0.0f;
+}
+HORN_SCHUNCK_WARP(f1, f2, nx, ny, f1_pyr, f2_pyr,
 		  f1_res, f2_res, f2_res_warp,
 		  du, dv, u, v, tmp,
 		  nx, ny, bx, by, hx, hy,
 		  m_alpha, epsilon_d, epsilon_s, w_bright_grad,
 		  num_iter_inner, num_iter_outer, n_omega, n_warp_eta,
-		  max_rec_depth,0);
+		  max_rec_depth,0,&bt,opt);
+
+
 
 
+if (opt->stats)
+{
+    opt->stats->halo_refreshes = bt.refreshes;
+    opt->stats->halo_skipped   = bt.skipped;
+}
 
+if (cache && !opt->init_flow)
+{
+    copy_matrix_2d(u,cache->u,nx+2*bx,ny+2*by,0,0);
+    copy_matrix_2d(v,cache->v,nx+2*bx,ny+2*by,0,0);
+    memcpy(cache->key,key,sizeof(key));
+    memcpy(cache->ikey,ikey,sizeof(ikey));
+    cache->result_valid = 1;
+}
 
 /* ---- free memory ---- */
-free_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
-           &f2_res_warp,&tmp);
+if (opt->low_memory)
+    free_multi(5,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
+               &tmp);
+else
+    free_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,&du,&dv,&f1_res,&f2_res,
+               &f2_res_warp,&tmp);
+
+
+}
+/* ------------------------------------------------------------------------- */
+
+
+void hs_default_options
+(
+ hs_options *opt          /* out    : default options                        */
+)
+
+/* sets the options that reproduce the original solver */
+
+{
+opt->stats           = NULL;
+opt->sor_weights     = 0;
+opt->adaptive_omega  = 0;
+opt->inner_tolerance = 0.0f;
+opt->line_relax      = 0;
+opt->line_omega      = 1.0f;
+opt->pcg             = 0;
+opt->tvl1            = 0;
+opt->tvl1_iterations = 50;
+opt->cache           = NULL;
+opt->init_flow       = 0;
+opt->low_memory      = 0;
+opt->tensor_storage  = HS_STORAGE_FLOAT32;
+opt->interleaved     = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+const char *hs_precision_policy
+(
+ void
+)
 
+/* name of the precision policy the kernels were built with (precision_lib.h) */
 
+{
+return OF_PRECISION_NAME;
 }
+
 /* ------------------------------------------------------------------------- */
 
+void HORN_SCHUNCK_MAIN
+(
+                         /*****************************************************/
+float **f1,              /* in     : 1st image                                */
+float **f2,              /* in     : 2nd image                                */
+float **u,               /* out    : x-component of displacement field        */
+float **v,               /* out    : y-component of displacement field        */
+int   nx,                /* in     : size in x-direction                      */
+int   ny,                /* in     : size in y-direction                      */
+int   bx,                /* in     : boundary size in x-direction             */
+int   by,                /* in     : boundary size in y-direction             */
+float hx,                /* in     : grid spacing in x-direction              */
+float hy,                /* in     : grid spacing in y-direction              */
+float m_alpha,           /* in     : smoothness weight                        */
+float epsilon_d,         /* in     : diffusivity param data term              */
+float epsilon_s,
+float w_bright_grad,
+int   num_iter_inner,    /* in     : inner solver iterations                  */
+int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+float n_warp_eta,        /* in     : warping reduction factor between levels  */
+float n_omega,
+int   n_warp_levels      /* in     : desired number of warping levels         */
+                         /*****************************************************/
+)
+
+/* computes optic flow with Horn/Schunck + Warping and the default options */
+
+{
+HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,hx,hy,m_alpha,epsilon_d,epsilon_s,
+                      w_bright_grad,num_iter_inner,num_iter_outer,n_warp_eta,
+                      n_omega,n_warp_levels,NULL);
+}
+/* ------------------------------------------------------------------------- */
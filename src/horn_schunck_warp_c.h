@@ -10,6 +10,141 @@
 #ifndef OF_HORN_SCHUNCK_INCLUDED
 #define OF_HORN_SCHUNCK_INCLUDED
 
+/* ---- solver options ----------------------------------------------------- */
+/* Implementation choices that do not change the model. HORN_SCHUNCK_MAIN    */
+/* uses the defaults of hs_default_options, HORN_SCHUNCK_MAIN_OPT takes      */
+/* them explicitly.                                                          */
+
+#define HS_OMEGA_MAX 1.99f /* upper limit of the estimated SOR omega        */
+
+/* storage of the motion tensor (hs_options tensor_storage)                  */
+#define HS_STORAGE_FLOAT32  0  /* float planes                               */
+#define HS_STORAGE_FLOAT16  1  /* IEEE half precision, F16C when compiled in */
+#define HS_STORAGE_BFLOAT16 2  /* upper 16 bits of a float                   */
+
+typedef struct
+{
+ long  halo_refreshes;    /* boundary mirrors done by the solver             */
+ long  halo_skipped;      /* boundary mirrors avoided (halo still valid)     */
+ long  sor_sweeps;        /* SOR sweeps (or PCG or TV-L1 iterations) done    */
+                          /*    over all levels                              */
+ double sor_updates;      /* pixels updated by these sweeps                  */
+ float omega_min;         /* smallest SOR omega used                         */
+ float omega_max;         /* largest SOR omega used                          */
+} hs_stats;
+
+/* ---- recompute cache ---------------------------------------------------- */
+/* Memoises the stages of HORN_SCHUNCK_MAIN_OPT between calls on the same    */
+/* image pair (hs_options cache): the resampled pyramids, per level the      */
+/* motion tensor of the incoming flow, and the last result. A stage is       */
+/* reused only if all its inputs are unchanged, so the flow is the same as   */
+/* without the cache. The images are identified by their pointers; call      */
+/* hs_cache_invalidate after changing their content.                         */
+
+typedef struct
+{
+ float **J[6];            /* J_11, J_22, J_33, J_12, J_13, J_23              */
+ int   nx, ny;            /* size of the planes, 0: not allocated            */
+ unsigned long long key;  /* hash of the incoming flow of the tensor         */
+ float w_bright_grad;     /* weight the tensor was computed with             */
+ int   valid;             /* 1: J holds the tensor of key                    */
+} hs_cache_level;
+
+typedef struct
+{
+ float **f1, **f2;        /* images of the pyramids, NULL: empty cache       */
+ int   nx, ny, bx, by;    /* size and boundaries of the images               */
+ float n_warp_eta;        /* reduction factor of the pyramids                */
+ int   depth;             /* number of pyramid levels                        */
+ float ***f1_pyr;         /* resampled 1st image per recursion depth         */
+ float ***f2_pyr;         /* resampled 2nd image per recursion depth         */
+ hs_cache_level *level;   /* motion tensor per recursion depth               */
+ long  tensor_budget;     /* bytes the cached tensors may take               */
+ long  tensor_bytes;      /* bytes the cached tensors take                   */
+ float **u, **v;          /* result of the last call                         */
+ float key[10];           /* model parameters of that result                 */
+ int   ikey[9];           /* iteration counts and options of that result     */
+ int   result_valid;      /* 1: u, v hold the result of key and ikey         */
+ long  pyramid_builds;    /* counters: pyramids built,                       */
+ long  tensor_hits;       /*    tensors reused,                              */
+ long  tensor_misses;     /*    tensors computed,                            */
+ long  result_hits;       /*    calls answered from the last result          */
+} hs_cache;
+
+#define HS_CACHE_TENSOR_BUDGET (256L << 20) /* default tensor budget, bytes */
+
+void hs_cache_init
+(
+ hs_cache *c              /* out    : empty cache                            */
+);
+
+void hs_cache_invalidate
+(
+ hs_cache *c              /* in+out : cache, emptied and memory released     */
+);
+
+typedef struct
+{
+ hs_stats *stats;         /* out: counters of the last call, NULL for none   */
+ int   sor_weights;       /* 1: assemble the SOR stencil weights and inverse */
+                          /*    diagonals once per outer iteration (default  */
+                          /*    0: recompute them in every sweep)            */
+ int   adaptive_omega;    /* 1: estimate the SOR omega on every warping      */
+                          /*    level instead of using n_omega (default 0)   */
+ float inner_tolerance;   /* > 0: stop the inner sweeps once the residual    */
+                          /*    has dropped by this factor, num_iter_inner   */
+                          /*    is the upper limit (default 0: always run    */
+                          /*    num_iter_inner sweeps)                       */
+ int   line_relax;        /* 1: alternating zebra line Gauss-Seidel instead  */
+                          /*    of pointwise SOR, one inner iteration relaxes*/
+                          /*    all x-lines and all y-lines (default 0)      */
+ float line_omega;        /* over-relaxation of the line solutions with      */
+                          /*    line_relax; n_omega and adaptive_omega only  */
+                          /*    apply to the point sweeps (default 1:        */
+                          /*    Gauss-Seidel)                                */
+ int   pcg;               /* 1, 2: preconditioned conjugate gradients with   */
+                          /*    point (1) or 2x2 block (2) Jacobi instead of */
+                          /*    SOR; num_iter_inner is the maximum number of */
+                          /*    iterations per outer iteration (default 0)   */
+ int   tvl1;              /* 1: primal-dual TV-L1 engine (brightness         */
+                          /*    constancy, m_alpha weights the TV term)      */
+                          /*    instead of the SOR model; epsilon_d,         */
+                          /*    epsilon_s, w_bright_grad, the iteration      */
+                          /*    counts and n_omega are not used (default 0)  */
+ int   tvl1_iterations;   /* primal-dual iterations per level (default 50)   */
+ hs_cache *cache;         /* recompute cache kept between calls, NULL for    */
+                          /*    none (default); not shared between threads   */
+ int   init_flow;         /* 1: u, v hold an initial flow on entry, the      */
+                          /*    coarsest level starts from it restricted     */
+                          /*    instead of from zero (default 0)             */
+ int   low_memory;        /* 1: derivatives are recomputed inside the tensor */
+                          /*    and smoothness updates instead of stored in  */
+                          /*    planes, and the warped image shares the      */
+                          /*    resampling buffer; same flow (default 0)     */
+ int   tensor_storage;    /* HS_STORAGE_*: storage of the motion tensor in   */
+                          /*    the plain SOR solver; 16 bit entries are     */
+                          /*    unpacked per column before it is swept;      */
+                          /*    not with the assembled solvers or a cache    */
+                          /*    (default HS_STORAGE_FLOAT32)                 */
+ int   interleaved;       /* 1: the plain SOR solver sweeps interleaved      */
+                          /*    copies: du, dv, u, v as one record and the   */
+                          /*    5 tensor entries it reads plus psi_prime_d   */
+                          /*    as another; same flow; not with the          */
+                          /*    assembled solvers or 16 bit storage          */
+                          /*    (default 0: separate planes)                 */
+} hs_options;
+
+void hs_default_options
+(
+ hs_options *opt          /* out    : default options                        */
+);
+
+const char *hs_precision_policy
+(
+ void                     /* name of the build's precision policy: legacy,   */
+                          /*    float, accumulate or double                  */
+);
+
 
 void HORN_SCHUNCK_MAIN
 (
@@ -36,6 +171,32 @@ void HORN_SCHUNCK_MAIN
 /*****************************************************/
 );
 
+void HORN_SCHUNCK_MAIN_OPT
+(
+ /*****************************************************/
+ float **f1,              /* in     : 1st image                                */
+ float **f2,              /* in     : 2nd image                                */
+ float **u,               /* out    : x-component of displacement field        */
+ float **v,               /* out    : y-component of displacement field        */
+ int   nx,                /* in     : size in x-direction                      */
+ int   ny,                /* in     : size in y-direction                      */
+ int   bx,                /* in     : boundary size in x-direction             */
+ int   by,                /* in     : boundary size in y-direction             */
+ float hx,                /* in     : grid spacing in x-direction              */
+ float hy,                /* in     : grid spacing in y-direction              */
+ float m_alpha,           /* in     : smoothness weight                        */
+ float epsilon_d,         /* in     : diffusivity param data term              */
+ float epsilon_s,
+ float w_bright_grad,
+ int   num_iter_inner,    /* in     : inner solver iterations                  */
+ int   num_iter_outer,    /* in     : outer nonlin update iterations           */
+ float n_warp_eta,        /* in     : warping reduction factor between levels  */
+ float n_omega,
+ int   n_warp_levels,     /* in     : desired number of warping levels         */
+ const hs_options *opt    /* in     : solver options, NULL for the defaults    */
+/*****************************************************/
+);
+
 void AllocateMem2D( float ***img, int nx, int ny);
 void DisallocateMem2D( float **img, int nx, int ny);
 
@@ -10,7 +10,9 @@ ext_modules = [Extension(
                include_dirs = [numpy.get_include()],  # .../site-packages/numpy/core/include
                language="c",
                # libraries=
-               # extra_compile_args = "...".split(),
+               # release flags of the headless core, see "make lib" in the
+               # Makefile; add -march=native for a machine specific build
+               extra_compile_args = "-O3 -DNDEBUG -std=gnu99 -fgnu89-inline".split(),
                # extra_link_args = "...".split()
                )]
 
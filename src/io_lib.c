@@ -19,6 +19,7 @@
 #include "malloc_lib.c"
 #include "console_lib.c"
 #include "funct_lib.c"
+#include "mmap_lib.c"
 /*****************************************************************************/
 /* Image types                                                               */
 /*****************************************************************************/
@@ -988,7 +989,7 @@ float **duplicate_pgm_image
     return NULL;
   }
 
-  memcpy(out[0], in[0], (nx + 2*bx) * (ny + 2*by) * sizeof(float));
+  memcpy(out[0], in[0], (size_t)(nx + 2*bx) * (ny + 2*by) * sizeof(float));
 
   return out;
 }
@@ -1088,7 +1089,7 @@ void read_barron_data
 }
 
 /* -------------------------------------------------------------------------- */
-void write_barron_data
+int write_barron_data
 (
     char *filename, /* in : file name */
     float **u,     /* in : x-component of vector data */
@@ -1099,13 +1100,15 @@ void write_barron_data
     int  by       /* in : boundary in y-direction */       
 )
 
-/* writes barron file */
+/* writes barron file; aborts the program if the file cannot be opened,    */
+/* returns 1 on success and 0 if writing failed                            */
 
 {
     FILE *file;   /* file pointer */
     float help;   /* tmp variable */
     int i,j;    /* loop variables */ 
     int offset; /* border size to crop (set fixed to 0) */ 
+    int ok;     /* 1 as long as all writes succeeded */
 
 //     printf("\n Trying to write barron file %s ...",filename);
     
@@ -1121,34 +1124,527 @@ void write_barron_data
     }
     
     /* write header */
+    ok = 1;
     help = nx;
-    fwrite (&help, 4, 1, file);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
     help = ny;
-    fwrite (&help, 4, 1, file);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
     offset=0;
     help = nx - 2 * offset;
-    fwrite (&help, 4, 1, file);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
     help = ny - 2 * offset;
-    fwrite (&help, 4, 1, file);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
     help = offset;
-    fwrite (&help, 4, 1, file);
-    fwrite (&help, 4, 1, file);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
+    ok &= (fwrite (&help, 4, 1, file) == 1);
 
     /* write data */
     for (j=by; j<ny+by; j++)
 	for (i=bx; i<nx+bx; i++)
 	{
 	    help = (float)u[i][j];
-	    fwrite (&help, 4, 1, file);
+	    ok &= (fwrite (&help, 4, 1, file) == 1);
 	    
 	    help = (float)v[i][j];
-	    fwrite (&help, 4, 1, file);
+	    ok &= (fwrite (&help, 4, 1, file) == 1);
 	}
        
-    /* close file */
-    fclose(file);
+    /* close file, this flushes the last buffered data */
+    if (fclose(file) != 0)
+	ok = 0;
+    if (!ok)
+	console_error("Could not write file %s!\n", filename);
     
 //     printf("... SUCCESS");
+    return ok;
+}
+
+/*****************************************************************************/
+/* Writes the same Barron file as write_barron_data, but for library use:    */
+/* the data go out with a single fwrite and every failure (open, write,      */
+/* flush on close) is reported instead of aborting the program.              */
+/* RETURNS 1 on success, 0 on failure.                                       */
+/*****************************************************************************/
+int write_barron_data_checked
+(
+  const char    *filename,      /* Name of file to be written                */
+  float         **u,            /* x-component of vector data                */
+  float         **v,            /* y-component of vector data                */
+  int           nx,             /* Size in x-direction                       */
+  int           ny,             /* Size in y-direction                       */
+  int           bx,             /* Boundary in X                             */
+  int           by              /* Boundary in Y                             */
+)
+{
+  FILE    *file;
+  float   *buffer;              /* header and data                           */
+  float   *p;
+  size_t  size;                 /* number of floats in buffer                */
+  int     i, j, ok;
+
+  size   = 6 + 2 * (size_t)nx * ny;
+  buffer = (float*)malloc(size * sizeof(float));
+  if (buffer == NULL)
+  {
+    console_error("Cannot allocate buffer for %s!\n", filename);
+    return 0;
+  }
+
+  /* header: size, size without the cropped border (none), border */
+  buffer[0] = (float)nx;
+  buffer[1] = (float)ny;
+  buffer[2] = (float)nx;
+  buffer[3] = (float)ny;
+  buffer[4] = 0.0f;
+  buffer[5] = 0.0f;
+
+  /* data: rows of interleaved (u,v) */
+  p = buffer + 6;
+  for (j = by; j < ny + by; j++)
+    for (i = bx; i < nx + bx; i++)
+    {
+      *p++ = u[i][j];
+      *p++ = v[i][j];
+    }
+
+  if ((file = fopen(filename, "wb")) == NULL)
+  {
+    console_error("Could not open file %s!\n", filename);
+    free(buffer);
+    return 0;
+  }
+  ok = (fwrite(buffer, sizeof(float), size, file) == size);
+  if (fclose(file) != 0)
+    ok = 0;
+  if (!ok)
+    console_error("Could not write file %s!\n", filename);
+  free(buffer);
+  return ok;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Memory mapped readers                                                     */
+/*                                                                           */
+/* The readers below map the whole file and decode the binary payload in     */
+/* one pass straight into the bx,by padded planes, instead of going through  */
+/* getline/fgetc/fread per value. They accept the same files as the stream   */
+/* readers above, but follow the netpbm definition for two-byte samples      */
+/* (big endian), and they report errors instead of aborting.                 */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Parses the header of a binary netpbm file (P5 or P6) in memory.           */
+/* RETURNS the offset of the first sample, or 0 on an error.                 */
+/*****************************************************************************/
+size_t parse_pnm_header
+(
+  const unsigned char *data,    /* Mapped file contents                      */
+  size_t        size,           /* Size of the file                          */
+  char          type,           /* Expected magic number ('5' or '6')        */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           *max_grey_value /* Returned maximal grey value               */
+)
+{
+  size_t       pos = 2;
+  int          field[3];
+  int          k;
+
+  if ((size < 2) || (data[0] != 'P') || (data[1] != type))
+    return 0;
+
+  /* Three decimal fields, separated by whitespace and comments              */
+  for (k = 0; k < 3; ++k)
+  {
+    while (pos < size)
+    {
+      if (data[pos] == '#')
+        while ((pos < size) && (data[pos] != '\n'))
+          ++pos;
+      else if ((data[pos] == ' ')  || (data[pos] == '\t') ||
+               (data[pos] == '\r') || (data[pos] == '\n'))
+        ++pos;
+      else
+        break;
+    }
+
+    if ((pos >= size) || (data[pos] < '0') || (data[pos] > '9'))
+      return 0;
+
+    field[k] = 0;
+    while ((pos < size) && (data[pos] >= '0') && (data[pos] <= '9'))
+    {
+      field[k] = 10 * field[k] + (data[pos] - '0');
+      if (field[k] > 65535 * 256)
+        return 0;
+      ++pos;
+    }
+  }
+
+  /* Exactly one whitespace character separates the header from the data   */
+  if (pos >= size)
+    return 0;
+
+  *width          = field[0];
+  *height         = field[1];
+  *max_grey_value = field[2];
+  return pos + 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Converts interleaved samples of one channel of a binary netpbm image into */
+/* a padded plane. The file is stored row by row while the planes are stored */
+/* column by column, so the copy is a transpose; it is done in blocks of     */
+/* PNM_BLOCK x PNM_BLOCK pixels such that both sides stay in the cache.      */
+/*****************************************************************************/
+#define PNM_BLOCK 32
+
+void decode_pnm_plane
+(
+  const unsigned char *src,     /* First sample of the channel               */
+  int           channels,       /* Samples per pixel (1 or 3)                */
+  int           bytes,          /* Bytes per sample (1 or 2)                 */
+  float         **image,        /* Output plane                              */
+  int           width,          /* Width of the image                        */
+  int           height,         /* Height of the image                       */
+  int           bx,             /* Boundary in X                             */
+  int           by              /* Boundary in Y                             */
+)
+{
+  size_t       step  = (size_t)channels * bytes;
+  size_t       row   = step * width;
+  int          i0, j0, i, j, imax, jmax;
+
+  for (i0 = 0; i0 < width; i0 += PNM_BLOCK)
+  {
+    imax = (i0 + PNM_BLOCK < width) ? i0 + PNM_BLOCK : width;
+
+    for (j0 = 0; j0 < height; j0 += PNM_BLOCK)
+    {
+      jmax = (j0 + PNM_BLOCK < height) ? j0 + PNM_BLOCK : height;
+
+      if (bytes == 1)
+      {
+        for (i = i0; i < imax; ++i)
+        {
+          const unsigned char *p   = src + i * step;
+          float               *out = image[i + bx] + by;
+
+          for (j = j0; j < jmax; ++j)
+            out[j] = (float)p[j * row];
+        }
+      }
+      else
+      {
+        for (i = i0; i < imax; ++i)
+        {
+          const unsigned char *p   = src + i * step;
+          float               *out = image[i + bx] + by;
+
+          for (j = j0; j < jmax; ++j)
+            out[j] = (float)((p[j * row] << 8) | p[j * row + 1]);
+        }
+      }
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Maps a P5/P6 file and checks its header against the payload size.         */
+/* RETURNS the offset of the first sample, or 0 on an error (the file is     */
+/*         unmapped then).                                                   */
+/*****************************************************************************/
+size_t map_pnm_file
+(
+  const char    *filename,      /* Name of file to be read                   */
+  char          type,           /* Expected magic number ('5' or '6')        */
+  int           channels,       /* Samples per pixel (1 or 3)                */
+  mapped_file   *map,           /* Returned mapping                          */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           *max_grey_value,/* Returned maximal grey value               */
+  int           *bytes          /* Returned bytes per sample                 */
+)
+{
+  size_t       offset;
+
+  *width = 0; *height = 0; *max_grey_value = 0;
+
+  if (!map_file_read(filename, map))
+    return 0;
+
+  offset = parse_pnm_header((const unsigned char*)map->data, map->size, type,
+                            width, height, max_grey_value);
+  if (!offset || (*width == 0) || (*height == 0) || (*max_grey_value == 0))
+  {
+    console_error("File %s is not of type %s!\n", filename,
+                  (type == '5') ? "PGM" : "PPM");
+    unmap_file(map);
+    *width = 0; *height = 0;
+    return 0;
+  }
+
+  if (*max_grey_value >= 65536)
+  {
+    console_error("Unexpected max grey value in file %s!\n", filename);
+    unmap_file(map);
+    *width = 0; *height = 0;
+    return 0;
+  }
+  *bytes = (*max_grey_value < 256) ? 1 : 2;
+
+  if (map->size - offset <
+      (size_t)*width * (size_t)*height * (size_t)(channels * *bytes))
+  {
+    console_error("Unexpected end of file %s!\n", filename);
+    unmap_file(map);
+    *width = 0; *height = 0;
+    return 0;
+  }
+
+  return offset;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Read in a one-byte or two-byte PGM file through a memory mapping.         */
+/* Same interface and memory layout as read_pgm_image_padded; the image is   */
+/* freed with free_pgm_image.                                                */
+/*****************************************************************************/
+float **read_pgm_image_mapped_padded
+(
+  const char    *filename,      /* Name of file to be read                   */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           bx,             /* Boundary in X                             */
+  int           by,             /* Boundary in Y                             */
+  int           *max_grey_value,/* Maximal grey value                        */
+  int           padding_x,      /* Padding to that many elements in x dir.   */
+  int           padding_y,      /* Padding to that many elements in y dir.   */
+  int           *memwidth,      /* Return: Resulting #elements in memory (x) */
+  int           *memheight      /* Return: Resulting #elements in memory (y) */
+)
+{
+  mapped_file  map;
+  float        **image;
+  size_t       offset;
+  int          bytes;
+
+  *memwidth = 0; *memheight = 0;
+
+  offset = map_pnm_file(filename, '5', 1, &map, width, height,
+                        max_grey_value, &bytes);
+  if (!offset)
+    return NULL;
+
+  if ((padding_x < 1) || (padding_y < 1))
+  {
+    console_error("Please specify meaningful paddings (default: 1)!");
+    unmap_file(&map);
+    *width = 0; *height = 0;
+    return NULL;
+  }
+  *memwidth  = ((*width  - 1) / padding_x + 1) * padding_x;
+  *memheight = ((*height - 1) / padding_y + 1) * padding_y;
+
+  /* Allocate the image array                                                */
+  calloc_multi(1,         2,          sizeof(float),
+               *memwidth, *memheight,
+               bx,        by,
+               0,         0,
+               &image);
+
+  decode_pnm_plane((const unsigned char*)map.data + offset, 1, bytes,
+                   image, *width, *height, bx, by);
+
+  unmap_file(&map);
+  return image;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Read in a one-byte or two-byte PGM file through a memory mapping.         */
+/* Same interface as read_pgm_image.                                         */
+/*****************************************************************************/
+float **read_pgm_image_mapped
+(
+  const char    *filename,      /* Name of file to be read                   */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           bx,             /* Boundary in X                             */
+  int           by,             /* Boundary in Y                             */
+  int           *max_grey_value /* Maximal grey value                        */
+)
+{
+  int    memwidth, memheight;
+  return read_pgm_image_mapped_padded(filename, width, height, bx, by,
+                                      max_grey_value, 1, 1,
+                                      &memwidth, &memheight);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Read in a one-byte or two-byte PPM file through a memory mapping.         */
+/* Same interface and memory layout as read_ppm_image_padded; the image is   */
+/* freed with free_ppm_image.                                                */
+/*****************************************************************************/
+float ***read_ppm_image_mapped_padded
+(
+  const char    *filename,      /* Name of file to be read                   */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           bx,             /* Boundary in X                             */
+  int           by,             /* Boundary in Y                             */
+  int           *max_grey_value,/* Maximal grey value                        */
+  int           padding_x,      /* padding to that many elements in x dir.   */
+  int           padding_y,      /* padding to that many elements in y dir.   */
+  int           *memwidth,      /* Return: Resulting #elements in memory (x) */
+  int           *memheight      /* Return: Resulting #elements in memory (y) */
+)
+{
+  mapped_file  map;
+  float        ***image;
+  size_t       offset;
+  int          bytes, c;
+
+  *memwidth = 0; *memheight = 0;
+
+  offset = map_pnm_file(filename, '6', 3, &map, width, height,
+                        max_grey_value, &bytes);
+  if (!offset)
+    return NULL;
+
+  if ((padding_x < 1) || (padding_y < 1))
+  {
+    console_error("Please specify meaningful paddings (default: 1)!");
+    unmap_file(&map);
+    *width = 0; *height = 0;
+    return NULL;
+  }
+  *memwidth  = ((*width  - 1) / padding_x + 1) * padding_x;
+  *memheight = ((*height - 1) / padding_y + 1) * padding_y;
+
+  /* Allocate the image array                                                */
+  malloc_multi(1, 3,         sizeof(float),
+               3, *memwidth, *memheight,
+               0, bx,        by,
+               0, 0,         0,
+               &image);
+
+  for (c = 0; c < 3; ++c)
+    decode_pnm_plane((const unsigned char*)map.data + offset + c * bytes,
+                     3, bytes, image[c], *width, *height, bx, by);
+
+  unmap_file(&map);
+  return image;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Read in a one-byte or two-byte PPM file through a memory mapping.         */
+/* Same interface as read_ppm_image.                                         */
+/*****************************************************************************/
+float ***read_ppm_image_mapped
+(
+  const char    *filename,      /* Name of file to be read                   */
+  int           *width,         /* Returned image width                      */
+  int           *height,        /* Returned image height                     */
+  int           bx,             /* Boundary in X                             */
+  int           by,             /* Boundary in Y                             */
+  int           *max_grey_value /* Maximal grey value                        */
+)
+{
+  int    memwidth, memheight;
+  return read_ppm_image_mapped_padded(filename, width, height, bx, by,
+                                      max_grey_value, 1, 1,
+                                      &memwidth, &memheight);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Reads a Barron .F file through a memory mapping, straight from the        */
+/* mapped (cropped) payload into u and v without a temporary array.          */
+/* RETURNS 1 on success, and 0 on an error (unlike read_barron_data, which   */
+/*         aborts the program).                                              */
+/*****************************************************************************/
+int read_barron_data_mapped
+(
+  const char    *filename,      /* Name of file to be read                   */
+  float         **u,            /* x-component of vector data                */
+  float         **v,            /* y-component of vector data                */
+  int           nx,             /* Size in x-direction                       */
+  int           ny,             /* Size in y-direction                       */
+  int           bx,             /* Boundary in X                             */
+  int           by              /* Boundary in Y                             */
+)
+{
+  mapped_file  map;
+  const float  *data;
+  int          nxref, nyref, offsetx, offsety;
+  int          i, j;
+
+  if (!map_file_read(filename, &map))
+    return 0;
+
+  if (map.size < 6 * sizeof(float))
+  {
+    console_error("Unexpected end of file %s!\n", filename);
+    unmap_file(&map);
+    return 0;
+  }
+
+  /* Header: full size, size without the crop offset, and the offset        */
+  data    = (const float*)map.data;
+  nxref   = (int)data[0];
+  nyref   = (int)data[1];
+  offsetx = (int)data[4];
+  offsety = (int)data[5];
+
+  if ((nx != (int)data[2]) || (ny != (int)data[3]) ||
+      (offsetx < 0) || (offsety < 0) ||
+      (nx + offsetx > nxref) || (ny + offsety > nyref))
+  {
+    console_error("Wrong dimensions in file %s!\n", filename);
+    unmap_file(&map);
+    return 0;
+  }
+
+  if ((map.size - 6 * sizeof(float)) / (2 * sizeof(float)) <
+      (size_t)nxref * (size_t)nyref)
+  {
+    console_error("Unexpected end of file %s!\n", filename);
+    unmap_file(&map);
+    return 0;
+  }
+
+  /* The payload is stored row by row with interleaved (u,v) pairs          */
+  data += 6;
+  for (i = 0; i < nx; ++i)
+  {
+    const float *p    = data + 2 * ((size_t)offsety * nxref + offsetx + i);
+    float       *outu = u[i + bx] + by;
+    float       *outv = v[i + bx] + by;
+
+    for (j = 0; j < ny; ++j)
+    {
+      outu[j] = p[2 * (size_t)j * nxref];
+      outv[j] = p[2 * (size_t)j * nxref + 1];
+    }
+  }
+
+  unmap_file(&map);
+  return 1;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -9,18 +9,254 @@
 /*                 Saarland University, Germany                              */
 /*                                                                           */
 /* Version 1.01 (2010-09-15)                                                 */
+/*                                                                           */
+/* Sizes and offsets are size_t, so structures of more than 2^31 bytes or    */
+/* elements can be allocated; widths and bounds stay int.                    */
+/*                                                                           */
+/* The data block of a structure is placed according to an allocation        */
+/* policy (malloc_multi_policy): plain heap memory, 64 byte aligned, 2 MB    */
+/* aligned and advised for transparent huge pages, or explicit huge pages    */
+/* from hugetlbfs.                                                           */
+/*                                                                           */
+/* Only the start of a data block is aligned. The rows of a structure are    */
+/* packed without padding (callers copy whole planes with one memcpy), so a  */
+/* row of ny+2*by floats and its interior by floats further in are in        */
+/* general not 64 byte aligned, and kernels cannot use aligned SIMD loads    */
+/* on them.                                                                  */
+/*                                                                           */
+/* The bytes of all live data blocks and their peak are counted; see         */
+/* malloc_multi_usage. Pointer tables and block headers are not counted.     */
 /*****************************************************************************/
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #include "console_lib.c"
 
+/* Allocation policies for the data blocks of malloc_multi                   */
+#define MALLOC_MULTI_PLAIN    0   /* malloc / calloc                         */
+#define MALLOC_MULTI_ALIGNED  1   /* 64 byte aligned block start             */
+#define MALLOC_MULTI_THP      2   /* 2 MB aligned, MADV_HUGEPAGE             */
+#define MALLOC_MULTI_HUGETLB  3   /* MAP_HUGETLB, falls back to THP          */
+
+#define PG_BLOCK_HEADER       64          /* bytes in front of a data block  */
+#define PG_HUGE_PAGE          (2UL << 20) /* huge page size                  */
+
+/* Bookkeeping in front of every data block                                  */
+typedef struct
+{
+  void   *base;         /* start of the allocation                           */
+  size_t mapped;        /* bytes mapped with mmap, 0 for heap memory         */
+  size_t bytes;         /* requested size of the data block                  */
+} pg_block_header;
+
+/* Policy of new allocations; set before the structures are allocated        */
+static int pg_malloc_policy = MALLOC_MULTI_PLAIN;
+
+/* Bytes in live data blocks, and their maximum since the last reset         */
+static size_t pg_bytes_current = 0;
+static size_t pg_bytes_peak    = 0;
 
 /* Prototypes for private routines (to suppress warnings)                    */
 int  malloc_multi_create_hierarchy
-     (int, int, int, int*, int*, void*, int, int);
+     (int, int, size_t, int*, int*, void*, int, int);
 void free_multi_destroy_hierarchy (void**, int, int);
+char *malloc_multi_block          (size_t, int);
+void free_multi_block             (void*);
+
+/*****************************************************************************/
+/* Select the allocation policy of all following malloc_multi/calloc_multi   */
+/* calls. MALLOC_MULTI_HUGETLB is probed once; without reserved huge pages   */
+/* it falls back to MALLOC_MULTI_THP with a warning. A negative policy only  */
+/* queries the current one.                                                  */
+/*                                                                           */
+/* RETURNS the previous policy                                               */
+/*****************************************************************************/
+int malloc_multi_policy
+(
+  int   policy          /* one of the MALLOC_MULTI_* policies, or -1         */
+)
+{
+  int   previous = pg_malloc_policy;
+  void  *probe;
+
+  if (policy < 0)
+    return previous;
+  if ((policy < MALLOC_MULTI_PLAIN) || (policy > MALLOC_MULTI_HUGETLB))
+  {
+    console_error("Unknown allocation policy %d!", policy);
+    return previous;
+  }
+
+  if (policy == MALLOC_MULTI_HUGETLB)
+  {
+    probe = mmap(NULL, PG_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (probe == MAP_FAILED)
+    {
+      console_warning("No huge pages reserved (vm.nr_hugepages), "
+                      "using transparent huge pages instead.");
+      policy = MALLOC_MULTI_THP;
+    }
+    else
+      munmap(probe, PG_HUGE_PAGE);
+  }
+
+  pg_malloc_policy = policy;
+  return previous;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Report the bytes held in data blocks of malloc_multi/calloc_multi right   */
+/* now and at most since the start or the last malloc_multi_reset_peak.      */
+/* Either pointer may be NULL.                                               */
+/*****************************************************************************/
+void malloc_multi_usage
+(
+  size_t *current,      /* out: bytes in live data blocks                    */
+  size_t *peak          /* out: peak of these bytes                          */
+)
+{
+  if (current)
+    *current = __atomic_load_n(&pg_bytes_current, __ATOMIC_RELAXED);
+  if (peak)
+    *peak = __atomic_load_n(&pg_bytes_peak, __ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Restart the peak of malloc_multi_usage at the bytes held right now.       */
+/*                                                                           */
+/* RETURNS the peak before the reset                                         */
+/*****************************************************************************/
+size_t malloc_multi_reset_peak
+(
+  void
+)
+{
+  size_t current = __atomic_load_n(&pg_bytes_current, __ATOMIC_RELAXED);
+
+  return __atomic_exchange_n(&pg_bytes_peak, current, __ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Allocate a data block of the given size under the current policy. The     */
+/* block starts PG_BLOCK_HEADER bytes behind the base, so it keeps the       */
+/* 64 byte (or larger) alignment of the base. Blocks on huge pages are       */
+/* additionally shifted by a rotating colour of 4160 bytes, since blocks     */
+/* that all start at the same offset in a 2 MB page compete for the same     */
+/* cache sets.                                                               */
+/*                                                                           */
+/* RETURNS the block, or NULL on failure                                     */
+/*****************************************************************************/
+char *malloc_multi_block
+(
+  size_t bytes,         /* size of the block                                 */
+  int    zero           /* 1: the block is cleared (calloc_multi)            */
+)
+{
+  static unsigned int colours = 0;
+  pg_block_header *h;
+  void   *base   = NULL;
+  size_t mapped  = 0;
+  size_t colour  = 0;
+  size_t current, peak;
+  size_t total   = bytes + PG_BLOCK_HEADER;
+  int    policy  = pg_malloc_policy;
+
+  /* blocks below one huge page gain nothing from huge pages               */
+  if ((policy >= MALLOC_MULTI_THP) && (total < PG_HUGE_PAGE))
+    policy = MALLOC_MULTI_ALIGNED;
+  if (policy >= MALLOC_MULTI_THP)
+  {
+    colour = (__sync_fetch_and_add(&colours,1) % 16) * (4096 + 64);
+    total += colour;
+  }
+
+  if (policy == MALLOC_MULTI_HUGETLB)
+  {
+    mapped = (total + PG_HUGE_PAGE - 1) / PG_HUGE_PAGE * PG_HUGE_PAGE;
+    base   = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base == MAP_FAILED)
+    {
+      /* pool exhausted: this block goes to transparent huge pages         */
+      base   = NULL;
+      mapped = 0;
+      policy = MALLOC_MULTI_THP;
+    }
+  }
+
+  if (policy == MALLOC_MULTI_PLAIN)
+    base = zero ? calloc(1, total) : malloc(total);
+  else if (policy == MALLOC_MULTI_ALIGNED)
+  {
+    if (posix_memalign(&base, 64, total) != 0)
+      base = NULL;
+    else if (zero)
+      memset(base, 0, total);
+  }
+  else if (policy == MALLOC_MULTI_THP)
+  {
+    if (posix_memalign(&base, PG_HUGE_PAGE, total) != 0)
+      base = NULL;
+    else
+    {
+      /* only the whole huge pages inside the block                      */
+      madvise(base, total / PG_HUGE_PAGE * PG_HUGE_PAGE, MADV_HUGEPAGE);
+      if (zero)
+        memset(base, 0, total);
+    }
+  }
+
+  if (!base)
+    return NULL;
+
+  h = (pg_block_header*)((char*)base + colour);
+  h->base   = base;
+  h->mapped = mapped;
+  h->bytes  = bytes;
+
+  /* raise the peak; other threads may allocate at the same time, and a    */
+  /* failed exchange reloads peak                                          */
+  current = __atomic_add_fetch(&pg_bytes_current, bytes, __ATOMIC_RELAXED);
+  peak    = __atomic_load_n(&pg_bytes_peak, __ATOMIC_RELAXED);
+  while ((current > peak) &&
+         !__atomic_compare_exchange_n(&pg_bytes_peak, &peak, current, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+
+  return (char*)h + PG_BLOCK_HEADER;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*****************************************************************************/
+/* Release a data block of malloc_multi_block                                */
+/*****************************************************************************/
+void free_multi_block
+(
+  void  *block          /* block to be released                              */
+)
+{
+  pg_block_header *h = (pg_block_header*)((char*)block - PG_BLOCK_HEADER);
+
+  __atomic_sub_fetch(&pg_bytes_current, h->bytes, __ATOMIC_RELAXED);
+  if (h->mapped)
+    munmap(h->base, h->mapped);
+  else
+    free(h->base);
+}
+
+/* ------------------------------------------------------------------------- */
 
 /*****************************************************************************/
 /* Some preprocessor stuff for the malloc_multi routine...                   */
@@ -49,7 +285,7 @@ int malloc_multi_create_hierarchy
 (
   int   number,         /* number of similar structures to allocate          */
   int   dimensions,     /* depth of each structure                           */
-  int   remaining,      /* remaining number of elements for this subtree     */
+  size_t remaining,     /* remaining number of elements for this subtree     */
   int   *n,             /* list of widths of the single stages               */
   int   *b,             /* list of bounds of the single stages               */
   void  *p,             /* list of pointers to the different structures      */
@@ -59,11 +295,11 @@ int malloc_multi_create_hierarchy
 {
   char  ***pointer = (char***)p;
   char  **levelmem;
-  int   levelsize, stepsize;
-  int   i;
+  size_t levelsize, stepsize;
+  size_t i;
 
   /* Allocate enough pointer space for the now finest level                  */
-  stepsize  = n[dimensions-1] + 2*b[dimensions-1];
+  stepsize  = (size_t)(n[dimensions-1] + 2*b[dimensions-1]);
   remaining = remaining / stepsize;
 
   if (!firstcall)
@@ -87,7 +323,7 @@ int malloc_multi_create_hierarchy
     levelmem[i] = &(levelmem[i-1][stepsize]);
 
   /* Relink the topmost layer                                                */
-  for (i = 0; i < number; ++i)
+  for (i = 0; i < (size_t)number; ++i)
     *pointer[i] = (char*)&(levelmem[remaining * i]);
 
   /* Recurse with the next coarser level                                     */
@@ -139,7 +375,7 @@ int malloc_multi_create_hierarchy
 /*                                                                           */
 /* RETURNS 1 on success and 0 on failure                                     */
 /*****************************************************************************/
-#define PG_GENERATE_MALLOC_MULTI(PG_MALLOC_TYPE,PG_MALLOC_CONTENT)            \
+#define PG_GENERATE_MALLOC_MULTI(PG_MALLOC_TYPE,PG_MALLOC_ZERO)               \
 int PG_MALLOC_TYPE##_multi                                                    \
 (                                                                             \
   int   number,         /* Number of structures to allocate                */ \
@@ -158,9 +394,9 @@ int PG_MALLOC_TYPE##_multi                                                    \
   char          **levelmem;           /* coarsest dimension (contain. ptrs)*/ \
   int           i, j;                 /* loop counters                     */ \
   int           is_pyramid;           /* flag determining the pyramid case */ \
-  int           totalsize, layersize; /* sizes for ~mem                    */ \
+  size_t        totalsize, layersize; /* sizes for ~mem (in elements)      */ \
   char          **helppointer;        /* helper                            */ \
-  int           *offset = NULL;       /* widths of the pyramid levels      */ \
+  size_t        *offset = NULL;       /* byte sizes of the pyramid levels  */ \
                                                                               \
   va_start(arguments, elementsize);                                           \
                                                                               \
@@ -194,7 +430,7 @@ int PG_MALLOC_TYPE##_multi                                                    \
   /* Compute total amount of storage needed                                */ \
   if (is_pyramid)                                                             \
   {                                                                           \
-    offset = (int*)malloc(n[0] * sizeof(int));                                \
+    offset = (size_t*)malloc(n[0] * sizeof(size_t));                          \
                                                                               \
     if (!offset)                                                              \
     {                                                                         \
@@ -238,13 +474,13 @@ int PG_MALLOC_TYPE##_multi                                                    \
       layersize = 1;                                                          \
       for (j = 1; j < dimensions; ++j)                                        \
       {                                                                       \
-        layersize *= npyr[i][j] + 2 * b[j];                                   \
+        layersize *= (size_t)(npyr[i][j] + 2 * b[j]);                         \
         if (r[j])                                                             \
           npyr[i+1][j] = npyr[i][j] / 2 + npyr[i][j] % 2;                     \
         else                                                                  \
           npyr[i+1][j] = n[j];                                                \
       }                                                                       \
-      offset[i]  = layersize * elementsize;                                   \
+      offset[i]  = layersize * (size_t)elementsize;                           \
       totalsize += layersize;                                                 \
     }                                                                         \
   }                                                                           \
@@ -253,11 +489,12 @@ int PG_MALLOC_TYPE##_multi                                                    \
     totalsize = 1;                                                            \
                                                                               \
     for (i = 0; i < dimensions; ++i)                                          \
-      totalsize *= n[i] + 2 * b[i];                                           \
+      totalsize *= (size_t)(n[i] + 2 * b[i]);                                 \
   }                                                                           \
                                                                               \
   /* Allocate that much storage                                            */ \
-  totalmem = (char*)PG_MALLOC_TYPE(PG_MALLOC_CONTENT);                        \
+  totalmem = malloc_multi_block(totalsize * number * elementsize,             \
+                                PG_MALLOC_ZERO);                              \
                                                                               \
   if (!totalmem)                                                              \
   {                                                                           \
@@ -289,7 +526,7 @@ int PG_MALLOC_TYPE##_multi                                                    \
     {                                                                         \
       console_error("Cannot allocate level memory block!");                   \
                                                                               \
-      free(totalmem);                                                         \
+      free_multi_block(totalmem);                                             \
                                                                               \
       for (j = 0; j <= n[0]; ++j)                                             \
         free(npyr[j]);                                                        \
@@ -309,7 +546,7 @@ int PG_MALLOC_TYPE##_multi                                                    \
     /* Topmost layer                                                       */ \
     for (i = 0; i < number; ++i)                                              \
     {                                                                         \
-      levelmem[i * n[0]] = &(totalmem[i * totalsize * elementsize]);          \
+      levelmem[i * n[0]] = &(totalmem[(size_t)i * totalsize * elementsize]);  \
       *p[i] = levelmem + i * n[0];                                            \
     }                                                                         \
                                                                               \
@@ -336,7 +573,7 @@ int PG_MALLOC_TYPE##_multi                                                    \
             console_error("Cannot allocate memory hierarchy!");               \
                                                                               \
             free(levelmem);                                                   \
-            free(totalmem);                                                   \
+            free_multi_block(totalmem);                                       \
                                                                               \
             for (j = 0; j <= n[0]; ++j)                                       \
               free(npyr[j]);                                                  \
@@ -358,14 +595,14 @@ int PG_MALLOC_TYPE##_multi                                                    \
   {                                                                           \
     /* This is the easy case: No pyramids, but 'cubical' objects           */ \
     for (i = 0; i < number; ++i)                                              \
-      *p[i] = &(totalmem[i * totalsize * elementsize]);                       \
+      *p[i] = &(totalmem[(size_t)i * totalsize * elementsize]);               \
                                                                               \
     if (dimensions > 1)                                                       \
       if (!malloc_multi_create_hierarchy(number, dimensions, totalsize,       \
                                          n, b, p, 1, elementsize))            \
       {                                                                       \
         console_error("Cannot allocate memory hierarchy!");                   \
-        free(totalmem);                                                       \
+        free_multi_block(totalmem);                                           \
                                                                               \
         return 0;                                                             \
       }                                                                       \
@@ -375,9 +612,8 @@ int PG_MALLOC_TYPE##_multi                                                    \
 }
 
 /* Generate the malloc_multi and the calloc_multi function                   */
-#define PG_COMMA ,
-PG_GENERATE_MALLOC_MULTI(malloc, totalsize * number * elementsize)
-PG_GENERATE_MALLOC_MULTI(calloc, elementsize PG_COMMA totalsize * number)
+PG_GENERATE_MALLOC_MULTI(malloc, 0)
+PG_GENERATE_MALLOC_MULTI(calloc, 1)
 
 /* ------------------------------------------------------------------------- */
 
@@ -394,8 +630,10 @@ void free_multi_destroy_hierarchy
   if (dimensions > 0)
     free_multi_destroy_hierarchy((void**)*p, dimensions - 1, destroy_finest);
 
-  if (destroy_finest || (dimensions > 0))
+  if (dimensions > 0)
     free(p);
+  else if (destroy_finest)
+    free_multi_block(p);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -38,7 +38,7 @@ float mean_val
 	int by
 )
 {
-	return sum(u,nx,ny,bx,by) / ((float)(nx*ny));
+	return sum(u,nx,ny,bx,by) / ((float)nx*ny);
 }
 
 //=================================================
@@ -137,7 +137,7 @@ float var
 	for (i=bx; i<nx+bx; i++)
 		for (j=by; j<ny+by; j++)
 			var += (u[i][j]-mean)*(u[i][j]-mean);
-	return var / ((float)(nx*ny));
+	return var / ((float)nx*ny);
 }
 
 
@@ -159,7 +159,7 @@ float var_twin
 		for (j=by; j<ny+by; j++)
 			var += (double)( (u[i][j]-mean)*(u[i][j]-mean) 
 			               + (v[i][j]-mean)*(v[i][j]-mean) );
-	return (float)(var / ((double)(2*nx*ny)));
+	return (float)(var / (2.0*nx*ny));
 }
 
 float var_twin_A
@@ -190,7 +190,7 @@ float var_twin_A
 				(um*(A11[i][j]*um+A12[i][j]*vm)
 				+vm*(A12[i][j]*um+A22[i][j]*vm));
 		}
-	return (float)(var / ((double)(2*nx*ny)));
+	return (float)(var / (2.0*nx*ny));
 }
 
 float cov
@@ -212,7 +212,7 @@ float cov
 	for (i=bx; i<nx+bx; i++)
 		for (j=by; j<ny+by; j++)
 			cov += (u[i][j]-meanu)*(v[i][j]-meanv);
-	return cov/((float)(nx*ny-1));
+	return cov/((float)nx*ny-1.0f);
 }
 
 float corr
@@ -263,7 +263,7 @@ float cov_twin_A
 			cov += u1m*(v1m*A11[i][j]+v2m*A12[i][j]) 
 			          + u2m*(v1m*A12[i][j]+v2m*A22[i][j]);
 		}
-	return cov/((float)(2*nx*ny-1));
+	return cov/(2.0f*nx*ny-1.0f);
 }
 
 float corr_twin_A
@@ -0,0 +1,132 @@
+#ifndef MMAP_LIB_INCLUDED
+#define MMAP_LIB_INCLUDED
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Memory mapped files for bulk reading and writing of image and flow data.  */
+/* Read mappings are private and read-only, write mappings are shared and   */
+/* back a file of fixed size that is created or truncated on opening.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "console_lib.c"
+#include "mmap_lib.h"
+
+/*---------------------------------------------------------------------------*/
+
+int map_file_read
+(
+                          /***************************************************/
+    const char  *filename,/* in  : file to be mapped                         */
+    mapped_file *m        /* out : mapping                                   */
+                          /***************************************************/
+)
+
+/* maps a whole file read-only; returns 1 on success and 0 on failure */
+
+{
+struct stat st;
+
+memset(m,0,sizeof(mapped_file));
+m->fd = -1;
+
+if ((m->fd = open(filename,O_RDONLY)) < 0)
+{
+    console_error("Could not open file %s!\n", filename);
+    return 0;
+}
+if ((fstat(m->fd,&st) != 0) || (st.st_size == 0))
+{
+    console_error("Could not map empty file %s!\n", filename);
+    close(m->fd);
+    m->fd = -1;
+    return 0;
+}
+
+m->size = (size_t)st.st_size;
+m->data = mmap(NULL,m->size,PROT_READ,MAP_PRIVATE,m->fd,0);
+if (m->data == MAP_FAILED)
+{
+    console_error("Could not map file %s!\n", filename);
+    close(m->fd);
+    m->data = NULL;
+    m->fd   = -1;
+    return 0;
+}
+
+/* the readers stream through the data once */
+madvise(m->data,m->size,MADV_SEQUENTIAL);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int map_file_write
+(
+                          /***************************************************/
+    const char  *filename,/* in  : file to be created                        */
+    size_t      size,     /* in  : size of the file in bytes                 */
+    mapped_file *m        /* out : mapping                                   */
+                          /***************************************************/
+)
+
+/* creates a file of the given size and maps it writable; returns 1 on     */
+/* success and 0 on failure                                                 */
+
+{
+memset(m,0,sizeof(mapped_file));
+m->fd = -1;
+
+if ((m->fd = open(filename,O_RDWR|O_CREAT|O_TRUNC,0644)) < 0)
+{
+    console_error("Could not create file %s!\n", filename);
+    return 0;
+}
+if (ftruncate(m->fd,(off_t)size) != 0)
+{
+    console_error("Could not resize file %s!\n", filename);
+    close(m->fd);
+    m->fd = -1;
+    return 0;
+}
+
+m->size     = size;
+m->writable = 1;
+m->data     = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,m->fd,0);
+if (m->data == MAP_FAILED)
+{
+    console_error("Could not map file %s!\n", filename);
+    close(m->fd);
+    m->data = NULL;
+    m->fd   = -1;
+    return 0;
+}
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void unmap_file
+(
+                          /***************************************************/
+    mapped_file *m        /* in+out : mapping to be released                 */
+                          /***************************************************/
+)
+{
+if (m->data)
+    munmap(m->data,m->size);
+if (m->fd >= 0)
+    close(m->fd);
+m->data = NULL;
+m->fd   = -1;
+}
+
+/*---------------------------------------------------------------------------*/
+#endif
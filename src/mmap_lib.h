@@ -0,0 +1,25 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Memory mapped files (see mmap_lib.c).                                     */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef MMAP_LIB_H_INCLUDED
+#define MMAP_LIB_H_INCLUDED
+
+#include <stddef.h>
+
+typedef struct
+{
+  void   *data;       /* start of the mapping, NULL if not mapped           */
+  size_t size;        /* size of the mapping in bytes                       */
+  int    fd;          /* file descriptor, -1 if closed                      */
+  int    writable;    /* mapping is shared and writable                     */
+} mapped_file;
+
+int  map_file_read  (const char *filename, mapped_file *m);
+int  map_file_write (const char *filename, size_t size, mapped_file *m);
+void unmap_file     (mapped_file *m);
+
+#endif
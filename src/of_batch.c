@@ -0,0 +1,464 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Headless batch tool: computes the flow between all consecutive frames   */
+/* of one or more PGM sequences and writes one flow file per pair.          */
+/*                                                                           */
+/*   of_batch input <dir|list> outdir <dir> format <F|flo> threads <n> ...   */
+/*                                                                           */
+/* input is either a directory (all *.pgm files in name order form one      */
+/* sequence) or a text file with one frame per line. In the list, an empty  */
+/* line ends a sequence and a line naming a directory adds that directory   */
+/* as a sequence of its own; lines starting with '#' are ignored.           */
+/* Pairs are distributed over a pool of worker threads. Throughput and      */
+/* per-pair latency (read + compute + write) are printed at the end. The    */
+/* exit status is 1 if any pair could not be read, solved or written.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "arg_utils.c"
+#include "of_core.h"
+
+#define FILENAME_LEN 512
+
+typedef struct
+{
+  char frame1[FILENAME_LEN];   /* first frame of the pair                  */
+  char frame2[FILENAME_LEN];   /* second frame of the pair                 */
+  char out[2*FILENAME_LEN+16]; /* flow file to be written                  */
+} flow_pair;
+
+typedef struct
+{
+  flow_pair       *pairs;      /* all pairs of all sequences               */
+  int             num_pairs;   /* number of pairs                          */
+  int             next;        /* next pair to be processed                */
+  pthread_mutex_t lock;        /* protects next                            */
+  double          *latency;    /* per pair latency in s, <0 on failure     */
+  long            pixels;      /* processed pixels (under lock)            */
+  int             bx, by;      /* border sizes                             */
+  int             flo;         /* write .flo instead of Barron .F          */
+  float           alpha, epsilon_d, epsilon_s, w_bright_grad;
+  float           omega, eta;
+  int             iter_inner, iter_outer, max_warp_levels;
+  hs_options      options;     /* solver implementation choices            */
+} batch_job;
+
+/*---------------------------------------------------------------------------*/
+
+int compare_string (const void *a, const void *b)
+{
+return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int is_directory (const char *path)
+{
+struct stat st;
+return (stat(path,&st) == 0) && S_ISDIR(st.st_mode);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void add_pair
+(
+                          /***************************************************/
+    batch_job  *job,      /* in+out : job the pair is appended to            */
+    int        *capacity, /* in+out : allocated number of pairs              */
+    const char *frame1,   /* in     : first frame                            */
+    const char *frame2,   /* in     : second frame                           */
+    const char *outdir,   /* in     : output directory                       */
+    int        seq        /* in     : sequence number, <0 for no prefix      */
+                          /***************************************************/
+)
+
+/* appends the pair (frame1,frame2); the output name is derived from frame1 */
+
+{
+flow_pair  *p;
+const char *stem;
+char       name[FILENAME_LEN];
+char       *dot;
+
+if (job->num_pairs == *capacity)
+{
+    *capacity = (*capacity) ? 2 * (*capacity) : 64;
+    job->pairs = (flow_pair*)realloc(job->pairs,(*capacity)*sizeof(flow_pair));
+}
+p = &job->pairs[job->num_pairs++];
+snprintf(p->frame1,FILENAME_LEN,"%s",frame1);
+snprintf(p->frame2,FILENAME_LEN,"%s",frame2);
+
+stem = strrchr(frame1,'/');
+stem = stem ? stem + 1 : frame1;
+snprintf(name,FILENAME_LEN,"%s",stem);
+if ((dot = strrchr(name,'.')) != NULL) *dot = '\0';
+if (seq < 0)
+    snprintf(p->out,sizeof(p->out),"%s/%s.%s",outdir,name,job->flo ? "flo" : "F");
+else
+    snprintf(p->out,sizeof(p->out),"%s/s%03d_%s.%s",outdir,seq,name,
+             job->flo ? "flo" : "F");
+}
+
+/*---------------------------------------------------------------------------*/
+
+int add_sequence
+(
+                          /***************************************************/
+    batch_job  *job,      /* in+out : job the pairs are appended to          */
+    int        *capacity, /* in+out : allocated number of pairs              */
+    char       **frames,  /* in     : frame names in sequence order          */
+    int        n,         /* in     : number of frames                       */
+    const char *outdir,   /* in     : output directory                       */
+    int        seq        /* in     : sequence number, <0 for no prefix      */
+                          /***************************************************/
+)
+
+/* appends all consecutive pairs of a sequence; returns number of pairs */
+
+{
+int k;
+
+for (k=0; k+1<n; k++)
+    add_pair(job,capacity,frames[k],frames[k+1],outdir,seq);
+return (n > 1) ? n - 1 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int read_directory
+(
+                          /***************************************************/
+    const char *dir,      /* in  : directory to scan                         */
+    char       ***frames  /* out : sorted *.pgm file names (with path)       */
+                          /***************************************************/
+)
+
+/* collects the PGM frames of a directory in name order; returns count */
+
+{
+DIR           *d;
+struct dirent *e;
+int           n = 0, capacity = 0;
+size_t        len;
+
+*frames = NULL;
+if ((d = opendir(dir)) == NULL)
+{
+    console_error("Could not open directory %s!\n", dir);
+    return 0;
+}
+while ((e = readdir(d)) != NULL)
+{
+    len = strlen(e->d_name);
+    if ((len < 5) || (strcmp(e->d_name+len-4,".pgm") != 0))
+        continue;
+    if (n == capacity)
+    {
+        capacity = capacity ? 2 * capacity : 64;
+        *frames = (char**)realloc(*frames,capacity*sizeof(char*));
+    }
+    (*frames)[n] = (char*)malloc(strlen(dir)+len+2);
+    sprintf((*frames)[n],"%s/%s",dir,e->d_name);
+    n++;
+}
+closedir(d);
+qsort(*frames,n,sizeof(char*),compare_string);
+return n;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void free_frames (char **frames, int n)
+{
+int k;
+for (k=0; k<n; k++) free(frames[k]);
+free(frames);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int read_list
+(
+                          /***************************************************/
+    batch_job  *job,      /* in+out : job the pairs are appended to          */
+    int        *capacity, /* in+out : allocated number of pairs              */
+    const char *listfile, /* in     : list of frames and directories         */
+    const char *outdir    /* in     : output directory                       */
+                          /***************************************************/
+)
+
+/* parses a list file as described in the header; returns 0 on failure */
+
+{
+FILE   *file;
+char   *line = NULL;
+size_t length = 0;
+char   **frames = NULL, **dirframes;
+int    n = 0, capacity_frames = 0, n_dir;
+int    seq = 0;
+size_t len;
+
+if ((file = fopen(listfile,"r")) == NULL)
+{
+    console_error("Could not open list %s!\n", listfile);
+    return 0;
+}
+while (getline(&line,&length,file) >= 0)
+{
+    len = strlen(line);
+    while ((len > 0) && ((line[len-1] == '\n') || (line[len-1] == '\r')
+                         || (line[len-1] == ' ')))
+        line[--len] = '\0';
+    if (line[0] == '#')
+        continue;
+
+    /* empty line or directory: close the current sequence */
+    if ((len == 0) || is_directory(line))
+    {
+        if (add_sequence(job,capacity,frames,n,outdir,seq)) seq++;
+        free_frames(frames,n);
+        frames = NULL; n = 0; capacity_frames = 0;
+        if (len == 0)
+            continue;
+
+        n_dir = read_directory(line,&dirframes);
+        if (add_sequence(job,capacity,dirframes,n_dir,outdir,seq)) seq++;
+        free_frames(dirframes,n_dir);
+        continue;
+    }
+
+    if (n == capacity_frames)
+    {
+        capacity_frames = capacity_frames ? 2 * capacity_frames : 64;
+        frames = (char**)realloc(frames,capacity_frames*sizeof(char*));
+    }
+    frames[n++] = strdup(line);
+}
+add_sequence(job,capacity,frames,n,outdir,seq);
+free_frames(frames,n);
+free(line);
+fclose(file);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void *batch_worker (void *arg)
+
+/* worker thread: processes pairs until the job is exhausted */
+
+{
+batch_job *job = (batch_job*)arg;
+flow_pair *p;
+float     **f1, **f2, **u, **v;
+int       k, nx, ny, nx2, ny2, maxgv, written;
+double    t0;
+
+for (;;)
+{
+    pthread_mutex_lock(&job->lock);
+    k = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (k >= job->num_pairs)
+        break;
+
+    p  = &job->pairs[k];
+    t0 = wall_time();
+    job->latency[k] = -1.0;
+
+    f1 = read_pgm_image_mapped(p->frame1,&nx,&ny,job->bx,job->by,&maxgv);
+    f2 = read_pgm_image_mapped(p->frame2,&nx2,&ny2,job->bx,job->by,&maxgv);
+    if (!f1 || !f2 || (nx != nx2) || (ny != ny2))
+    {
+        console_error("Skipping pair %s / %s!\n", p->frame1, p->frame2);
+        if (f1) free_pgm_image(f1,nx,ny,job->bx,job->by);
+        if (f2) free_pgm_image(f2,nx2,ny2,job->bx,job->by);
+        continue;
+    }
+
+    if (!calloc_multi(2,2,sizeof(float),nx,ny,job->bx,job->by,0,0,&u,&v))
+    {
+        console_error("Out of memory for pair %s / %s!\n", p->frame1,
+                      p->frame2);
+        free_pgm_image(f1,nx,ny,job->bx,job->by);
+        free_pgm_image(f2,nx,ny,job->bx,job->by);
+        continue;
+    }
+    HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,job->bx,job->by,1.0f,1.0f,
+                          job->alpha,job->epsilon_d,job->epsilon_s,
+                          job->w_bright_grad,job->iter_inner,job->iter_outer,
+                          job->eta,job->omega,job->max_warp_levels,
+                          &job->options);
+    /* the checked writer reports errors instead of ending the process */
+    if (job->flo)
+        written = write_flo_data(p->out,u,v,nx,ny,job->bx,job->by);
+    else
+        written = write_barron_data_checked(p->out,u,v,nx,ny,job->bx,
+                                            job->by);
+
+    free_multi(2,2,sizeof(float),nx,ny,job->bx,job->by,0,0,&u,&v);
+    free_pgm_image(f1,nx,ny,job->bx,job->by);
+    free_pgm_image(f2,nx,ny,job->bx,job->by);
+    if (!written)
+    {
+        /* a pair without its flow file counts as failed */
+        console_error("Could not write the flow of pair %s / %s!\n",
+                      p->frame1, p->frame2);
+        continue;
+    }
+
+    job->latency[k] = wall_time() - t0;
+    pthread_mutex_lock(&job->lock);
+    job->pixels += (long)nx * ny;
+    pthread_mutex_unlock(&job->lock);
+}
+return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int print_statistics
+(
+                          /***************************************************/
+    batch_job *job,       /* in : finished job                               */
+    double    total,      /* in : wall time of the whole batch in s          */
+    int       threads     /* in : number of worker threads                   */
+                          /***************************************************/
+)
+
+/* prints throughput and latency; returns the number of failed pairs */
+
+{
+double *t = (double*)malloc((job->num_pairs+1)*sizeof(double));
+double sum = 0.0, median;
+int    k, n = 0;
+
+for (k=0; k<job->num_pairs; k++)
+    if (job->latency[k] >= 0.0)
+    {
+        t[n++] = 1000.0 * job->latency[k];
+        sum   += 1000.0 * job->latency[k];
+    }
+
+printf("------ batch statistics ------\n");
+printf("pairs            %d (%d failed), %d threads\n",
+       job->num_pairs, job->num_pairs - n, threads);
+printf("wall time        %.3f s\n", total);
+if (n > 0)
+{
+    printf("throughput       %.2f pairs/s, %.2f Mpixel/s\n",
+           n / total, 1.0e-6 * job->pixels / total);
+    median = median_double(t,n);
+    printf("latency [ms]     min %.2f  mean %.2f  median %.2f  p95 %.2f  "
+           "max %.2f\n", t[0], sum / n, median,
+           t[(int)(0.95*(n-1)+0.5)], t[n-1]);
+}
+free(t);
+return job->num_pairs - n;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main (int argc, char* argv[])
+{
+char      input[FILENAME_LEN], outdir[FILENAME_LEN], format[16];
+char      *console_string = (char*)calloc(3000,sizeof(char));
+char      **frames;
+batch_job job;
+pthread_t *workers;
+int       threads, capacity = 0, n, k, failed;
+double    t0;
+
+memset(&job,0,sizeof(job));
+parse_arg_string(argc,argv,"input",input,".",console_string);
+parse_arg_string(argc,argv,"outdir",outdir,".",console_string);
+parse_arg_string(argc,argv,"format",format,"F",console_string);
+parse_arg_int   (argc,argv,"threads",&threads,
+                 (int)sysconf(_SC_NPROCESSORS_ONLN),console_string);
+parse_arg_int   (argc,argv,"bordersizex",&job.bx,2,console_string);
+parse_arg_int   (argc,argv,"bordersizey",&job.by,2,console_string);
+parse_arg_float (argc,argv,"alpha",&job.alpha,5.0f,console_string);
+parse_arg_float (argc,argv,"epsilon_d",&job.epsilon_d,0.01f,console_string);
+parse_arg_float (argc,argv,"epsilon_s",&job.epsilon_s,0.01f,console_string);
+parse_arg_float (argc,argv,"w_bright_grad",&job.w_bright_grad,0.0f,
+                 console_string);
+parse_arg_int   (argc,argv,"iterations_inner",&job.iter_inner,1,console_string);
+parse_arg_int   (argc,argv,"iterations_outer",&job.iter_outer,15,console_string);
+parse_arg_float (argc,argv,"omega",&job.omega,1.96f,console_string);
+parse_arg_float (argc,argv,"eta",&job.eta,0.92f,console_string);
+parse_arg_int   (argc,argv,"max_warp_levels",&job.max_warp_levels,200,
+                 console_string);
+hs_default_options(&job.options);
+parse_arg_int   (argc,argv,"sor_weights",&job.options.sor_weights,
+                 job.options.sor_weights,console_string);
+parse_arg_int   (argc,argv,"adaptive_omega",&job.options.adaptive_omega,
+                 job.options.adaptive_omega,console_string);
+parse_arg_float (argc,argv,"inner_tolerance",&job.options.inner_tolerance,
+                 job.options.inner_tolerance,console_string);
+parse_arg_int   (argc,argv,"line_relax",&job.options.line_relax,
+                 job.options.line_relax,console_string);
+parse_arg_float (argc,argv,"line_omega",&job.options.line_omega,
+                 job.options.line_omega,console_string);
+parse_arg_int   (argc,argv,"pcg",&job.options.pcg,job.options.pcg,
+                 console_string);
+parse_arg_int   (argc,argv,"tvl1",&job.options.tvl1,job.options.tvl1,
+                 console_string);
+parse_arg_int   (argc,argv,"tvl1_iterations",&job.options.tvl1_iterations,
+                 job.options.tvl1_iterations,console_string);
+printf("------\n%s---------\n",console_string);
+
+job.flo = (strcmp(format,"flo") == 0);
+if (!job.flo && (strcmp(format,"F") != 0))
+{
+    console_error("Unknown format %s (use F or flo)!\n", format);
+    return 1;
+}
+if (threads < 1) threads = 1;
+
+/* collect the pairs */
+if (is_directory(input))
+{
+    n = read_directory(input,&frames);
+    add_sequence(&job,&capacity,frames,n,outdir,-1);
+    free_frames(frames,n);
+}
+else if (!read_list(&job,&capacity,input,outdir))
+    return 1;
+
+if (job.num_pairs == 0)
+{
+    console_error("No frame pairs found in %s!\n", input);
+    return 1;
+}
+
+/* process them on the worker pool */
+job.latency = (double*)malloc(job.num_pairs*sizeof(double));
+workers     = (pthread_t*)malloc(threads*sizeof(pthread_t));
+pthread_mutex_init(&job.lock,NULL);
+
+t0 = wall_time();
+for (k=0; k<threads; k++)
+    pthread_create(&workers[k],NULL,batch_worker,&job);
+for (k=0; k<threads; k++)
+    pthread_join(workers[k],NULL);
+
+failed = print_statistics(&job,wall_time()-t0,threads);
+if (failed > 0)
+    console_error("%d of %d pairs failed!\n", failed, job.num_pairs);
+
+pthread_mutex_destroy(&job.lock);
+free(workers);
+free(job.latency);
+free(job.pairs);
+free(console_string);
+return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,1609 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Headless benchmark driver for the flow core library (libofcore).         */
+/*                                                                           */
+/*   of_bench mode <m> ...                                                   */
+/*                                                                           */
+/*   solve   times HORN_SCHUNCK_MAIN on an image pair with the parameters    */
+/*           of the python demo; "make bench" runs it for every build        */
+/*           variant of the library                                          */
+/*           (gt <file> adds the endpoint error to a Barron ground truth)   */
+/*   flowio  writes and replays a sequence of flow fields in the Barron,     */
+/*           .flo and flow stream formats                                    */
+/*   imageio compares the stream and the memory mapped readers for PGM,     */
+/*           PPM and Barron files                                            */
+/*   batch   pairs/s of HORN_SCHUNCK_MAIN_BATCH on lanes crops of size       */
+/*           crop_nx x crop_ny against a loop over HORN_SCHUNCK_MAIN         */
+/*   bidir   HORN_SCHUNCK_MAIN_BIDIR against two HORN_SCHUNCK_MAIN_OPT      */
+/*           calls, with the share of consistent pixels                      */
+/*   tune    replays runs parameter changes as in the interactive frontend  */
+/*           with and without the recompute cache (hs_options cache)        */
+/*   sweep   HORN_SCHUNCK_SWEEP over a grid around alpha, epsilon_d and     */
+/*           epsilon_s on threads threads against a loop over               */
+/*           HORN_SCHUNCK_MAIN_OPT (needs gt <file>)                         */
+/*   tiled   HORN_SCHUNCK_MAIN_TILED with tile x tile tiles and overlap      */
+/*           pixels of overlap against HORN_SCHUNCK_MAIN_OPT on the whole   */
+/*           image: peak resident memory and the difference of the flow,    */
+/*           overall and next to the tile seams                             */
+/*   alloc   SOR throughput of the solver under each allocation policy of   */
+/*           malloc_multi (alloc <p> selects the policy for all modes)      */
+/*   large   allocates a large_nx x large_ny plane (more than 2^31 bytes    */
+/*           by default), runs set/resample kernels over it and checks the  */
+/*           addresses; then a large_bytes x large_bytes plane of bytes     */
+/*           (more than 2^31 elements by default, 0: none); solve 1 also    */
+/*           solves a synthetic pair of large_nx x large_ny                 */
+/*   memory  peak bytes of malloc_multi per solve with and without the     */
+/*           low memory mode (low_memory 1 selects it for all modes); on    */
+/*           a synthetic mem_nx x mem_ny pair if given                      */
+/*   storage runtime, SOR throughput and error with the motion tensor in  */
+/*           float32, float16 and bfloat16 (tensor_storage <s> selects the  */
+/*           storage for all modes)                                         */
+/*   layout  SOR throughput and hardware counters of the plain solver with  */
+/*           separate planes and with interleaved records (interleaved 1    */
+/*           selects the records for all modes); the counters need a PMU    */
+/*           the kernel exposes through perf_event_open                     */
+/*   pipeline pairs/s and latency of HORN_SCHUNCK_PIPELINE on 1 .. stages   */
+/*           stages over frames frames against a loop over                  */
+/*           HORN_SCHUNCK_MAIN_OPT                                          */
+/*                                                                           */
+/* See BENCHMARKS.txt for the numbers.                                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "arg_utils.c"
+#include "of_core.h"
+
+char   file1[200], file2[200];   // input image pair
+char   label[200];               // label of the result line
+char   outfile[200];             // flow output of mode solve, "-" for none
+char   gtfile[200];              // ground truth of mode solve, "-" for none
+char   tmpdir[200];              // scratch directory for I/O benchmarks
+float  **f1, **f2;               // input images
+int    nx, ny, bx, by;           // image dimensions and border sizes
+float  alpha;                    // smoothness weight
+float  epsilon_d;                // diffusivity param data term
+float  epsilon_s;                // diffusivity param smoothness term
+float  w_bright_grad;            // weight gradient vs. brightness constancy
+float  omega;                    // SOR overrelaxation parameter
+float  eta;                      // warping reduction factor between levels
+int    iter_inner, iter_outer;   // solver and fixed point iterations
+int    max_warp_levels;          // maximal number of warping levels
+int    runs;                     // number of timed runs / frames
+int    lanes;                    // pairs of mode batch
+int    crop_nx, crop_ny;         // crop size of mode batch
+int    threads;                  // worker threads of mode sweep
+int    tile, overlap;            // tile size and overlap of mode tiled
+int    large_nx, large_ny;       // plane size of mode large
+int    large_solve;              // 1: mode large also solves at that size
+int    large_bytes;              // side of the byte plane of mode large
+int    alloc_policy;             // allocation policy of malloc_multi
+int    mem_nx, mem_ny;           // synthetic pair of mode memory, 0: input
+int    frames;                   // sequence length of mode pipeline
+int    stages;                   // largest number of stages of mode pipeline
+hs_options options;              // solver implementation choices
+
+/*---------------------------------------------------------------------------*/
+
+float mean_flow_magnitude
+(
+                     /********************************************************/
+    float **u,       /* in : x-component of displacement field               */
+    float **v,       /* in : y-component of displacement field               */
+    int   nx,        /* in : size in x-direction                             */
+    int   ny,        /* in : size in y-direction                             */
+    int   bx,        /* in : boundary size in x-direction                    */
+    int   by         /* in : boundary size in y-direction                    */
+                     /********************************************************/
+)
+
+/* mean length of the flow vectors, used to check that variants agree */
+
+{
+int    i,j;
+double sum = 0.0;
+
+for (i=bx; i<nx+bx; i++)
+    for (j=by; j<ny+by; j++)
+	sum += sqrt(u[i][j]*u[i][j] + v[i][j]*v[i][j]);
+
+return (float)(sum / ((double)nx*ny));
+}
+
+/*---------------------------------------------------------------------------*/
+
+float max_flow_difference
+(
+                     /********************************************************/
+    float **u1,      /* in : x-component of 1st displacement field           */
+    float **v1,      /* in : y-component of 1st displacement field           */
+    float **u2,      /* in : x-component of 2nd displacement field           */
+    float **v2,      /* in : y-component of 2nd displacement field           */
+    int   nx,        /* in : size in x-direction                             */
+    int   ny,        /* in : size in y-direction                             */
+    int   bx,        /* in : boundary size in x-direction                    */
+    int   by         /* in : boundary size in y-direction                    */
+                     /********************************************************/
+)
+
+/* maximal endpoint distance between two flow fields */
+
+{
+int   i,j;
+float d, dmax = 0.0f;
+
+for (i=bx; i<nx+bx; i++)
+    for (j=by; j<ny+by; j++)
+    {
+	d = sqrtf((u1[i][j]-u2[i][j])*(u1[i][j]-u2[i][j])
+	         +(v1[i][j]-v2[i][j])*(v1[i][j]-v2[i][j]));
+	if (d > dmax) dmax = d;
+    }
+return dmax;
+}
+
+/*---------------------------------------------------------------------------*/
+
+float mean_endpoint_error
+(
+                     /********************************************************/
+    float **u1,      /* in : x-component of 1st displacement field           */
+    float **v1,      /* in : y-component of 1st displacement field           */
+    float **u2,      /* in : x-component of 2nd displacement field           */
+    float **v2,      /* in : y-component of 2nd displacement field           */
+    int   nx,        /* in : size in x-direction                             */
+    int   ny,        /* in : size in y-direction                             */
+    int   bx,        /* in : boundary size in x-direction                    */
+    int   by         /* in : boundary size in y-direction                    */
+                     /********************************************************/
+)
+
+/* average endpoint distance between two flow fields */
+
+{
+int    i,j;
+double sum = 0.0;
+
+for (i=bx; i<nx+bx; i++)
+    for (j=by; j<ny+by; j++)
+	sum += sqrt((u1[i][j]-u2[i][j])*(u1[i][j]-u2[i][j])
+	           +(v1[i][j]-v2[i][j])*(v1[i][j]-v2[i][j]));
+return (float)(sum / ((double)nx*ny));
+}
+
+/*---------------------------------------------------------------------------*/
+
+void compute_flow
+(
+                     /********************************************************/
+    float **u,       /* out : x-component of displacement field              */
+    float **v        /* out : y-component of displacement field              */
+                     /********************************************************/
+)
+
+/* computes the flow between f1 and f2 with the global parameters */
+
+{
+HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,alpha,epsilon_d,
+                      epsilon_s,w_bright_grad,iter_inner,iter_outer,eta,omega,
+                      max_warp_levels,&options);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_solve ()
+
+/* times the solver on the image pair */
+
+{
+float  **u, **v, **gu, **gv;
+double *t, t0, t_med;
+int    r;
+hs_stats stats;
+
+calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v);
+t = (double*)malloc(runs*sizeof(double));
+
+/* warm-up run, then timed runs */
+compute_flow(u,v);
+for (r=0; r<runs; r++)
+{
+    t0 = wall_time();
+    compute_flow(u,v);
+    t[r] = 1000.0 * (wall_time() - t0);
+}
+t_med = median_double(t,runs);
+
+/* counters of one more run */
+options.stats = &stats;
+compute_flow(u,v);
+options.stats = NULL;
+
+printf("%-10s %4dx%-4d runs %3d   min %9.2f ms   median %9.2f ms   |w| %.6f\n",
+       label, nx, ny, runs, t[0], t_med,
+       mean_flow_magnitude(u,v,nx,ny,bx,by));
+printf("%-10s precision policy %s\n", label, hs_precision_policy());
+printf("%-10s halo mirrors per frame: %ld done, %ld avoided\n",
+       label, stats.halo_refreshes, stats.halo_skipped);
+if (options.tvl1)
+    printf("%-10s TV-L1 iterations per frame: %ld (%.1f at full size)\n",
+           label, stats.sor_sweeps, stats.sor_updates/((double)nx*ny));
+else if (options.pcg)
+    printf("%-10s PCG iterations per frame: %ld (%.1f at full size)\n",
+           label, stats.sor_sweeps, stats.sor_updates/((double)nx*ny));
+else
+    printf("%-10s SOR sweeps per frame: %ld (%.1f at full size), "
+           "omega %.3f .. %.3f\n",
+           label, stats.sor_sweeps, stats.sor_updates/((double)nx*ny),
+           stats.omega_min, stats.omega_max);
+if (strcmp(gtfile,"-") != 0)
+{
+    calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+    read_barron_data(gtfile,gu,gv,nx,ny,bx,by);
+    printf("%-10s average endpoint error %.4f px   max %.4f px\n", label,
+           mean_endpoint_error(u,v,gu,gv,nx,ny,bx,by),
+           max_flow_difference(u,v,gu,gv,nx,ny,bx,by));
+    free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+}
+if (strcmp(outfile,"-") != 0)
+    write_barron_data(outfile,u,v,nx,ny,bx,by);
+
+free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v);
+free(t);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void print_io_line
+(
+    const char *name,    /* format                                           */
+    double     t_write,  /* total write time in s                            */
+    double     t_read,   /* total read time in s                             */
+    double     bytes,    /* bytes on disk                                    */
+    float      err       /* maximal endpoint error after the round trip      */
+)
+{
+printf("%-16s write %8.3f ms/frame %8.1f MB/s   read %8.3f ms/frame "
+       "%8.1f MB/s   %7.2f MB   max err %.2e\n",
+       name, 1000.0*t_write/runs, 1.0e-6*bytes/t_write,
+       1000.0*t_read/runs, 1.0e-6*bytes/t_read, 1.0e-6*bytes, err);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_flowio ()
+
+/* writes runs frames of the flow of the image pair in every format and    */
+/* reads them back; the page cache is warm, so this measures the CPU cost  */
+/* of the formats rather than the disk                                     */
+
+{
+float              **u, **v, **ur, **vr;
+char               name[400];
+flow_stream_writer sw;
+flow_stream_reader sr;
+double             t0, tw, tr;
+float              err;
+int                r, enc;
+
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ur,&vr);
+compute_flow(u,v);
+
+/* Barron .F, one file per frame */
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.F",tmpdir,r);
+    write_barron_data(name,u,v,nx,ny,bx,by);
+}
+tw = wall_time() - t0;
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.F",tmpdir,r);
+    read_barron_data(name,ur,vr,nx,ny,bx,by);
+}
+tr = wall_time() - t0;
+err = max_flow_difference(u,v,ur,vr,nx,ny,bx,by);
+print_io_line("barron .F",tw,tr,runs*(24.0+8.0*nx*ny),err);
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.F",tmpdir,r);
+    unlink(name);
+}
+
+/* Middlebury .flo, one file per frame */
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.flo",tmpdir,r);
+    write_flo_data(name,u,v,nx,ny,bx,by);
+}
+tw = wall_time() - t0;
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.flo",tmpdir,r);
+    read_flo_data(name,ur,vr,nx,ny,bx,by);
+}
+tr = wall_time() - t0;
+err = max_flow_difference(u,v,ur,vr,nx,ny,bx,by);
+print_io_line("middlebury .flo",tw,tr,runs*(12.0+8.0*nx*ny),err);
+for (r=0; r<runs; r++)
+{
+    sprintf(name,"%s/of_bench_%04d.flo",tmpdir,r);
+    unlink(name);
+}
+
+/* flow streams, all frames in one file */
+for (enc=FLOW_STREAM_FLOAT32; enc<=FLOW_STREAM_FLOAT16; enc++)
+{
+    sprintf(name,"%s/of_bench.ofs",tmpdir);
+    t0 = wall_time();
+    flow_stream_open_write(&sw,name,nx,ny,enc);
+    for (r=0; r<runs; r++)
+        flow_stream_write_frame(&sw,u,v,bx,by);
+    flow_stream_close_write(&sw);
+    tw = wall_time() - t0;
+
+    t0 = wall_time();
+    flow_stream_open_read(&sr,name);
+    for (r=0; r<sr.header.frames; r++)
+        flow_stream_read_frame(&sr,r,ur,vr,bx,by);
+    flow_stream_close_read(&sr);
+    tr = wall_time() - t0;
+    err = max_flow_difference(u,v,ur,vr,nx,ny,bx,by);
+    print_io_line(enc == FLOW_STREAM_FLOAT16 ? "stream float16"
+                                             : "stream float32",
+                  tw,tr,FLOW_STREAM_HEADER + runs*(double)sw.header.frame_bytes,
+                  err);
+    unlink(name);
+}
+
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ur,&vr);
+}
+
+void print_read_line
+(
+    const char *name,    /* format and reader                                */
+    double     t,        /* total read time in s                             */
+    double     bytes,    /* bytes per file                                   */
+    float      err       /* maximal difference to the reference reader       */
+)
+{
+printf("%-22s read %8.3f ms/file %8.1f MB/s   max diff %.2e\n",
+       name, 1000.0*t/runs, 1.0e-6*bytes*runs/t, err);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_imageio ()
+
+/* reads the same PGM, PPM and Barron file runs times with the stream      */
+/* readers of io_lib.c and with their memory mapped counterparts, and      */
+/* checks that both give the same planes                                   */
+
+{
+float  **g = NULL, **u, **v, **ur, **vr;
+float  ***c, ***cm = NULL;
+char   name[400];
+double t0, t;
+float  err;
+int    r, k, w, h, maxgv;
+
+/* PGM: the first input image */
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    g = read_pgm_image(file1,&w,&h,bx,by,&maxgv);
+    free_pgm_image(g,w,h,bx,by);
+}
+t = wall_time() - t0;
+print_read_line("pgm  stream",t,nx*ny,0.0f);
+
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    g = read_pgm_image_mapped(file1,&w,&h,bx,by,&maxgv);
+    if (r < runs-1) free_pgm_image(g,w,h,bx,by);
+}
+t = wall_time() - t0;
+print_read_line("pgm  mapped",t,nx*ny,
+                max_flow_difference(f1,f1,g,g,nx,ny,bx,by));
+free_pgm_image(g,w,h,bx,by);
+
+/* PPM: the input pair and its mean as colour channels */
+malloc_multi(1,3,sizeof(float),3,nx,ny,0,bx,by,0,0,0,&c);
+for (k=0; k<(nx+2*bx)*(ny+2*by); k++)
+{
+    c[0][0][k] = f1[0][k];
+    c[1][0][k] = f2[0][k];
+    c[2][0][k] = 0.5f * (f1[0][k] + f2[0][k]);
+}
+sprintf(name,"%s/of_bench.ppm",tmpdir);
+write_ppm_image(name,nx,ny,bx,by,c,1);
+free_ppm_image(c,nx,ny,bx,by);
+
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    c = read_ppm_image(name,&w,&h,bx,by,&maxgv);
+    if (r < runs-1) free_ppm_image(c,w,h,bx,by);
+}
+t = wall_time() - t0;
+print_read_line("ppm  stream",t,3.0*nx*ny,0.0f);
+
+t0 = wall_time();
+for (r=0; r<runs; r++)
+{
+    cm = read_ppm_image_mapped(name,&w,&h,bx,by,&maxgv);
+    if (r < runs-1) free_ppm_image(cm,w,h,bx,by);
+}
+t = wall_time() - t0;
+err = 0.0f;
+for (k=0; k<3; k++)
+{
+    float e = max_flow_difference(c[k],c[k],cm[k],cm[k],nx,ny,bx,by);
+    if (e > err) err = e;
+}
+print_read_line("ppm  mapped",t,3.0*nx*ny,err);
+free_ppm_image(c,nx,ny,bx,by);
+free_ppm_image(cm,nx,ny,bx,by);
+unlink(name);
+
+/* Barron .F: the flow of the input pair */
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ur,&vr);
+compute_flow(u,v);
+sprintf(name,"%s/of_bench.F",tmpdir);
+write_barron_data(name,u,v,nx,ny,bx,by);
+
+t0 = wall_time();
+for (r=0; r<runs; r++)
+    read_barron_data(name,ur,vr,nx,ny,bx,by);
+t = wall_time() - t0;
+print_read_line("barron stream",t,24.0+8.0*nx*ny,
+                max_flow_difference(u,v,ur,vr,nx,ny,bx,by));
+
+t0 = wall_time();
+for (r=0; r<runs; r++)
+    read_barron_data_mapped(name,ur,vr,nx,ny,bx,by);
+t = wall_time() - t0;
+print_read_line("barron mapped",t,24.0+8.0*nx*ny,
+                max_flow_difference(u,v,ur,vr,nx,ny,bx,by));
+unlink(name);
+
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ur,&vr);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_batch ()
+
+/* cuts lanes crops of size crop_nx x crop_ny out of the image pair (spread */
+/* over the image) and times three ways to compute all their flows: a loop */
+/* over HORN_SCHUNCK_MAIN, a loop over HORN_SCHUNCK_MAIN_OPT with          */
+/* sor_weights 1, and HORN_SCHUNCK_MAIN_BATCH, which must agree with the   */
+/* second one                                                              */
+
+{
+float      ***c1, ***c2;          /* crops                                  */
+float      ***ul, ***vl;          /* flows of the loops                     */
+float      ***ub, ***vb;          /* flows of the batched solver            */
+double     *t, t0, t_med[3];
+float      err, e;
+double     mean;
+int        r, k, m, i, j, ox, oy;
+hs_options sw;
+const char *name[3] = {"loop MAIN", "loop sor_weights", "batched"};
+
+if ((crop_nx > nx) || (crop_ny > ny) || (lanes < 1))
+{
+    console_error("[bench_batch] crops of %dx%d do not fit into %dx%d\n",
+                  crop_nx, crop_ny, nx, ny);
+    return;
+}
+hs_default_options(&sw);
+sw.sor_weights = 1;
+
+c1 = (float***)malloc(6*lanes*sizeof(float**));
+c2 = c1 + lanes;   ul = c1 + 2*lanes;   vl = c1 + 3*lanes;
+ub = c1 + 4*lanes; vb = c1 + 5*lanes;
+for (k=0; k<lanes; k++)
+{
+    calloc_multi(6,2,sizeof(float),crop_nx,crop_ny,bx,by,0,0,
+                 &c1[k],&c2[k],&ul[k],&vl[k],&ub[k],&vb[k]);
+    ox = (lanes > 1) ? k*(nx-crop_nx)/(lanes-1) : 0;
+    oy = (lanes > 1) ? ((k*5)%lanes)*(ny-crop_ny)/(lanes-1) : 0;
+    for (i=bx; i<crop_nx+bx; i++)
+        for (j=by; j<crop_ny+by; j++)
+        {
+            c1[k][i][j] = f1[i+ox][j+oy];
+            c2[k][i][j] = f2[i+ox][j+oy];
+        }
+}
+t = (double*)malloc(runs*sizeof(double));
+
+for (m=0; m<3; m++)
+{
+    for (r=-1; r<runs; r++)   /* r = -1: warm-up */
+    {
+        t0 = wall_time();
+        if (m == 2)
+            HORN_SCHUNCK_MAIN_BATCH(c1,c2,ub,vb,lanes,crop_nx,crop_ny,bx,by,
+                                    1.0f,1.0f,alpha,epsilon_d,epsilon_s,
+                                    w_bright_grad,iter_inner,iter_outer,eta,
+                                    omega,max_warp_levels);
+        else
+            for (k=0; k<lanes; k++)
+                HORN_SCHUNCK_MAIN_OPT(c1[k],c2[k],ul[k],vl[k],crop_nx,crop_ny,
+                                      bx,by,1.0f,1.0f,alpha,epsilon_d,
+                                      epsilon_s,w_bright_grad,iter_inner,
+                                      iter_outer,eta,omega,max_warp_levels,
+                                      (m == 0) ? NULL : &sw);
+        if (r >= 0)
+            t[r] = wall_time() - t0;
+    }
+    t_med[m] = median_double(t,runs);
+}
+
+err  = 0.0f;
+mean = 0.0;
+for (k=0; k<lanes; k++)
+{
+    e = max_flow_difference(ul[k],vl[k],ub[k],vb[k],crop_nx,crop_ny,bx,by);
+    if (e > err) err = e;
+    mean += mean_endpoint_error(ul[k],vl[k],ub[k],vb[k],crop_nx,crop_ny,
+                                bx,by) / lanes;
+}
+for (m=0; m<3; m++)
+    printf("%-10s %-16s %3d x %4dx%-4d  %9.2f ms  %8.1f pairs/s\n",
+           label, name[m], lanes, crop_nx, crop_ny, 1000.0*t_med[m],
+           lanes/t_med[m]);
+printf("%-10s batched vs loop sor_weights: difference max %.2e px, "
+       "mean %.2e px\n", label, err, mean);
+
+for (k=0; k<lanes; k++)
+    free_multi(6,2,sizeof(float),crop_nx,crop_ny,bx,by,0,0,
+               &c1[k],&c2[k],&ul[k],&vl[k],&ub[k],&vb[k]);
+free(c1);
+free(t);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_bidir ()
+
+/* times the forward and the backward flow as two HORN_SCHUNCK_MAIN_OPT    */
+/* calls and as one HORN_SCHUNCK_MAIN_BIDIR call (with consistency mask),  */
+/* which must agree; with gt the endpoint error of the forward flow is     */
+/* split into consistent and inconsistent pixels                           */
+
+{
+float  **u, **v, **ub, **vb;      /* flows of the two calls                 */
+float  **bu, **bv, **bub, **bvb;  /* flows of the bidirectional call        */
+float  **mask, **gu, **gv;
+double *t, t0, t_med[2];
+double n_in, e_in, e_out, d;
+int    r, m, i, j;
+const char *name[2] = {"two calls", "bidir"};
+
+calloc_multi(9,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ub,&vb,
+             &bu,&bv,&bub,&bvb,&mask);
+t = (double*)malloc(runs*sizeof(double));
+
+for (m=0; m<2; m++)
+{
+    for (r=-1; r<runs; r++)   /* r = -1: warm-up */
+    {
+        t0 = wall_time();
+        if (m == 1)
+            HORN_SCHUNCK_MAIN_BIDIR(f1,f2,bu,bv,bub,bvb,mask,nx,ny,bx,by,
+                                    1.0f,1.0f,alpha,epsilon_d,epsilon_s,
+                                    w_bright_grad,iter_inner,iter_outer,eta,
+                                    omega,max_warp_levels,&options);
+        else
+        {
+            HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,alpha,
+                                  epsilon_d,epsilon_s,w_bright_grad,
+                                  iter_inner,iter_outer,eta,omega,
+                                  max_warp_levels,&options);
+            HORN_SCHUNCK_MAIN_OPT(f2,f1,ub,vb,nx,ny,bx,by,1.0f,1.0f,alpha,
+                                  epsilon_d,epsilon_s,w_bright_grad,
+                                  iter_inner,iter_outer,eta,omega,
+                                  max_warp_levels,&options);
+        }
+        if (r >= 0)
+            t[r] = wall_time() - t0;
+    }
+    t_med[m] = median_double(t,runs);
+}
+
+n_in = 0.0;
+for (i=bx; i<nx+bx; i++)
+    for (j=by; j<ny+by; j++)
+        n_in += mask[i][j];
+
+for (m=0; m<2; m++)
+    printf("%-10s %-10s %4dx%-4d  %9.2f ms\n", label, name[m], nx, ny,
+           1000.0*t_med[m]);
+printf("%-10s bidir vs two calls: difference forward %.2e px, "
+       "backward %.2e px, consistent %.1f %%\n", label,
+       max_flow_difference(u,v,bu,bv,nx,ny,bx,by),
+       max_flow_difference(ub,vb,bub,bvb,nx,ny,bx,by),
+       100.0*n_in/((double)nx*ny));
+
+if (strcmp(gtfile,"-") != 0)
+{
+    calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+    read_barron_data(gtfile,gu,gv,nx,ny,bx,by);
+    e_in = e_out = 0.0;
+    for (i=bx; i<nx+bx; i++)
+        for (j=by; j<ny+by; j++)
+        {
+            d = sqrt((bu[i][j]-gu[i][j])*(bu[i][j]-gu[i][j])
+                    +(bv[i][j]-gv[i][j])*(bv[i][j]-gv[i][j]));
+            if (mask[i][j] > 0.5f) e_in += d; else e_out += d;
+        }
+    printf("%-10s average endpoint error consistent %.4f px, "
+           "inconsistent %.4f px\n", label,
+           (n_in > 0.0) ? e_in/n_in : 0.0,
+           ((double)nx*ny > n_in) ? e_out/((double)nx*ny-n_in) : 0.0);
+    free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+}
+
+free_multi(9,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ub,&vb,
+           &bu,&bv,&bub,&bvb,&mask);
+free(t);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_tune ()
+
+/* replays an interactive tuning session: step r changes alpha, every     */
+/* third step epsilon_d, and every fourth step repeats the previous       */
+/* parameters; each session is timed without and with the recompute      */
+/* cache, whose flows must agree                                          */
+
+{
+float    **u, **v, **uc, **vc;
+float    a, e, err;
+double   t0, t_step[2], t_total[2];
+int      r, m;
+hs_cache cache;
+hs_options copt;
+
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&uc,&vc);
+hs_cache_init(&cache);
+copt = options;
+copt.cache = &cache;
+
+t_total[0] = t_total[1] = 0.0;
+err = 0.0f;
+a = alpha;
+e = epsilon_d;
+for (r=0; r<runs; r++)
+{
+    if ((r > 0) && (r % 4 != 0))
+    {
+        a = alpha * (1.0f + 0.25f*(r % 5));
+        if (r % 3 == 0)
+            e = epsilon_d * (1.0f + 0.5f*(r % 2));
+    }
+    for (m=0; m<2; m++)
+    {
+        t0 = wall_time();
+        HORN_SCHUNCK_MAIN_OPT(f1,f2,m ? uc : u,m ? vc : v,nx,ny,bx,by,
+                              1.0f,1.0f,a,e,epsilon_s,w_bright_grad,
+                              iter_inner,iter_outer,eta,omega,max_warp_levels,
+                              m ? &copt : &options);
+        t_step[m] = wall_time() - t0;
+        t_total[m] += t_step[m];
+    }
+    if (max_flow_difference(u,v,uc,vc,nx,ny,bx,by) > err)
+        err = max_flow_difference(u,v,uc,vc,nx,ny,bx,by);
+    printf("%-10s step %3d  alpha %7.3f  epsilon_d %7.4f  %9.2f ms  "
+           "cached %9.2f ms\n", label, r, a, e,
+           1000.0*t_step[0], 1000.0*t_step[1]);
+}
+printf("%-10s total %9.2f ms, cached %9.2f ms (%.2fx), difference %.2e px\n",
+       label, 1000.0*t_total[0], 1000.0*t_total[1], t_total[0]/t_total[1],
+       err);
+printf("%-10s cache: %ld pyramid builds, tensors %ld reused / %ld computed, "
+       "%ld results reused, %.1f MB of tensors\n", label,
+       cache.pyramid_builds, cache.tensor_hits, cache.tensor_misses,
+       cache.result_hits, cache.tensor_bytes/1048576.0);
+
+hs_cache_invalidate(&cache);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&uc,&vc);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_sweep ()
+
+/* sweeps alpha x {0.5,1,2}, epsilon_d x {1,10} and epsilon_s x {1,10}     */
+/* once as a loop over HORN_SCHUNCK_MAIN_OPT and once with                 */
+/* HORN_SCHUNCK_SWEEP, whose errors must agree, and prints the table       */
+
+{
+float  **u, **v, **gu, **gv;
+float  al[3], ed[2], es[2], ref_d, cal_d, aae, aepe;
+double t0, t_loop, t_sweep;
+int    n, k, same;
+hs_sweep_point *pts;
+
+if (strcmp(gtfile,"-") == 0)
+{
+    console_error("[bench_sweep] mode sweep needs gt <file>\n");
+    return;
+}
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&gu,&gv);
+read_barron_data(gtfile,gu,gv,nx,ny,bx,by);
+
+al[0] = 0.5f*alpha;      al[1] = alpha;      al[2] = 2.0f*alpha;
+ed[0] = epsilon_d;       ed[1] = 10.0f*epsilon_d;
+es[0] = epsilon_s;       es[1] = 10.0f*epsilon_s;
+n = hs_sweep_grid(al,3,ed,2,es,2,&w_bright_grad,1,&pts);
+
+t0 = wall_time();
+HORN_SCHUNCK_SWEEP(f1,f2,gu,gv,pts,n,nx,ny,bx,by,1.0f,1.0f,iter_inner,
+                   iter_outer,eta,omega,max_warp_levels,&options,threads);
+t_sweep = wall_time() - t0;
+
+same = 1;
+t0 = wall_time();
+for (k=0; k<n; k++)
+{
+    HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,pts[k].alpha,
+                          pts[k].epsilon_d,pts[k].epsilon_s,
+                          pts[k].w_bright_grad,iter_inner,iter_outer,eta,
+                          omega,max_warp_levels,&options);
+    calculate_errors_2d(gu,gv,u,v,nx,ny,bx,by,&aae,&aepe,&ref_d,&cal_d);
+    if ((aae != pts[k].aae) || (aepe != pts[k].aepe))
+        same = 0;
+}
+t_loop = wall_time() - t0;
+
+printf("%-10s      alpha  epsilon_d  epsilon_s  w_bright_grad     AAE    "
+       "AEPE        ms\n", label);
+for (k=0; k<n; k++)
+    printf("%-10s %10.3f %10.4f %10.4f %14.3f %7.3f %7.4f %9.2f\n", label,
+           pts[k].alpha, pts[k].epsilon_d, pts[k].epsilon_s,
+           pts[k].w_bright_grad, pts[k].aae, pts[k].aepe,
+           1000.0*pts[k].seconds);
+printf("%-10s %d points: loop %9.2f ms, sweep on %d threads %9.2f ms "
+       "(%.2fx), errors %s\n", label, n, 1000.0*t_loop, threads,
+       1000.0*t_sweep, t_loop/t_sweep, same ? "identical" : "DIFFER");
+
+free(pts);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&gu,&gv);
+}
+
+/*---------------------------------------------------------------------------*/
+
+long peak_rss_kb ()
+
+/* high water mark of the resident memory of the process in kB */
+
+{
+struct rusage ru;
+
+getrusage(RUSAGE_SELF,&ru);
+return ru.ru_maxrss;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int bench_tiled ()
+
+/* runs HORN_SCHUNCK_MAIN_TILED before anything of the image size is      */
+/* allocated, then reads the pair and the tiled flow and compares it to   */
+/* HORN_SCHUNCK_MAIN_OPT on the whole image; pixels within 8 of an inner  */
+/* tile border count as seam; returns 0 on failure                        */
+
+{
+char   flo[400];
+float  **u, **v, **ut, **vt, **gu, **gv;
+float  ref_d, cal_d, aae, aepe, d;
+double sum, sum_seam, max, max_seam, t0, t_full;
+long   rss_tiled, rss_full, n_seam;
+int    i, j, x, y, maxgv, seam;
+hs_tiled_info info;
+
+snprintf(flo,sizeof(flo),"%s/of_bench_tiled.flo",tmpdir);
+if (!HORN_SCHUNCK_MAIN_TILED(file1,file2,flo,tile,overlap,bx,by,alpha,
+                             epsilon_d,epsilon_s,w_bright_grad,iter_inner,
+                             iter_outer,eta,omega,max_warp_levels,&options,
+                             &info))
+    return 0;
+rss_tiled = peak_rss_kb();
+
+f1 = read_pgm_image(file1,&nx,&ny,bx,by,&maxgv);
+f2 = read_pgm_image(file2,&nx,&ny,bx,by,&maxgv);
+if (!f1 || !f2)
+    return 0;
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ut,&vt);
+t0 = wall_time();
+HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,alpha,epsilon_d,
+                      epsilon_s,w_bright_grad,iter_inner,iter_outer,eta,
+                      omega,max_warp_levels,&options);
+t_full = wall_time() - t0;
+rss_full = peak_rss_kb();
+read_flo_data(flo,ut,vt,nx,ny,bx,by);
+
+sum = sum_seam = max = max_seam = 0.0;
+n_seam = 0;
+for (i=0; i<nx; i++)
+    for (j=0; j<ny; j++)
+    {
+        x = i % tile;
+        y = j % tile;
+        seam = ((x < 8) && (i >= tile)) || ((x >= tile-8) && (i-x+tile < nx))
+            || ((y < 8) && (j >= tile)) || ((y >= tile-8) && (j-y+tile < ny));
+        d = sqrtf((u[i+bx][j+by]-ut[i+bx][j+by])*(u[i+bx][j+by]-ut[i+bx][j+by])
+                + (v[i+bx][j+by]-vt[i+bx][j+by])*(v[i+bx][j+by]-vt[i+bx][j+by]));
+        sum += d;
+        if (d > max) max = d;
+        if (seam)
+        {
+            sum_seam += d;
+            if (d > max_seam) max_seam = d;
+            n_seam++;
+        }
+    }
+
+printf("%-10s %dx%d: coarse 1/%d (%dx%d), %d tiles of %d+2x%d with %d "
+       "levels\n", label, nx, ny, info.coarse_factor, info.coarse_nx,
+       info.coarse_ny, info.tiles, tile, overlap, info.tile_levels);
+printf("%-10s tiled %9.2f ms (coarse %.2f ms), peak RSS %ld kB; untiled "
+       "%9.2f ms, peak RSS %ld kB\n", label,
+       1000.0*(info.seconds_coarse+info.seconds_tiles),
+       1000.0*info.seconds_coarse, rss_tiled, 1000.0*t_full, rss_full);
+printf("%-10s |w| tiled %.4f, untiled %.4f; tiled - untiled: mean %.4f px, "
+       "max %.4f px; seams: mean %.4f px, max %.4f px\n", label,
+       mean_flow_magnitude(ut,vt,nx,ny,bx,by),
+       mean_flow_magnitude(u,v,nx,ny,bx,by), sum/((double)nx*ny), max,
+       n_seam ? sum_seam/n_seam : 0.0, max_seam);
+if (strcmp(gtfile,"-") != 0)
+{
+    calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+    read_barron_data(gtfile,gu,gv,nx,ny,bx,by);
+    calculate_errors_2d(gu,gv,ut,vt,nx,ny,bx,by,&aae,&aepe,&ref_d,&cal_d);
+    printf("%-10s AEPE tiled %.4f", label, aepe);
+    calculate_errors_2d(gu,gv,u,v,nx,ny,bx,by,&aae,&aepe,&ref_d,&cal_d);
+    printf(", untiled %.4f\n", aepe);
+    free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+}
+
+remove(flo);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&ut,&vt);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void synthetic_pair
+(
+                     /********************************************************/
+    float **g1,      /* out : 1st image                                      */
+    float **g2,      /* out : 2nd image, shifted by (0.5, 0.25)              */
+    int   mx,        /* in  : size in x-direction                            */
+    int   my         /* in  : size in y-direction                            */
+                     /********************************************************/
+)
+
+/* smooth test pair with the known flow (0.5, 0.25) everywhere */
+
+{
+int i,j;
+
+for (i=bx; i<mx+bx; i++)
+    for (j=by; j<my+by; j++)
+    {
+        g1[i][j] = 128.0f + 60.0f*sinf(0.15f*(i-bx))*cosf(0.11f*(j-by));
+        g2[i][j] = 128.0f + 60.0f*sinf(0.15f*(i-bx-0.5f))
+                                 *cosf(0.11f*(j-by-0.25f));
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+int bench_large_bytes ()
+
+/* allocates a large_bytes x large_bytes plane of one byte elements: more  */
+/* than 2^31 elements in the memory of the float plane of bench_large, so  */
+/* an int element count overflows here first; checks the extent and the    */
+/* sum of a fill pattern; returns 0 on failure                             */
+
+{
+unsigned char **c;
+size_t total, extent;
+long long sum, expect;
+int    i, j, mx, my, ok;
+double t0;
+
+mx    = large_bytes+2*bx;
+my    = large_bytes+2*by;
+total = (size_t)mx * my;
+printf("%-10s byte plane %dx%d: %zu elements (2^31 = %zu)\n", label,
+       large_bytes, large_bytes, total, (size_t)1 << 31);
+
+t0 = wall_time();
+if (!malloc_multi(1,2,sizeof(unsigned char),large_bytes,large_bytes,bx,by,
+                  0,0,&c))
+    return 0;
+extent = (size_t)(&c[mx-1][my-1] - &c[0][0]) + 1;
+
+/* rows alternate 1 and 3, boundaries included */
+for (i=0; i<mx; i++)
+    for (j=0; j<my; j++)
+        c[i][j] = (unsigned char)(1 + 2*(j & 1));
+sum = 0;
+for (i=0; i<mx; i++)
+    for (j=0; j<my; j++)
+        sum += c[i][j];
+expect = (long long)mx * (my + 2*(my/2));
+free_multi(1,2,sizeof(unsigned char),large_bytes,large_bytes,bx,by,0,0,&c);
+
+ok = (extent == total) && (sum == expect);
+printf("%-10s extent %zu elements, sum %lld of %lld (%s), %.2f s\n", label,
+       extent, sum, expect, ok ? "ok" : "WRONG", wall_time()-t0);
+return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int bench_large ()
+
+/* allocates a plane of large_nx x large_ny with bounds, checks that its   */
+/* last element lies where 64 bit offsets put it, fills it, restricts it   */
+/* to half the size and compares the means; then bench_large_bytes; with   */
+/* large_solve the flow of a synthetic pair shifted by (0.5, 0.25) is      */
+/* computed at that size; returns 0 on failure                             */
+
+{
+float  **u, **v, **h, **tmp, **g1, **g2;
+double sum, sum_h, epe, t0;
+size_t total, extent;
+int    i, j, mx, my, ok;
+
+total = (size_t)(large_nx+2*bx) * (large_ny+2*by);
+printf("%-10s plane %dx%d: %zu elements, %zu bytes\n", label, large_nx,
+       large_ny, total, total*sizeof(float));
+
+t0 = wall_time();
+if (!malloc_multi(1,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&u))
+    return 0;
+extent = (size_t)(&u[large_nx+2*bx-1][large_ny+2*by-1] - &u[0][0]) + 1;
+ok = (extent == total);
+
+/* fill with a pattern whose mean is known: rows alternate 1 and 3 */
+for (i=0; i<large_nx+2*bx; i++)
+    for (j=0; j<large_ny+2*by; j++)
+        u[i][j] = (float)(1 + 2*(j & 1));
+set_bounds_2d(u,large_nx,large_ny,bx,by,(float)0.0);
+sum = 0.0;
+for (i=bx; i<large_nx+bx; i++)
+    for (j=by; j<large_ny+by; j++)
+        sum += u[i][j];
+
+/* area based restriction to half the size keeps the mean */
+mx = large_nx/2;
+my = large_ny/2;
+if (!malloc_multi(1,2,sizeof(float),mx,my,bx,by,0,0,&h))
+    return 0;
+if (!malloc_multi(1,2,sizeof(float),large_nx,my,bx,by,0,0,&tmp))
+    return 0;
+resample_2d(u,large_nx,large_ny,bx,by,h,mx,my,tmp);
+free_multi(1,2,sizeof(float),large_nx,my,bx,by,0,0,&tmp);
+sum_h = 0.0;
+for (i=bx; i<mx+bx; i++)
+    for (j=by; j<my+by; j++)
+        sum_h += h[i][j];
+free_multi(1,2,sizeof(float),mx,my,bx,by,0,0,&h);
+free_multi(1,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&u);
+
+printf("%-10s extent %zu elements (%s), mean %.6f, restricted mean %.6f, "
+       "%.2f s\n", label, extent, ok ? "ok" : "WRONG",
+       sum/((double)large_nx*large_ny), sum_h/((double)mx*my),
+       wall_time()-t0);
+if (ok && (large_bytes > 0))
+    ok = bench_large_bytes();
+if (!ok || !large_solve)
+    return ok;
+
+/* synthetic pair, the 2nd image is the 1st shifted by (0.5, 0.25) */
+if (!malloc_multi(2,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&g1,&g2) ||
+    !calloc_multi(2,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&u,&v))
+    return 0;
+synthetic_pair(g1,g2,large_nx,large_ny);
+t0 = wall_time();
+HORN_SCHUNCK_MAIN_OPT(g1,g2,u,v,large_nx,large_ny,bx,by,1.0f,1.0f,alpha,
+                      epsilon_d,epsilon_s,w_bright_grad,iter_inner,iter_outer,
+                      eta,omega,max_warp_levels,&options);
+epe = 0.0;
+for (i=bx; i<large_nx+bx; i++)
+    for (j=by; j<large_ny+by; j++)
+        epe += sqrt((u[i][j]-0.5f)*(u[i][j]-0.5f)
+                    + (v[i][j]-0.25f)*(v[i][j]-0.25f));
+printf("%-10s solve %dx%d: %.2f s, mean endpoint error %.4f px\n", label,
+       large_nx, large_ny, wall_time()-t0, epe/((double)large_nx*large_ny));
+
+free_multi(2,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&g1,&g2);
+free_multi(2,2,sizeof(float),large_nx,large_ny,bx,by,0,0,&u,&v);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+long huge_page_kb ()
+
+/* memory of the process in transparent or hugetlbfs huge pages in kB */
+
+{
+FILE   *f;
+char   line[256];
+long   kb, sum = 0;
+
+f = fopen("/proc/self/smaps_rollup","r");
+if (!f)
+    return -1;
+while (fgets(line,sizeof(line),f))
+    if ((sscanf(line,"AnonHugePages: %ld kB",&kb) == 1) ||
+        (sscanf(line,"Private_Hugetlb: %ld kB",&kb) == 1))
+        sum += kb;
+fclose(f);
+return sum;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_alloc ()
+
+/* times the solver under every allocation policy of malloc_multi; the     */
+/* throughput counts SOR point updates (hs_stats sor_updates); the flow    */
+/* must not depend on the policy                                           */
+
+{
+static const char *names[4] = { "plain", "aligned64", "thp", "hugetlb" };
+float  **u, **v, **u0, **v0, **p[6];
+double *t, t0, t_med;
+long   huge;
+int    k, r, policy, previous;
+hs_stats stats;
+
+calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u0,&v0);
+t = (double*)malloc(runs*sizeof(double));
+previous = malloc_multi_policy(MALLOC_MULTI_PLAIN);
+compute_flow(u0,v0);
+
+for (k=MALLOC_MULTI_PLAIN; k<=MALLOC_MULTI_HUGETLB; k++)
+{
+    malloc_multi_policy(k);
+    policy = malloc_multi_policy(-1);
+    calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v);
+
+    compute_flow(u,v);
+    for (r=0; r<runs; r++)
+    {
+        t0 = wall_time();
+        compute_flow(u,v);
+        t[r] = wall_time() - t0;
+    }
+    t_med = median_double(t,runs);
+    options.stats = &stats;
+    compute_flow(u,v);
+    options.stats = NULL;
+
+    /* huge pages behind six solver-sized planes */
+    malloc_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,
+                 &p[0],&p[1],&p[2],&p[3],&p[4],&p[5]);
+    for (r=0; r<6; r++)
+        memset(&p[r][0][0],0,(size_t)(nx+2*bx)*(ny+2*by)*sizeof(float));
+    huge = huge_page_kb();
+    free_multi(6,2,sizeof(float),nx,ny,bx,by,0,0,
+               &p[0],&p[1],&p[2],&p[3],&p[4],&p[5]);
+
+    printf("%-10s %-9s (as %-9s) median %9.2f ms, %8.1f M SOR updates/s, "
+           "huge pages %6ld kB, difference %.2e\n", label, names[k],
+           names[policy], 1000.0*t_med, stats.sor_updates/t_med/1e6, huge,
+           max_flow_difference(u,v,u0,v0,nx,ny,bx,by));
+    free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v);
+}
+
+malloc_multi_policy(previous);
+free(t);
+free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&u0,&v0);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int bench_memory ()
+
+/* peak bytes of malloc_multi during one solve, with and without the low   */
+/* memory mode; on the input pair, or with mem_nx and mem_ny on a          */
+/* synthetic pair of that size; returns 0 on failure                       */
+
+{
+static const char *names[2] = { "default", "low_memory" };
+float  **g1, **g2, **u, **v, **u0, **v0;
+size_t base, peak;
+double t0, t;
+int    mx, my, k, low_memory;
+
+mx = (mem_nx > 0) ? mem_nx : nx;
+my = (mem_ny > 0) ? mem_ny : ny;
+if (mem_nx > 0)
+{
+    if (!malloc_multi(2,2,sizeof(float),mx,my,bx,by,0,0,&g1,&g2))
+        return 0;
+    synthetic_pair(g1,g2,mx,my);
+}
+else
+{
+    g1 = f1;
+    g2 = f2;
+}
+if (!calloc_multi(4,2,sizeof(float),mx,my,bx,by,0,0,&u,&v,&u0,&v0))
+    return 0;
+
+low_memory = options.low_memory;
+for (k=0; k<2; k++)
+{
+    options.low_memory = k;
+    malloc_multi_usage(&base,NULL);
+    malloc_multi_reset_peak();
+    t0 = wall_time();
+    HORN_SCHUNCK_MAIN_OPT(g1,g2,k ? u : u0,k ? v : v0,mx,my,bx,by,1.0f,1.0f,
+                          alpha,epsilon_d,epsilon_s,w_bright_grad,iter_inner,
+                          iter_outer,eta,omega,max_warp_levels,&options);
+    t = wall_time() - t0;
+    malloc_multi_usage(NULL,&peak);
+    printf("%-10s %dx%d %-10s peak %8.1f MB (%5.1f planes), solver %8.1f MB "
+           "(%5.1f planes), %.2f s\n", label, mx, my, names[k],
+           peak/1048576.0,
+           peak/((double)(mx+2*bx)*(my+2*by)*sizeof(float)),
+           (peak-base)/1048576.0,
+           (peak-base)/((double)(mx+2*bx)*(my+2*by)*sizeof(float)), t);
+}
+options.low_memory = low_memory;
+printf("%-10s low_memory - default: difference %.2e px\n", label,
+       max_flow_difference(u,v,u0,v0,mx,my,bx,by));
+
+free_multi(4,2,sizeof(float),mx,my,bx,by,0,0,&u,&v,&u0,&v0);
+if (mem_nx > 0)
+    free_multi(2,2,sizeof(float),mx,my,bx,by,0,0,&g1,&g2);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_storage ()
+
+/* times the solver with the motion tensor in float32, float16 and         */
+/* bfloat16 storage; reports the tensor bytes read per SOR sweep, the      */
+/* difference to the float32 flow and, with gt, the endpoint error         */
+
+{
+static const char *names[3] = { "float32", "float16", "bfloat16" };
+static const int  bytes[3]  = { 4, 2, 2 };
+float  **u, **v, **u0, **v0, **uk, **vk, **gu, **gv;
+double *t, t0, t_med;
+int    k, r, storage;
+hs_stats stats;
+
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&u0,&v0);
+if (strcmp(gtfile,"-") != 0)
+{
+    calloc_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+    read_barron_data(gtfile,gu,gv,nx,ny,bx,by);
+}
+t = (double*)malloc(runs*sizeof(double));
+storage = options.tensor_storage;
+
+for (k=HS_STORAGE_FLOAT32; k<=HS_STORAGE_BFLOAT16; k++)
+{
+    /* the float32 flow is the reference of the others */
+    options.tensor_storage = k;
+    uk = (k == HS_STORAGE_FLOAT32) ? u0 : u;
+    vk = (k == HS_STORAGE_FLOAT32) ? v0 : v;
+    compute_flow(uk,vk);
+    for (r=0; r<runs; r++)
+    {
+        t0 = wall_time();
+        compute_flow(uk,vk);
+        t[r] = wall_time() - t0;
+    }
+    t_med = median_double(t,runs);
+    options.stats = &stats;
+    compute_flow(uk,vk);
+    options.stats = NULL;
+
+    printf("%-10s %-8s median %9.2f ms, %6.1f M SOR updates/s, tensor "
+           "%2d B/pixel/sweep, difference %.2e px", label, names[k],
+           1000.0*t_med, stats.sor_updates/t_med/1e6, 5*bytes[k],
+           max_flow_difference(uk,vk,u0,v0,nx,ny,bx,by));
+    if (strcmp(gtfile,"-") != 0)
+        printf(", AEPE %.4f px", mean_endpoint_error(uk,vk,gu,gv,nx,ny,bx,by));
+    printf("\n");
+}
+
+options.tensor_storage = storage;
+if (strcmp(gtfile,"-") != 0)
+    free_multi(2,2,sizeof(float),nx,ny,bx,by,0,0,&gu,&gv);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&u0,&v0);
+free(t);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* hardware counters of mode layout */
+#define NUM_COUNTERS 5
+static const char *counter_names[NUM_COUNTERS] =
+    { "cycles", "instructions", "LLC refs", "LLC misses", "L1d misses" };
+
+int open_counters
+(
+                     /********************************************************/
+    int   *fd        /* out : NUM_COUNTERS descriptors, -1 if unavailable    */
+                     /********************************************************/
+)
+
+/* opens the counters of this thread, disabled, user space only; returns  */
+/* the number that could be opened                                       */
+
+{
+static const unsigned long long config[NUM_COUNTERS] =
+    { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+struct perf_event_attr attr;
+int    k, n = 0;
+
+for (k=0; k<NUM_COUNTERS; k++)
+{
+    memset(&attr,0,sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = (k < 4) ? PERF_TYPE_HARDWARE : PERF_TYPE_HW_CACHE;
+    attr.config         = config[k];
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    fd[k] = (int)syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+    if (fd[k] >= 0)
+        n++;
+}
+return n;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void switch_counters
+(
+                     /********************************************************/
+    int   *fd,       /* in : descriptors of open_counters                    */
+    int   on         /* in : 1: reset and enable, 0: disable                 */
+                     /********************************************************/
+)
+
+/* starts or stops the open counters */
+
+{
+int k;
+
+for (k=0; k<NUM_COUNTERS; k++)
+    if (fd[k] >= 0)
+    {
+        if (on)
+            ioctl(fd[k],PERF_EVENT_IOC_RESET,0);
+        ioctl(fd[k],on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE,0);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_layout ()
+
+/* times the plain SOR solver with separate planes and with interleaved    */
+/* records, with the hardware counters of the timed runs per SOR update   */
+/* where available; the flow must not depend on the layout                */
+
+{
+static const char *names[2] = { "planes", "interleaved" };
+float  **u, **v, **u0, **v0, **uk, **vk;
+double *t, t0, t_med;
+long long count;
+int    fd[NUM_COUNTERS];
+int    k, c, r, interleaved, have;
+hs_stats stats;
+
+calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&u0,&v0);
+t = (double*)malloc(runs*sizeof(double));
+have = open_counters(fd);
+if (have == 0)
+    printf("%-10s no hardware counters (perf_event_open failed), timing "
+           "only\n", label);
+interleaved = options.interleaved;
+
+for (k=0; k<2; k++)
+{
+    /* the flow on separate planes is the reference */
+    options.interleaved = k;
+    uk = (k == 0) ? u0 : u;
+    vk = (k == 0) ? v0 : v;
+    compute_flow(uk,vk);
+    options.stats = &stats;
+    compute_flow(uk,vk);
+    options.stats = NULL;
+
+    switch_counters(fd,1);
+    for (r=0; r<runs; r++)
+    {
+        t0 = wall_time();
+        compute_flow(uk,vk);
+        t[r] = wall_time() - t0;
+    }
+    switch_counters(fd,0);
+    t_med = median_double(t,runs);
+
+    printf("%-10s %-11s inner %2d  median %9.2f ms, %6.1f M SOR updates/s, "
+           "difference %.2e px\n", label, names[k], iter_inner,
+           1000.0*t_med, stats.sor_updates/t_med/1e6,
+           max_flow_difference(uk,vk,u0,v0,nx,ny,bx,by));
+    if (have > 0)
+    {
+        printf("%-10s %-11s per SOR update:", label, names[k]);
+        for (c=0; c<NUM_COUNTERS; c++)
+            if ((fd[c] >= 0) && (read(fd[c],&count,sizeof(count)) ==
+                                 sizeof(count)))
+                printf("  %s %.2f", counter_names[c],
+                       count/(runs*stats.sor_updates));
+        printf("\n");
+    }
+}
+
+options.interleaved = interleaved;
+for (c=0; c<NUM_COUNTERS; c++)
+    if (fd[c] >= 0)
+        close(fd[c]);
+free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u,&v,&u0,&v0);
+free(t);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void bench_pipeline ()
+
+/* solves the pairs of a sequence of frames frames (f1, f2, f1, f2, ...)  */
+/* once as a loop over HORN_SCHUNCK_MAIN_OPT and with HORN_SCHUNCK_PIPELINE */
+/* on 1 .. stages stages, whose flow must agree; prints pairs/s and the   */
+/* time from the start to the end of a pair, and from the CPU time of the */
+/* stages the rate and latency with a core per stage                      */
+
+{
+float  ***f, ***u, ***v, ***us, ***vs;
+float  d, dmax;
+double t0, t_loop, lat, lat_max, cpu_max, cpu_sum;
+int    n, t, s, k;
+hs_pipeline_info info;
+
+if (frames < 2) frames = 2;
+n  = frames - 1;
+f  = (float***)malloc(frames*sizeof(float**));
+u  = (float***)malloc(n*sizeof(float**));
+v  = (float***)malloc(n*sizeof(float**));
+us = (float***)malloc(n*sizeof(float**));
+vs = (float***)malloc(n*sizeof(float**));
+for (t=0; t<frames; t++)
+    f[t] = (t % 2) ? f2 : f1;
+for (t=0; t<n; t++)
+    calloc_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u[t],&v[t],&us[t],&vs[t]);
+
+/* the loop is the reference; its latency is the time of one solve */
+lat = lat_max = 0.0;
+t_loop = wall_time();
+for (t=0; t<n; t++)
+{
+    t0 = wall_time();
+    HORN_SCHUNCK_MAIN_OPT(f[t],f[t+1],us[t],vs[t],nx,ny,bx,by,1.0f,1.0f,
+                          alpha,epsilon_d,epsilon_s,w_bright_grad,iter_inner,
+                          iter_outer,eta,omega,max_warp_levels,&options);
+    t0 = wall_time() - t0;
+    lat += t0/n;
+    if (t0 > lat_max) lat_max = t0;
+}
+t_loop = wall_time() - t_loop;
+printf("%-10s %d pairs, %ld cores\n", label, n,
+       sysconf(_SC_NPROCESSORS_ONLN));
+printf("%-10s loop        %7.2f pairs/s, latency mean %8.2f ms, max "
+       "%8.2f ms\n", label, n/t_loop, 1000.0*lat, 1000.0*lat_max);
+
+for (s=1; s<=stages; s++)
+{
+    HORN_SCHUNCK_PIPELINE(f,frames,u,v,nx,ny,bx,by,1.0f,1.0f,alpha,
+                          epsilon_d,epsilon_s,w_bright_grad,iter_inner,
+                          iter_outer,eta,omega,max_warp_levels,&options,s,
+                          &info);
+    dmax = 0.0f;
+    for (t=0; t<n; t++)
+    {
+        d = max_flow_difference(u[t],v[t],us[t],vs[t],nx,ny,bx,by);
+        if (d > dmax) dmax = d;
+    }
+    printf("%-10s %2d stages  %7.2f pairs/s, latency mean %8.2f ms, max "
+           "%8.2f ms, difference %.2e px, levels", label, info.stages,
+           n/info.seconds, 1000.0*info.latency_mean,
+           1000.0*info.latency_max, dmax);
+    for (k=0; k<info.stages; k++)
+        printf(" %d-%d", info.first_depth[k],
+               (k < info.stages-1) ? info.first_depth[k+1]+1 : 0);
+    printf("\n");
+
+    /* with a core per stage the slowest stage sets the rate and a pair */
+    /* takes the sum of its stages                                       */
+    cpu_max = cpu_sum = 0.0;
+    for (k=0; k<info.stages; k++)
+    {
+        cpu_sum += info.stage_seconds[k]/n;
+        if (info.stage_seconds[k]/n > cpu_max)
+            cpu_max = info.stage_seconds[k]/n;
+    }
+    printf("%-10s %2d stages  CPU ms per pair:", label, info.stages);
+    for (k=0; k<info.stages; k++)
+        printf(" %.2f", 1000.0*info.stage_seconds[k]/n);
+    printf(" -> on %d cores %7.2f pairs/s, latency %8.2f ms\n",
+           info.stages, 1.0/cpu_max, 1000.0*cpu_sum);
+}
+
+for (t=0; t<n; t++)
+    free_multi(4,2,sizeof(float),nx,ny,bx,by,0,0,&u[t],&v[t],&us[t],&vs[t]);
+free(f);
+free(u);
+free(v);
+free(us);
+free(vs);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int main (int argc, char* argv[])
+{
+char   mode[200];
+char   *console_string = (char*)calloc(3000,sizeof(char));
+int    maxgv, verbose;
+
+parse_arg_string(argc,argv,"mode",mode,"solve",console_string);
+parse_arg_string(argc,argv,"f1",file1,"../demo/f1.pgm",console_string);
+parse_arg_string(argc,argv,"f2",file2,"../demo/f2.pgm",console_string);
+parse_arg_string(argc,argv,"label",label,"-",console_string);
+parse_arg_string(argc,argv,"out",outfile,"-",console_string);
+parse_arg_string(argc,argv,"gt",gtfile,"-",console_string);
+parse_arg_string(argc,argv,"tmpdir",tmpdir,"/tmp",console_string);
+parse_arg_int   (argc,argv,"bordersizex",&bx,2,console_string);
+parse_arg_int   (argc,argv,"bordersizey",&by,2,console_string);
+parse_arg_float (argc,argv,"alpha",&alpha,5.0f,console_string);
+parse_arg_float (argc,argv,"epsilon_d",&epsilon_d,0.01f,console_string);
+parse_arg_float (argc,argv,"epsilon_s",&epsilon_s,0.01f,console_string);
+parse_arg_float (argc,argv,"w_bright_grad",&w_bright_grad,0.0f,console_string);
+parse_arg_int   (argc,argv,"iterations_inner",&iter_inner,1,console_string);
+parse_arg_int   (argc,argv,"iterations_outer",&iter_outer,15,console_string);
+parse_arg_float (argc,argv,"omega",&omega,1.96f,console_string);
+parse_arg_float (argc,argv,"eta",&eta,0.92f,console_string);
+parse_arg_int   (argc,argv,"max_warp_levels",&max_warp_levels,200,console_string);
+parse_arg_int   (argc,argv,"runs",&runs,5,console_string);
+parse_arg_int   (argc,argv,"lanes",&lanes,8,console_string);
+parse_arg_int   (argc,argv,"crop_nx",&crop_nx,128,console_string);
+parse_arg_int   (argc,argv,"crop_ny",&crop_ny,96,console_string);
+parse_arg_int   (argc,argv,"threads",&threads,
+                 (int)sysconf(_SC_NPROCESSORS_ONLN),console_string);
+parse_arg_int   (argc,argv,"tile",&tile,256,console_string);
+parse_arg_int   (argc,argv,"overlap",&overlap,32,console_string);
+parse_arg_int   (argc,argv,"large_nx",&large_nx,23200,console_string);
+parse_arg_int   (argc,argv,"large_ny",&large_ny,23200,console_string);
+parse_arg_int   (argc,argv,"solve",&large_solve,0,console_string);
+parse_arg_int   (argc,argv,"large_bytes",&large_bytes,46342,console_string);
+parse_arg_int   (argc,argv,"alloc",&alloc_policy,MALLOC_MULTI_PLAIN,
+                 console_string);
+parse_arg_int   (argc,argv,"mem_nx",&mem_nx,0,console_string);
+parse_arg_int   (argc,argv,"mem_ny",&mem_ny,0,console_string);
+parse_arg_int   (argc,argv,"frames",&frames,9,console_string);
+parse_arg_int   (argc,argv,"stages",&stages,4,console_string);
+hs_default_options(&options);
+parse_arg_int   (argc,argv,"sor_weights",&options.sor_weights,
+                 options.sor_weights,console_string);
+parse_arg_int   (argc,argv,"adaptive_omega",&options.adaptive_omega,
+                 options.adaptive_omega,console_string);
+parse_arg_float (argc,argv,"inner_tolerance",&options.inner_tolerance,
+                 options.inner_tolerance,console_string);
+parse_arg_int   (argc,argv,"line_relax",&options.line_relax,
+                 options.line_relax,console_string);
+parse_arg_float (argc,argv,"line_omega",&options.line_omega,
+                 options.line_omega,console_string);
+parse_arg_int   (argc,argv,"pcg",&options.pcg,options.pcg,console_string);
+parse_arg_int   (argc,argv,"tvl1",&options.tvl1,options.tvl1,console_string);
+parse_arg_int   (argc,argv,"tvl1_iterations",&options.tvl1_iterations,
+                 options.tvl1_iterations,console_string);
+parse_arg_int   (argc,argv,"low_memory",&options.low_memory,
+                 options.low_memory,console_string);
+parse_arg_int   (argc,argv,"tensor_storage",&options.tensor_storage,
+                 options.tensor_storage,console_string);
+parse_arg_int   (argc,argv,"interleaved",&options.interleaved,
+                 options.interleaved,console_string);
+parse_arg_int   (argc,argv,"verbose",&verbose,0,console_string);
+if (verbose)
+    printf("------\n%s---------\n",console_string);
+if (runs < 1) runs = 1;
+malloc_multi_policy(alloc_policy);
+
+/* modes without the input pair */
+if (strcmp(mode,"large") == 0)
+{
+    free(console_string);
+    return bench_large() ? 0 : 1;
+}
+
+/* the tiled mode reads the full images only after its own run */
+if (strcmp(mode,"tiled") == 0)
+{
+    if (!bench_tiled())
+        return 1;
+    free_pgm_image(f1,nx,ny,bx,by);
+    free_pgm_image(f2,nx,ny,bx,by);
+    free(console_string);
+    return 0;
+}
+
+f1 = read_pgm_image(file1,&nx,&ny,bx,by,&maxgv);
+f2 = read_pgm_image(file2,&nx,&ny,bx,by,&maxgv);
+if (!f1 || !f2)
+    return 1;
+
+if (strcmp(mode,"solve") == 0)
+    bench_solve();
+else if (strcmp(mode,"flowio") == 0)
+    bench_flowio();
+else if (strcmp(mode,"imageio") == 0)
+    bench_imageio();
+else if (strcmp(mode,"batch") == 0)
+    bench_batch();
+else if (strcmp(mode,"bidir") == 0)
+    bench_bidir();
+else if (strcmp(mode,"tune") == 0)
+    bench_tune();
+else if (strcmp(mode,"sweep") == 0)
+    bench_sweep();
+else if (strcmp(mode,"alloc") == 0)
+    bench_alloc();
+else if (strcmp(mode,"storage") == 0)
+    bench_storage();
+else if (strcmp(mode,"layout") == 0)
+    bench_layout();
+else if (strcmp(mode,"pipeline") == 0)
+    bench_pipeline();
+else if (strcmp(mode,"memory") == 0)
+{
+    if (!bench_memory())
+        return 1;
+}
+else
+{
+    console_error("Unknown mode %s!\n", mode);
+    return 1;
+}
+
+free_pgm_image(f1,nx,ny,bx,by);
+free_pgm_image(f2,nx,ny,bx,by);
+free(console_string);
+return 0;
+}
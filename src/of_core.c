@@ -0,0 +1,21 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Translation unit of the headless flow core library (libofcore).          */
+/*                                                                           */
+/* Collects the solver, the file I/O and the error measures into one object */
+/* without any GL/GLUT dependency. Programs linking the library include      */
+/* of_core.h; the GL frontends keep including the *_lib.c files directly.    */
+/*                                                                           */
+/*****************************************************************************/
+
+#include "horn_schunck_warp_c.c"
+#include "horn_schunck_batch_c.c"
+#include "horn_schunck_bidir_c.c"
+#include "io_lib.c"
+#include "of_lib.c"
+#include "flow_io_lib.c"
+#include "timer_lib.c"
+#include "horn_schunck_sweep_c.c"
+#include "horn_schunck_tiled_c.c"
+#include "horn_schunck_pipeline_c.c"
+#include "of_core.h"
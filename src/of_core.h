@@ -0,0 +1,93 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Public interface of the headless flow core library (libofcore).          */
+/* See of_core.c and the "lib" target of the Makefile.                       */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef OF_CORE_H_INCLUDED
+#define OF_CORE_H_INCLUDED
+
+#include "horn_schunck_warp_c.h"
+#include "horn_schunck_batch_c.h"
+#include "horn_schunck_bidir_c.h"
+#include "horn_schunck_sweep_c.h"
+#include "horn_schunck_tiled_c.h"
+#include "horn_schunck_pipeline_c.h"
+#include "flow_io_lib.h"
+
+/* ---- console messages (console_lib.c) ---------------------------------- */
+
+void  console_error   (const char *formatstring, ...);
+void  console_warning (const char *formatstring, ...);
+void  console_info    (const char *formatstring, ...);
+
+/* ---- memory (malloc_lib.c) ---------------------------------------------- */
+
+#define MALLOC_MULTI_PLAIN    0   /* malloc / calloc                         */
+#define MALLOC_MULTI_ALIGNED  1   /* 64 byte aligned block start             */
+#define MALLOC_MULTI_THP      2   /* 2 MB aligned, MADV_HUGEPAGE             */
+#define MALLOC_MULTI_HUGETLB  3   /* MAP_HUGETLB, falls back to THP          */
+
+int   malloc_multi_policy (int policy);
+void  malloc_multi_usage (size_t *current, size_t *peak);
+size_t malloc_multi_reset_peak (void);
+int   malloc_multi (int number, int dimensions, int elementsize, ...);
+int   calloc_multi (int number, int dimensions, int elementsize, ...);
+void  free_multi   (int number, int dimensions, int elementsize, ...);
+
+/* ---- plane kernels (bounds_lib.c, mg_trans_lib.c) ---------------------- */
+
+void  set_bounds_2d
+     (float **u, int nx, int ny, int bx, int by, float value);
+void  resample_2d
+     (float **u, int nx, int ny, int bx, int by, float **u_out, int mx,
+      int my, float **tmp);
+
+/* ---- file I/O (io_lib.c) ------------------------------------------------ */
+
+float **read_pgm_image
+     (const char *filename, int *width, int *height, int bx, int by,
+      int *max_grey_value);
+float **read_pgm_image_mapped
+     (const char *filename, int *width, int *height, int bx, int by,
+      int *max_grey_value);
+float ***read_ppm_image
+     (const char *filename, int *width, int *height, int bx, int by,
+      int *max_grey_value);
+float ***read_ppm_image_mapped
+     (const char *filename, int *width, int *height, int bx, int by,
+      int *max_grey_value);
+void  free_pgm_image
+     (float **image, int width, int height, int bx, int by);
+void  free_ppm_image
+     (float ***image, int width, int height, int bx, int by);
+void  write_ppm_image
+     (const char *filename, int width, int height, int bx, int by,
+      float ***image, int bytes, ...);
+void  read_barron_data
+     (char *filename, float **u, float **v, int nx, int ny, int bx, int by);
+int   read_barron_data_mapped
+     (const char *filename, float **u, float **v, int nx, int ny, int bx,
+      int by);
+int   write_barron_data
+     (char *filename, float **u, float **v, int nx, int ny, int bx, int by);
+int   write_barron_data_checked
+     (const char *filename, float **u, float **v, int nx, int ny, int bx,
+      int by);
+/* .flo files and flow streams: see flow_io_lib.h */
+
+/* ---- error measures (of_lib.c) ------------------------------------------ */
+
+void  calculate_errors_2d
+     (float **uref, float **vref, float **u, float **v, int nx, int ny,
+      int bx, int by, float *aae, float *al2e, float *ref_d, float *cal_d);
+
+/* ---- timing (timer_lib.c) ----------------------------------------------- */
+
+double wall_time     (void);
+double thread_time   (void);
+double median_double (double *t, int n);
+
+#endif
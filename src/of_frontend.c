@@ -11,10 +11,14 @@
 /* This C-Code will open a GLUT-window and display the image that has been   */
 /* specified as commandline argument. By pressing the '.'-button the         */
 /* computation is started (see compute()).                                   */
+/*                                                                           */
+/* With "sequence <n>" it runs headless over the frames <basename>1.pgm to   */
+/* <basename><n>.pgm instead (see run_sequence()).                           */
 /*-------------------------------------------------------------------------------------*/
 
 #include <GL/glut.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "frontend_lib.c"
 #include "malloc_lib.c"
@@ -23,9 +27,12 @@
 #include "matrix_lib.c"
 #include "arg_utils.c"
 #include "color_lib.c"
-#include "horn_schunck_warp.c"
+#include "horn_schunck_warp_c.c"
 #include "of_lib.c"
 #include "diffusivity_lib.c"
+#include "flow_io_lib.c"
+#include "queue_lib.c"
+#include "timer_lib.c"
 
 typedef unsigned char uchar;
 char basename[200];
@@ -42,6 +49,8 @@ int    bx,by;                   // border sizes
 
 float  alpha;                   // smoothness weight
 float  epsilon_d;               // diffusivity param data term
+float  epsilon_s;               // diffusivity param smoothness term
+float  w_bright_grad;           // weight gradient vs. brightness constancy
 int    diffusivity_type_d;      // nonlinearity function data term
 int    num_iterations_inner;    // number of solver iterations
 int    num_iterations_outer;    // number of fixed point iterations (nonlinearity)
@@ -57,6 +66,13 @@ uchar  active_param;            // which option is active
 int    num_images_side_by_side; // number of images shown side by side
 GLuint gl_rgb_tex;              // texture identifyier  
 
+int    sequence;                // number of frames in sequence mode, 0: off
+char   sequence_out[200];       // prefix of the flow files in sequence mode
+int    queue_depth;             // frames / flow fields queued in sequence mode
+int    pipeline;                // overlap reading and writing with compute
+hs_options options;             // solver implementation choices
+hs_cache cache;                 // stages kept between compute() calls
+
 /*-------------------------------------------------------------------------------------*/
 
 void handleDraw()
@@ -84,6 +100,8 @@ void writeParamsToStr(char* tgt)
 	printTitleLine(tgt,"optic flow frontend");
 	showParamLinef(tgt,active_param,'a',"Smoothness weight alpha",&alpha);
 	showParamLinef(tgt,active_param,'E',"Diffusivity param Data",&epsilon_d);
+	showParamLinef(tgt,active_param,'S',"Diffusivity param Smoothness",&epsilon_s);
+	showParamLinef(tgt,active_param,'w',"Weight gradient constancy",&w_bright_grad);
 	showParamLinei(tgt,active_param,'i',"Number inner iterations",&num_iterations_inner);
 	showParamLinei(tgt,active_param,'I',"Number outer iterations",&num_iterations_outer);
 	showParamLineStr(tgt,active_param,'d',"Diffusivity type Data",diffusivity_names[diffusivity_type_d]);
@@ -136,9 +154,9 @@ void compute()
 	
 	/* compute from function	*/
 	
-	HORN_SCHUNCK_MAIN(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,
-					  alpha,epsilon_d,diffusivity_type_d,num_iterations_inner,
-					  num_iterations_outer,omega,warp_eta,max_warp_levels);
+	HORN_SCHUNCK_MAIN_OPT(f1,f2,u,v,nx,ny,bx,by,1.0f,1.0f,
+					  alpha,epsilon_d,epsilon_s,w_bright_grad,num_iterations_inner,
+					  num_iterations_outer,warp_eta,omega,max_warp_levels,&options);
 	
 
 	/* read u and v from txt file */
@@ -183,6 +201,8 @@ void handleKeyboardspecial(int key, int x, int y)
 	change_vali(key,active_param,'d',&diffusivity_type_d);
 	change_valf(key,active_param,'e',&warp_eta);
 	change_valf(key,active_param,'E',&epsilon_d);
+	change_valf(key,active_param,'S',&epsilon_s);
+	change_valf(key,active_param,'w',&w_bright_grad);
 	change_vali(key,active_param,'i',&num_iterations_inner);
 	change_vali(key,active_param,'I',&num_iterations_outer);
 	change_valf(key,active_param,'l',&max_displacement);
@@ -192,6 +212,7 @@ void handleKeyboardspecial(int key, int x, int y)
 	clamp(0,&num_iterations_outer,10000000);
 	clampf(0,&omega,2);
 	clampf(0,&warp_eta,1);
+	clampf(0,&w_bright_grad,1);
 	clamp(0,&max_warp_levels,10000000);
 	showParams();    
 }
@@ -248,6 +269,227 @@ void ReSizeGLScene(int Width, int Height)
     glLoadIdentity();
 }
 
+/*-------------------------------------------------------------------------------------*/
+/* Sequence mode                                                                       */
+/*                                                                                     */
+/* The flow between frames k and k+1 is written to <sequence_out><k>.flo. With         */
+/* pipeline 1 a loader thread decodes the upcoming frames into a bounded queue while   */
+/* the solver works on the current pair, and a writer thread takes the finished flow   */
+/* fields from a second bounded queue, so reading and writing overlap with compute.    */
+/* queue_depth bounds the memory: at most queue_depth frames are decoded ahead and at  */
+/* most queue_depth flow fields wait for the writer. pipeline 0 does the same steps    */
+/* one after another for comparison.                                                   */
+/*-------------------------------------------------------------------------------------*/
+
+typedef struct
+{
+	int    index;                   // frame number
+	int    nx,ny;                   // frame size
+	float  **f;                     // frame with bx,by boundaries
+} seq_frame;
+
+typedef struct
+{
+	int    index;                   // number of the first frame of the pair
+	int    nx,ny;                   // size of the flow field
+	float  **u,**v;                 // flow field with bx,by boundaries
+} seq_flow;
+
+bounded_queue seq_frames;           // loader -> solver
+bounded_queue seq_flows;            // solver -> writer
+double        seq_wait_load;        // time the solver waited for frames [s]
+double        seq_wait_write;       // time the solver waited for the writer [s]
+int           seq_write_errors;     // flow files that could not be written
+
+/*-------------------------------------------------------------------------------------*/
+
+seq_frame *load_frame(int k)
+{
+	char      filename[256];
+	int       maxgv;
+	seq_frame *fr = (seq_frame*)malloc(sizeof(seq_frame));
+
+	snprintf(filename,sizeof(filename),"%s%d.pgm",basename,k);
+	fr->index = k;
+	fr->f     = read_pgm_image_mapped(filename,&fr->nx,&fr->ny,bx,by,&maxgv);
+	if (!fr->f)
+	{
+		free(fr);
+		return NULL;
+	}
+	return fr;
+}
+
+void free_frame(seq_frame *fr)
+{
+	free_pgm_image(fr->f,fr->nx,fr->ny,bx,by);
+	free(fr);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+void write_flow(seq_flow *fl)
+{
+	char filename[256];
+
+	snprintf(filename,sizeof(filename),"%s%d.flo",sequence_out,fl->index);
+	// only one thread writes, and the count is read after it was joined
+	if (!write_flo_data(filename,fl->u,fl->v,fl->nx,fl->ny,bx,by))
+		seq_write_errors++;
+	free_multi(2,2,sizeof(float),fl->nx,fl->ny,bx,by,0,0,&fl->u,&fl->v);
+	free(fl);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+seq_flow *compute_pair(seq_frame *a, seq_frame *b)
+{
+	seq_flow *fl = (seq_flow*)malloc(sizeof(seq_flow));
+
+	fl->index = a->index;
+	fl->nx    = a->nx;
+	fl->ny    = a->ny;
+	calloc_multi(2,2,sizeof(float),fl->nx,fl->ny,bx,by,0,0,&fl->u,&fl->v);
+	HORN_SCHUNCK_MAIN_OPT(a->f,b->f,fl->u,fl->v,fl->nx,fl->ny,bx,by,1.0f,1.0f,
+					  alpha,epsilon_d,epsilon_s,w_bright_grad,num_iterations_inner,
+					  num_iterations_outer,warp_eta,omega,max_warp_levels,&options);
+	return fl;
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+void *loader_thread(void *arg)
+{
+	int       k;
+	seq_frame *fr;
+
+	for (k = 1; k <= sequence; k++)
+	{
+		if (!(fr = load_frame(k)))
+			break;
+		if (!queue_push(&seq_frames,fr))
+		{
+			// the solver gave up, nobody will take the frame
+			free_frame(fr);
+			break;
+		}
+	}
+	queue_close(&seq_frames);
+	return NULL;
+}
+
+void *writer_thread(void *arg)
+{
+	seq_flow *fl;
+
+	while ((fl = (seq_flow*)queue_pop(&seq_flows)))
+		write_flow(fl);
+	return NULL;
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+seq_frame *next_frame(int k)
+{
+	seq_frame *fr;
+	double    t0 = wall_time();
+
+	if (pipeline)
+		fr = (seq_frame*)queue_pop(&seq_frames);
+	else
+		fr = load_frame(k);
+	seq_wait_load += wall_time() - t0;
+	return fr;
+}
+
+void put_flow(seq_flow *fl)
+{
+	double t0 = wall_time();
+
+	if (pipeline)
+		queue_push(&seq_flows,fl);
+	else
+		write_flow(fl);
+	seq_wait_write += wall_time() - t0;
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+int run_sequence()
+{
+	pthread_t  loader, writer;
+	seq_frame  *prev, *cur;
+	int        pairs = 0;
+	double     t0, t_compute = 0.0, t_total;
+
+	if (pipeline)
+	{
+		if (!queue_init(&seq_frames,queue_depth) || !queue_init(&seq_flows,queue_depth))
+		{
+			console_error("Could not allocate the frame queues!\n");
+			return 1;
+		}
+	}
+	seq_wait_load = seq_wait_write = 0.0;
+	seq_write_errors = 0;
+
+	t_total = wall_time();
+	if (pipeline)
+	{
+		pthread_create(&loader,NULL,loader_thread,NULL);
+		pthread_create(&writer,NULL,writer_thread,NULL);
+	}
+
+	prev = next_frame(1);
+	while (prev && (prev->index < sequence))
+	{
+		if (!(cur = next_frame(prev->index+1)))
+			break;
+		if ((cur->nx != prev->nx) || (cur->ny != prev->ny))
+		{
+			console_error("Frame %d differs in size from frame %d!\n",
+						  cur->index,prev->index);
+			free_frame(cur);
+			break;
+		}
+
+		t0 = wall_time();
+		put_flow(compute_pair(prev,cur));
+		t_compute += wall_time() - t0;
+		pairs++;
+
+		free_frame(prev);
+		prev = cur;
+	}
+	if (prev)
+		free_frame(prev);
+
+	if (pipeline)
+	{
+		// stop the loader if we broke off early, then let the writer drain
+		queue_close(&seq_frames);
+		while ((cur = (seq_frame*)queue_pop(&seq_frames)))
+			free_frame(cur);
+		pthread_join(loader,NULL);
+		queue_close(&seq_flows);
+		pthread_join(writer,NULL);
+		queue_free(&seq_frames);
+		queue_free(&seq_flows);
+	}
+	t_total = wall_time() - t_total;
+
+	t_compute -= seq_wait_write;
+	printf("sequence %s: %d pairs, %s, %.1f ms total, %.2f pairs/s\n",
+		   basename,pairs,pipeline ? "pipelined" : "serial",1000.0*t_total,
+		   pairs/t_total);
+	printf("  compute %.1f ms, waiting for frames %.1f ms, for output %.1f ms\n",
+		   1000.0*t_compute,1000.0*seq_wait_load,1000.0*seq_wait_write);
+	if (seq_write_errors)
+		console_error("%d flow files could not be written!\n",seq_write_errors);
+
+	return ((pairs == sequence-1) && !seq_write_errors) ? 0 : 1;
+}
+
 /*-------------------------------------------------------------------------------------*/
 
 int main (int argc, char* argv[])
@@ -262,6 +504,8 @@ int main (int argc, char* argv[])
 	parse_arg_int   (argc,argv,"bordersizey",&by,2,console_string);
 	parse_arg_float (argc,argv,"alpha",&alpha,100,console_string);
 	parse_arg_float (argc,argv,"epsilon_d",&epsilon_d,0.01f,console_string);
+	parse_arg_float (argc,argv,"epsilon_s",&epsilon_s,0.01f,console_string);
+	parse_arg_float (argc,argv,"w_bright_grad",&w_bright_grad,0.0f,console_string);
 	parse_arg_int   (argc,argv,"diffusivity_type_d",&diffusivity_type_d,0,console_string);
 	parse_arg_int   (argc,argv,"iterations_inner",&num_iterations_inner,30,console_string);
 	parse_arg_int   (argc,argv,"iterations_outer",&num_iterations_outer,5,console_string);
@@ -271,8 +515,32 @@ int main (int argc, char* argv[])
 	parse_arg_float (argc,argv,"max_displacement",&max_displacement,5.0f,console_string);
 	parse_arg_string(argc,argv,"basename",basename,"../images/yos",console_string);
 	parse_arg_int   (argc,argv,"no_frontend",&no_frontend,0,console_string);
+	parse_arg_int   (argc,argv,"sequence",&sequence,0,console_string);
+	parse_arg_string(argc,argv,"sequence_out",sequence_out,"flow",console_string);
+	parse_arg_int   (argc,argv,"queue_depth",&queue_depth,4,console_string);
+	parse_arg_int   (argc,argv,"pipeline",&pipeline,1,console_string);
+	// many inner iterations by default, so assemble the SOR weights only once
+	hs_default_options(&options);
+	parse_arg_int   (argc,argv,"sor_weights",&options.sor_weights,1,console_string);
+	parse_arg_int   (argc,argv,"adaptive_omega",&options.adaptive_omega,0,console_string);
+	parse_arg_float (argc,argv,"inner_tolerance",&options.inner_tolerance,0.0f,console_string);
+	parse_arg_int   (argc,argv,"line_relax",&options.line_relax,0,console_string);
+	parse_arg_float (argc,argv,"line_omega",&options.line_omega,1.0f,console_string);
+	parse_arg_int   (argc,argv,"pcg",&options.pcg,0,console_string);
+	parse_arg_int   (argc,argv,"tvl1",&options.tvl1,0,console_string);
+	parse_arg_int   (argc,argv,"tvl1_iterations",&options.tvl1_iterations,50,console_string);
+	int use_cache;
+	parse_arg_int   (argc,argv,"cache",&use_cache,1,console_string);
 	char filename[200];
 	printf("------\n%s---------\n",console_string);
+
+	if (sequence > 0)
+		return run_sequence();
+
+	// interactive mode: a parameter change only recomputes the stages it affects
+	hs_cache_init(&cache);
+	if (use_cache)
+		options.cache = &cache;
 	
 	sprintf(filename,"%s1.pgm",basename);
 	f1 = read_pgm_image(filename,&nx,&ny,bx,by,&maxgv);
@@ -37,9 +37,9 @@ float  ue,ve;       /* computed  ( (e)stimated) flow field                   */
 float  temp1,temp2; /* time saver                                            */
 float  conv_const;  /* time saver                                            */
 float  aux;         /* time saver                                            */
-int    kcal;        /* percentage of pixels of the calculated flow field     */
+long   kcal;        /* percentage of pixels of the calculated flow field     */
                     /* where the optic flow exists                           */
-int    kref;        /* percentage of pixels of the reference flow field      */
+long   kref;        /* percentage of pixels of the reference flow field      */
                     /* where the optic flow exists                           */
 int    i,j;         /* loop variables                                        */
                     /*********************************************************/
@@ -100,8 +100,8 @@ conv_const = (180.0 / 3.1415927) ;
 *al2e = sum2 /((float) kcal);
 
 /* calucalte densities */
-*ref_d = (float)kref/(nx*ny);
-*cal_d = (float)kcal/(nx*ny);
+*ref_d = (float)kref/((float)nx*ny);
+*cal_d = (float)kcal/((float)nx*ny);
 
 }
 
@@ -0,0 +1,73 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Precision policy of the solver kernels, fixed at build time with          */
+/* -DOF_PRECISION=<n> (make PRECISION=<name>, see the Makefile).             */
+/*                                                                           */
+/* The planes are float under every policy; the policy only selects the     */
+/* arithmetic inside the per-pixel kernels:                                  */
+/*                                                                           */
+/*   0 legacy      the mix of the original code: float temporaries, double  */
+/*                 literals and sqrt. Bit-identical to it, the default.     */
+/*   1 float       float math throughout, no conversions in the loops.      */
+/*   2 accumulate  every sum, product and quotient in double, rounded to    */
+/*                 float when stored in a temporary or a plane.             */
+/*   3 double      double math and double temporaries; rounded to float     */
+/*                 only when stored in a plane.                             */
+/*                                                                           */
+/* of_real  type of the named temporaries of a kernel                        */
+/* of_acc   type the expressions are evaluated in                            */
+/* OF_C     literal constant                                                 */
+/* OF_ACC   promotes the first operand of an expression to the accumulation  */
+/*          type, so the whole expression is evaluated in it                 */
+/* OF_SQRT  square root in the accumulation type                             */
+/*                                                                           */
+/*****************************************************************************/
+
+
+#ifndef PRECISION_LIB_H_INCLUDED
+#define PRECISION_LIB_H_INCLUDED
+
+#include <math.h>
+
+#define OF_PRECISION_LEGACY     0
+#define OF_PRECISION_FLOAT      1
+#define OF_PRECISION_ACCUMULATE 2
+#define OF_PRECISION_DOUBLE     3
+
+#ifndef OF_PRECISION
+#define OF_PRECISION OF_PRECISION_LEGACY
+#endif
+
+#if OF_PRECISION == OF_PRECISION_LEGACY
+typedef float  of_real;
+typedef double of_acc;
+#define OF_C(x)     (x)
+#define OF_ACC(x)   (x)
+#define OF_SQRT(x)  sqrt(x)
+#define OF_PRECISION_NAME "legacy"
+#elif OF_PRECISION == OF_PRECISION_FLOAT
+typedef float  of_real;
+typedef float  of_acc;
+#define OF_C(x)     ((float)(x))
+#define OF_ACC(x)   (x)
+#define OF_SQRT(x)  sqrtf(x)
+#define OF_PRECISION_NAME "float"
+#elif OF_PRECISION == OF_PRECISION_ACCUMULATE
+typedef float  of_real;
+typedef double of_acc;
+#define OF_C(x)     ((double)(x))
+#define OF_ACC(x)   ((double)(x))
+#define OF_SQRT(x)  sqrt(x)
+#define OF_PRECISION_NAME "accumulate"
+#elif OF_PRECISION == OF_PRECISION_DOUBLE
+typedef double of_real;
+typedef double of_acc;
+#define OF_C(x)     ((double)(x))
+#define OF_ACC(x)   ((double)(x))
+#define OF_SQRT(x)  sqrt(x)
+#define OF_PRECISION_NAME "double"
+#else
+#error "OF_PRECISION must be 0 (legacy), 1 (float), 2 (accumulate) or 3 (double)"
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef QUEUE_LIB_INCLUDED
+#define QUEUE_LIB_INCLUDED
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Bounded blocking FIFO of pointers for producer/consumer pipelines.        */
+/* push blocks while the queue is full and pop blocks while it is empty, so  */
+/* the capacity bounds the number of items (frames, flow fields) in flight.  */
+/* After queue_close, push fails and pop drains the remaining items and      */
+/* returns NULL once the queue is empty.                                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct
+{
+  void            **items;    /* ring buffer of capacity entries            */
+  int             capacity;   /* maximal number of queued items             */
+  int             head;       /* index of the oldest item                   */
+  int             count;      /* number of queued items                     */
+  int             closed;     /* no more items will be pushed               */
+  pthread_mutex_t lock;       /* protects all fields above                  */
+  pthread_cond_t  not_empty;  /* signalled after push and close             */
+  pthread_cond_t  not_full;   /* signalled after pop and close              */
+} bounded_queue;
+
+/*---------------------------------------------------------------------------*/
+
+int queue_init
+(
+                          /***************************************************/
+    bounded_queue *q,     /* out : queue                                     */
+    int           capacity/* in  : maximal number of queued items            */
+                          /***************************************************/
+)
+
+/* returns 1 on success and 0 if the ring buffer could not be allocated */
+
+{
+if (capacity < 1) capacity = 1;
+q->items = (void**)malloc(capacity*sizeof(void*));
+if (!q->items)
+    return 0;
+q->capacity = capacity;
+q->head     = 0;
+q->count    = 0;
+q->closed   = 0;
+pthread_mutex_init(&q->lock,NULL);
+pthread_cond_init(&q->not_empty,NULL);
+pthread_cond_init(&q->not_full,NULL);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int queue_push
+(
+                          /***************************************************/
+    bounded_queue *q,     /* in+out : queue                                  */
+    void          *item   /* in     : item to be appended (not NULL)         */
+                          /***************************************************/
+)
+
+/* appends an item, waiting for a free slot; returns 0 if the queue was    */
+/* closed and the item was not queued                                      */
+
+{
+pthread_mutex_lock(&q->lock);
+while ((q->count == q->capacity) && !q->closed)
+    pthread_cond_wait(&q->not_full,&q->lock);
+if (q->closed)
+{
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+q->items[(q->head + q->count) % q->capacity] = item;
+q->count++;
+pthread_cond_signal(&q->not_empty);
+pthread_mutex_unlock(&q->lock);
+return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void *queue_pop
+(
+                          /***************************************************/
+    bounded_queue *q      /* in+out : queue                                  */
+                          /***************************************************/
+)
+
+/* removes the oldest item, waiting for one; returns NULL once the queue   */
+/* is closed and empty                                                     */
+
+{
+void *item;
+
+pthread_mutex_lock(&q->lock);
+while ((q->count == 0) && !q->closed)
+    pthread_cond_wait(&q->not_empty,&q->lock);
+if (q->count == 0)
+{
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+item = q->items[q->head];
+q->head = (q->head + 1) % q->capacity;
+q->count--;
+pthread_cond_signal(&q->not_full);
+pthread_mutex_unlock(&q->lock);
+return item;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void queue_close
+(
+                          /***************************************************/
+    bounded_queue *q      /* in+out : queue                                  */
+                          /***************************************************/
+)
+
+/* marks the end of the stream and wakes up all waiting threads */
+
+{
+pthread_mutex_lock(&q->lock);
+q->closed = 1;
+pthread_cond_broadcast(&q->not_empty);
+pthread_cond_broadcast(&q->not_full);
+pthread_mutex_unlock(&q->lock);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void queue_free
+(
+                          /***************************************************/
+    bounded_queue *q      /* in+out : queue, must not be in use any more     */
+                          /***************************************************/
+)
+{
+pthread_cond_destroy(&q->not_full);
+pthread_cond_destroy(&q->not_empty);
+pthread_mutex_destroy(&q->lock);
+free(q->items);
+q->items = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+#endif
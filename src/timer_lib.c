@@ -0,0 +1,71 @@
+#ifndef TIMER_LIB_INCLUDED
+#define TIMER_LIB_INCLUDED
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/* Wall clock helpers for benchmarks and batch tools.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <time.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------*/
+
+double wall_time (void)
+
+/* returns a monotonic wall clock time stamp in seconds */
+
+{
+struct timespec ts;
+
+clock_gettime(CLOCK_MONOTONIC, &ts);
+return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+
+double thread_time (void)
+
+/* returns the CPU time of the calling thread in seconds */
+
+{
+struct timespec ts;
+
+clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+return (double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int compare_double (const void *a, const void *b)
+
+/* comparison function for qsort on arrays of double */
+
+{
+double da = *(const double*)a;
+double db = *(const double*)b;
+
+return (da > db) - (da < db);
+}
+
+/*---------------------------------------------------------------------------*/
+
+double median_double
+(
+                     /********************************************************/
+    double *t,       /* in+out : samples (sorted on return)                  */
+    int    n         /* in     : number of samples                           */
+                     /********************************************************/
+)
+
+/* returns the median of n samples */
+
+{
+if (n <= 0) return 0.0;
+qsort(t, n, sizeof(double), compare_double);
+return (n % 2) ? t[n/2] : 0.5 * (t[n/2-1] + t[n/2]);
+}
+
+/*---------------------------------------------------------------------------*/
+#endif